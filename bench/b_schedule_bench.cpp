@@ -0,0 +1,134 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <gmp.h>
+
+#include "../common/corpus.h"
+#include "../common/get_timestamp.h"
+#include "../common/job_log.h"
+#include "../common/prime_table.h"
+#include "../common/thread_pool.h"
+#include "../pollard/b_schedule.h"
+#include "../pollard/cpu_factor.h"
+#include "../pollard/kernel.h"
+
+#define B_START 2
+#define B_JUMP 2048
+#define BENCH_B_MAX 4194304 // 2^22
+
+/*
+ * Time to the first factor for every B schedule strategy over a corpus in the
+ * format of common/corpus.h, CPU backend. A strategy only counts an entry as
+ * found when its factor is one of the entry's known primes.
+ */
+
+struct strategy_result_t {
+    const char *name;
+    unsigned found = 0;
+    std::vector<long long> times_us;
+};
+
+int main(int argc, char *argv[]) {
+    unsigned b_max = BENCH_B_MAX;
+    unsigned threads = default_worker_count();
+    const char *corpus = "bench/schedule_corpus.txt";
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-b_max") == 0 && i + 1 < argc) {
+            b_max = (unsigned) strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            threads = (unsigned) atoi(argv[++i]);
+        } else if (argv[i][0] != '-') {
+            corpus = argv[i];
+        } else {
+            fprintf(stderr, "Usage: %s [-b_max B] [-t threads] [corpus file]\n", argv[0]);
+            return -1;
+        }
+    }
+
+    std::string version;
+    std::vector<corpus_entry_t> entries;
+    if (corpus_load(corpus, &version, entries) != 0 || entries.empty()) {
+        return -1;
+    }
+
+    unsigned primes_num = MAX_PRIMES;
+    auto *prime_table = (unsigned *) calloc(primes_num, sizeof(unsigned));
+    if (generate_prime_table(prime_table, primes_num) != 0) {
+        return -1;
+    }
+
+    const int strategies = 4; // linear, geometric, cost model, per-size default
+    strategy_result_t results[strategies];
+    results[0].name = b_schedule_name(B_SCHEDULE_LINEAR);
+    results[1].name = b_schedule_name(B_SCHEDULE_GEOMETRIC);
+    results[2].name = b_schedule_name(B_SCHEDULE_COST_MODEL);
+    results[3].name = "auto";
+
+    mpz_t n, factor, known;
+    mpz_init(n);
+    mpz_init(factor);
+    mpz_init(known);
+
+    printf("Corpus %s (%s), %u entries\n", corpus, version.c_str(), (unsigned) entries.size());
+    std::string discarded; // per-step progress output of the backend
+    for (auto &entry : entries) {
+        mpz_set_str(n, entry.number.c_str(), 16);
+        const auto bits = (unsigned) mpz_sizeinbase(n, 2);
+
+        printf("0x%s (%u bits, B1 %s):", entry.number.c_str(), bits, entry.smoothness.c_str());
+        for (int s = 0; s < strategies; s++) {
+            const b_schedule_t schedule = s < 3
+                                          ? b_schedule_make((b_schedule_kind_t) s, bits, B_START, B_JUMP, b_max)
+                                          : b_schedule_for_bits(bits, B_START, B_JUMP, b_max);
+
+            unsigned b_found = 0;
+            int res;
+            const long long start = get_timestamp();
+            {
+                JobLogScope log_scope(discarded);
+                res = threads > 1
+                      ? cpu_factorize_parallel(n, prime_table, primes_num, schedule, threads, &factor, &b_found)
+                      : cpu_factorize(n, prime_table, primes_num, schedule, &factor, &b_found);
+            }
+            const long long elapsed = get_timestamp() - start;
+            discarded.clear();
+
+            bool found = false;
+            for (auto &prime : entry.factors) {
+                mpz_set_str(known, prime.c_str(), 16);
+                if (res == 0 && mpz_cmp(factor, known) == 0) found = true;
+            }
+            if (found) {
+                results[s].found++;
+                results[s].times_us.push_back(elapsed);
+            }
+            printf(" %s %s %ld.%06ld s", results[s].name, found ? "ok" : "--", (long) (elapsed / 1000000),
+                   (long) (elapsed % 1000000));
+            fflush(stdout);
+        }
+        printf("\n");
+    }
+
+    printf("\n%-10s %8s %14s %14s\n", "strategy", "found", "total [s]", "median [s]");
+    for (auto &result : results) {
+        long long total = 0, median = 0;
+        for (auto t : result.times_us) total += t;
+        if (!result.times_us.empty()) {
+            std::sort(result.times_us.begin(), result.times_us.end());
+            median = result.times_us[result.times_us.size() / 2];
+        }
+        printf("%-10s %4u/%-3u %14.6f %14.6f\n", result.name, result.found, (unsigned) entries.size(),
+               total / 1e6, median / 1e6);
+    }
+
+    mpz_clear(n);
+    mpz_clear(factor);
+    mpz_clear(known);
+    free(prime_table);
+    return 0;
+}
@@ -0,0 +1,292 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <gmp.h>
+
+#include "../common/corpus.h"
+#include "../common/get_timestamp.h"
+#include "../common/json_line.h"
+#include "../pollard/b_schedule.h"
+#include "../pollard/libpollard.h"
+
+#define E2E_THRESHOLD 10.0        // percent of throughput a bucket may lose against the baseline
+#define E2E_SUCCESS_THRESHOLD 0.0 // percentage points of success rate a bucket may lose
+
+/*
+ * End-to-end regression run over a versioned corpus of moduli with known
+ * factors (common/corpus.h, as written by test_data). Every input goes through the library exactly as a client submits
+ * it; a result only counts when its factors are exactly the known ones.
+ * Results are reported per (bits, B1) bucket and compared with a baseline of
+ * the same corpus version, any regression beyond the thresholds exits with 1.
+ */
+
+struct entry_result_t {
+    bool factored = false;
+    long long elapsed_us = 0;
+};
+
+struct bucket_stats_t {
+    unsigned count = 0;
+    unsigned factored = 0;
+    double rate = 0;  // factorizations per second of job time
+    long long median_us = 0;
+    long long p99_us = 0;
+};
+
+// the reported factors are exactly the known primes of the entry, with their powers multiplying back to N
+static bool matches_known(const corpus_entry_t &entry, const pollard_result_t *result) {
+    if (result->status != POLLARD_FACTORED) return false;
+
+    mpz_t n, product, factor, expected;
+    mpz_init_set_str(n, entry.number.c_str(), 16);
+    mpz_init_set_ui(product, 1);
+    mpz_init(factor);
+    mpz_init(expected);
+
+    bool known = true;
+    for (size_t i = 0; i < result->factor_count && known; i++) {
+        mpz_set_str(factor, result->factors[i].prime, 16);
+        bool listed = false;
+        for (auto &prime : entry.factors) {
+            mpz_set_str(expected, prime.c_str(), 16);
+            listed |= mpz_cmp(factor, expected) == 0;
+        }
+        known = listed;
+        for (unsigned p = 0; p < result->factors[i].power; p++) {
+            mpz_mul(product, product, factor);
+        }
+    }
+    known = known && mpz_cmp(product, n) == 0;
+
+    mpz_clear(n);
+    mpz_clear(product);
+    mpz_clear(factor);
+    mpz_clear(expected);
+    return known;
+}
+
+static bucket_stats_t summarize(const std::vector<long long> &latencies, unsigned count, unsigned factored) {
+    bucket_stats_t stats;
+    stats.count = count;
+    stats.factored = factored;
+
+    std::vector<long long> sorted(latencies);
+    std::sort(sorted.begin(), sorted.end());
+    long long total_us = 0;
+    for (auto t : sorted) total_us += t;
+    if (!sorted.empty()) {
+        stats.median_us = sorted[sorted.size() / 2];
+        stats.p99_us = sorted[std::min(sorted.size() - 1, (sorted.size() * 99 + 99) / 100 - 1)];
+    }
+    stats.rate = total_us > 0 ? factored * 1e6 / (double) total_us : 0;
+    return stats;
+}
+
+static int load_baseline(const char *filename, std::string &version, std::map<std::string, bucket_stats_t> &buckets) {
+    FILE *file = fopen(filename, "r");
+    if (file == nullptr) {
+        fprintf(stderr, "Cannot open baseline %s\n", filename);
+        return -1;
+    }
+
+    char line[4096];
+    while (fgets(line, sizeof(line), file) != nullptr) {
+        json_object_t object;
+        std::string error;
+        if (json_parse_object(line, &object, &error) != 0) continue;
+        if (object.count("corpus") != 0) {
+            version = object["corpus"].text;
+        } else if (object.count("bucket") != 0) {
+            bucket_stats_t &stats = buckets[object["bucket"].text];
+            stats.count = (unsigned) atoi(object["count"].text.c_str());
+            stats.factored = (unsigned) atoi(object["factored"].text.c_str());
+            stats.rate = atof(object["rate"].text.c_str());
+            stats.median_us = atoll(object["median_us"].text.c_str());
+            stats.p99_us = atoll(object["p99_us"].text.c_str());
+        }
+    }
+    fclose(file);
+    return 0;
+}
+
+static int save_results(const char *filename, const std::string &version,
+                        const std::map<std::string, bucket_stats_t> &buckets) {
+    FILE *file = fopen(filename, "w");
+    if (file == nullptr) {
+        fprintf(stderr, "Cannot write %s\n", filename);
+        return -1;
+    }
+    fprintf(file, "{\"corpus\": %s}\n", json_quote(version).c_str());
+    for (auto &bucket : buckets) {
+        fprintf(file, "{\"bucket\": %s, \"count\": %u, \"factored\": %u, \"rate\": %.3f, \"median_us\": %lld, "
+                      "\"p99_us\": %lld}\n", json_quote(bucket.first).c_str(), bucket.second.count,
+                bucket.second.factored, bucket.second.rate, bucket.second.median_us, bucket.second.p99_us);
+    }
+    fclose(file);
+    return 0;
+}
+
+struct pending_t {
+    const corpus_entry_t *entry;
+    entry_result_t *result;
+    std::mutex *lock;
+    std::condition_variable *done;
+    size_t *remaining;
+};
+
+static void entry_done(void *user, const pollard_result_t *result) {
+    auto *pending = (pending_t *) user;
+    pending->result->factored = matches_known(*pending->entry, result);
+    pending->result->elapsed_us = result->elapsed_us;
+
+    std::lock_guard<std::mutex> guard(*pending->lock);
+    if (--*pending->remaining == 0) pending->done->notify_all();
+    delete pending;
+}
+
+int main(int argc, char *argv[]) {
+    pollard_options_t options;
+    pollard_options_init(&options);
+    options.gmp_arena = 1; // this process owns GMP's allocator
+    const char *corpus = "bench/e2e_corpus.txt";
+    const char *json_out = nullptr;
+    const char *baseline_file = nullptr;
+    double threshold = E2E_THRESHOLD;
+    double success_threshold = E2E_SUCCESS_THRESHOLD;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-cpu") == 0) {
+            options.use_cpu = 1;
+        } else if (strcmp(argv[i], "-cpu-kernel") == 0) {
+            options.use_cpu = 1;
+            options.host_kernel = 1;
+        } else if (strcmp(argv[i], "-hybrid") == 0) {
+            options.hybrid = 1;
+        } else if (strcmp(argv[i], "-no-numa") == 0) {
+            options.no_numa = 1;
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            options.job_threads = (unsigned) atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            options.search_threads = (unsigned) atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-schedule") == 0 && i + 1 < argc) {
+            b_schedule_kind_t schedule_kind;
+            if (b_schedule_parse(argv[++i], &schedule_kind) != 0) {
+                fprintf(stderr, "Unknown B schedule: %s\n", argv[i]);
+                return -1;
+            }
+            options.schedule = schedule_kind;
+        } else if (strcmp(argv[i], "-deadline") == 0 && i + 1 < argc) {
+            options.deadline_ms = atoll(argv[++i]);
+        } else if (strcmp(argv[i], "-json") == 0 && i + 1 < argc) {
+            json_out = argv[++i];
+        } else if (strcmp(argv[i], "-baseline") == 0 && i + 1 < argc) {
+            baseline_file = argv[++i];
+        } else if (strcmp(argv[i], "-threshold") == 0 && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-success-threshold") == 0 && i + 1 < argc) {
+            success_threshold = atof(argv[++i]);
+        } else if (argv[i][0] != '-') {
+            corpus = argv[i];
+        } else {
+            fprintf(stderr, "Usage: %s [-cpu] [-cpu-kernel] [-hybrid] [-no-numa] [-j jobs] [-t search threads] "
+                            "[-schedule linear|geometric|cost] [-deadline ms] [-json out] [-baseline file] "
+                            "[-threshold percent] [-success-threshold points] [corpus file]\n", argv[0]);
+            return -1;
+        }
+    }
+
+    std::string version;
+    std::vector<corpus_entry_t> entries;
+    if (corpus_load(corpus, &version, entries) != 0 || entries.empty()) {
+        return -1;
+    }
+
+    std::string baseline_version;
+    std::map<std::string, bucket_stats_t> baseline;
+    if (baseline_file != nullptr) {
+        if (load_baseline(baseline_file, baseline_version, baseline) != 0) return -1;
+        if (baseline_version != version) {
+            fprintf(stderr, "Baseline was taken on corpus %s, this is %s\n", baseline_version.c_str(),
+                    version.c_str());
+            return -1;
+        }
+    }
+
+    pollard_context_t *context = pollard_create(&options);
+    if (context == nullptr || pollard_prepare(context) != 0) {
+        return -1;
+    }
+
+    std::vector<entry_result_t> results(entries.size());
+    std::mutex lock;
+    std::condition_variable done;
+    size_t remaining = entries.size();
+
+    const long long start = get_timestamp();
+    for (size_t i = 0; i < entries.size(); i++) {
+        auto *pending = new pending_t{&entries[i], &results[i], &lock, &done, &remaining};
+        if (pollard_submit(context, entries[i].number.c_str(), 0, 0, entry_done, pending) != 0) {
+            fprintf(stderr, "Not a hex number: %s\n", entries[i].number.c_str());
+            delete pending;
+            std::lock_guard<std::mutex> guard(lock);
+            remaining--;
+        }
+    }
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        done.wait(guard, [&]() { return remaining == 0; });
+    }
+    const long long wall_us = get_timestamp() - start;
+    pollard_destroy(context);
+
+    // buckets in corpus order, "all" last
+    std::vector<std::string> order;
+    std::map<std::string, std::vector<long long>> latencies;
+    std::map<std::string, unsigned> counts, factored;
+    for (size_t i = 0; i < entries.size(); i++) {
+        for (const std::string &bucket : {entries[i].bucket(), std::string("all")}) {
+            if (counts[bucket]++ == 0 && bucket != "all") order.push_back(bucket);
+            latencies[bucket].push_back(results[i].elapsed_us);
+            if (results[i].factored) factored[bucket]++;
+        }
+    }
+    order.push_back("all");
+
+    std::map<std::string, bucket_stats_t> buckets;
+    bool regressed = false;
+    printf("\ncorpus %s, %zu inputs in %.3f s, %.3f factorizations/s\n", version.c_str(), entries.size(),
+           wall_us / 1e6, wall_us > 0 ? factored["all"] * 1e6 / wall_us : 0.0);
+    printf("%-20s %8s %10s %12s %14s %14s  %s\n", "bits/B1:B2", "success", "rate [%]", "fact/job-s", "median [ms]",
+           "p99 [ms]", baseline.empty() ? "" : "vs baseline");
+    for (auto &bucket : order) {
+        const bucket_stats_t stats = summarize(latencies[bucket], counts[bucket], factored[bucket]);
+        buckets[bucket] = stats;
+        const double success = 100.0 * stats.factored / stats.count;
+        printf("%-20s %4u/%-3u %10.1f %12.3f %14.3f %14.3f", bucket.c_str(), stats.factored, stats.count, success,
+               stats.rate, stats.median_us / 1e3, stats.p99_us / 1e3);
+
+        auto base = baseline.find(bucket);
+        if (base != baseline.end() && base->second.count > 0) {
+            const double base_success = 100.0 * base->second.factored / base->second.count;
+            const double rate_change = base->second.rate > 0 ? (stats.rate / base->second.rate - 1.0) * 100.0 : 0;
+            const bool slower = rate_change < -threshold;
+            const bool lost = success < base_success - success_threshold;
+            printf("  rate %+.1f%%, success %+.1f pts%s", rate_change, success - base_success,
+                   slower || lost ? "  REGRESSION" : "");
+            regressed |= slower || lost;
+        }
+        printf("\n");
+    }
+
+    if (json_out != nullptr && save_results(json_out, version, buckets) != 0) {
+        return -1;
+    }
+    return regressed ? 1 : 0;
+}
@@ -0,0 +1,351 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <gmp.h>
+
+#include "../common/gmp_arena.h"
+#include "../common/job_log.h"
+#include "../common/json_line.h"
+#include "../common/prime_table.h"
+#include "../pollard/b_schedule.h"
+#include "../pollard/cpu_factor.h"
+#include "../pollard/exponent_cache.h"
+#include "../pollard/host_kernel.h"
+#include "../pollard/kernel.h"
+#include "../pollard/limbs.h"
+#include "../primegen/primegen.h"
+
+#define BENCH_REPS 7          // samples per case, min and median are taken over them
+#define BENCH_MIN_TIME_MS 50  // iterations per sample grow until a sample takes this long
+#define BENCH_SEED 1          // operands are the same on every run
+#define BENCH_THRESHOLD 10.0  // percent, median changes beyond it are flagged against a baseline
+#define BENCH_BATCH 16        // moduli per batch_stage1 case
+
+/*
+ * Micro-benchmarks of the host hot paths: limb conversion, exponent
+ * construction, stage 1, the prime sieve and the prime table. Every case is
+ * sampled BENCH_REPS times after a warm-up call; the JSON baseline is one
+ * object per line and a later run compares its medians against it.
+ */
+
+struct bench_case_t {
+    std::string name;
+    std::function<void()> op;
+};
+
+struct bench_result_t {
+    std::string name;
+    unsigned long long iterations; // per sample
+    double min_ns;
+    double median_ns;
+};
+
+static const unsigned operand_bits[] = {64, 128, 256, 512, 1024, 2048};
+
+static double now_ns() {
+    return (double) std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// the factors are balanced so stage 1 runs to the end
+static void random_semiprime(mpz_t n, unsigned bits, gmp_randstate_t random) {
+    mpz_t p, q;
+    mpz_init(p);
+    mpz_init(q);
+    do {
+        mpz_urandomb(p, random, bits / 2);
+        mpz_setbit(p, bits / 2 - 1);
+        mpz_nextprime(p, p);
+        mpz_urandomb(q, random, bits - bits / 2);
+        mpz_setbit(q, bits - bits / 2 - 1);
+        mpz_nextprime(q, q);
+        mpz_mul(n, p, q);
+    } while (mpz_sizeinbase(n, 2) != bits);
+    mpz_clear(p);
+    mpz_clear(q);
+}
+
+static bench_result_t run_case(const bench_case_t &bench, unsigned reps, double min_time_ns) {
+    bench.op(); // warm-up, caches and allocations
+
+    unsigned long long iterations = 1;
+    while (true) {
+        const double start = now_ns();
+        for (unsigned long long i = 0; i < iterations; i++) bench.op();
+        const double elapsed = now_ns() - start;
+        if (elapsed >= min_time_ns || iterations >= (1ull << 30)) break;
+        // aim a little past the target so the next round usually settles it
+        const double scale = elapsed > 0 ? 1.2 * min_time_ns / elapsed : 100.0;
+        iterations = (unsigned long long) (iterations * std::min(100.0, std::max(2.0, scale)));
+    }
+
+    std::vector<double> samples;
+    for (unsigned r = 0; r < reps; r++) {
+        const double start = now_ns();
+        for (unsigned long long i = 0; i < iterations; i++) bench.op();
+        samples.push_back((now_ns() - start) / iterations);
+    }
+    std::sort(samples.begin(), samples.end());
+    return bench_result_t{bench.name, iterations, samples.front(), samples[samples.size() / 2]};
+}
+
+static int load_baseline(const char *filename, std::map<std::string, double> &medians) {
+    FILE *file = fopen(filename, "r");
+    if (file == nullptr) {
+        fprintf(stderr, "Cannot open baseline %s\n", filename);
+        return -1;
+    }
+
+    char line[4096];
+    while (fgets(line, sizeof(line), file) != nullptr) {
+        json_object_t object;
+        std::string error;
+        if (json_parse_object(line, &object, &error) != 0) continue;
+        if (object.count("benchmark") != 0 && object.count("median_ns") != 0) {
+            medians[object["benchmark"].text] = atof(object["median_ns"].text.c_str());
+        }
+    }
+    fclose(file);
+    return 0;
+}
+
+static int save_results(const char *filename, const std::vector<bench_result_t> &results) {
+    FILE *file = fopen(filename, "w");
+    if (file == nullptr) {
+        fprintf(stderr, "Cannot write %s\n", filename);
+        return -1;
+    }
+    for (auto &result : results) {
+        fprintf(file, "{\"benchmark\": %s, \"iterations\": %llu, \"min_ns\": %.1f, \"median_ns\": %.1f, "
+                      "\"ops_per_s\": %.1f}\n", json_quote(result.name).c_str(), result.iterations, result.min_ns,
+                result.median_ns, 1e9 / result.median_ns);
+    }
+    fclose(file);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    gmp_arena_install(); // the factoring paths are timed with their job arenas, as in cuda_rsa
+    unsigned reps = BENCH_REPS;
+    double min_time_ms = BENCH_MIN_TIME_MS;
+    double threshold = BENCH_THRESHOLD;
+    const char *filter = nullptr;
+    const char *json_out = nullptr;
+    const char *baseline_file = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-reps") == 0 && i + 1 < argc) {
+            reps = (unsigned) atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-min-time") == 0 && i + 1 < argc) {
+            min_time_ms = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "-json") == 0 && i + 1 < argc) {
+            json_out = argv[++i];
+        } else if (strcmp(argv[i], "-baseline") == 0 && i + 1 < argc) {
+            baseline_file = argv[++i];
+        } else if (strcmp(argv[i], "-threshold") == 0 && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        } else {
+            fprintf(stderr, "Usage: %s [-filter substring] [-reps n] [-min-time ms] [-json out] [-baseline file] "
+                            "[-threshold percent]\n", argv[0]);
+            return -1;
+        }
+    }
+    if (reps < 1) reps = 1;
+
+    std::map<std::string, double> baseline;
+    if (baseline_file != nullptr && load_baseline(baseline_file, baseline) != 0) {
+        return -1;
+    }
+
+    unsigned primes_num = MAX_PRIMES;
+    auto *prime_table = (unsigned *) calloc(primes_num, sizeof(unsigned));
+    if (generate_prime_table(prime_table, primes_num) != 0) {
+        return -1;
+    }
+
+    gmp_randstate_t random;
+    gmp_randinit_default(random);
+    gmp_randseed_ui(random, BENCH_SEED);
+
+    // semiprime moduli of every operand size
+    std::vector<mpz_ptr> moduli;
+    for (unsigned bits : operand_bits) {
+        auto n = (mpz_ptr) malloc(sizeof(__mpz_struct));
+        mpz_init(n);
+        random_semiprime(n, bits, random);
+        moduli.push_back(n);
+    }
+
+    ExponentCache exponents(prime_table, primes_num);
+    mpz_t e, tmp, result, converted;
+    mpz_init(e);
+    mpz_init(tmp);
+    mpz_init(result);
+    mpz_init(converted);
+    uint32_t limbs[2048 / 32];
+    std::string discarded; // progress output of cpu_factorize
+
+    std::vector<bench_case_t> cases;
+    for (size_t i = 0; i < moduli.size(); i++) {
+        mpz_ptr n = moduli[i];
+        const unsigned words = operand_bits[i] / 32;
+        cases.push_back({"from_mpz/" + std::to_string(operand_bits[i]), [=, &limbs]() {
+            from_mpz(n, limbs, words);
+        }});
+        cases.push_back({"to_mpz/" + std::to_string(operand_bits[i]), [=, &limbs, &converted]() {
+            to_mpz(converted, limbs, words);
+        }});
+    }
+
+    // E(B) is built by one word-sized multiplication per prime, quadratic in B; 2^24 would take minutes
+    for (unsigned B : {1u << 12, 1u << 16, 1u << 20}) {
+        cases.push_back({"primes_power/B=" + std::to_string(B), [=, &e, &tmp]() {
+            primes_power(&e, prime_table, primes_num, B, &tmp);
+        }});
+    }
+
+    for (unsigned B : {1u << 12, 1u << 16}) {
+        for (size_t i = 0; i < moduli.size(); i++) {
+            mpz_ptr n = moduli[i];
+            // a single schedule step straight to B, exponent construction, modexp and gcd once each
+            b_schedule_t schedule = b_schedule_make(B_SCHEDULE_LINEAR, operand_bits[i], 0, B, B);
+            cases.push_back({"cpu_factorize/" + std::to_string(operand_bits[i]) + "/B=" + std::to_string(B),
+                             [=, &result, &discarded]() {
+                                 unsigned b_found;
+                                 JobLogScope log_scope(discarded);
+                                 cpu_factorize(n, prime_table, primes_num, schedule, &result, &b_found);
+                                 discarded.clear();
+                             }});
+        }
+    }
+
+    // the same step with the exponent taken from a shared cache, as every job after the first one does
+    for (size_t i = 0; i < moduli.size(); i++) {
+        mpz_ptr n = moduli[i];
+        const unsigned B = 1u << 16;
+        b_schedule_t schedule = b_schedule_make(B_SCHEDULE_LINEAR, operand_bits[i], 0, B, B);
+        cases.push_back({"cpu_factorize_cached/" + std::to_string(operand_bits[i]) + "/B=" + std::to_string(B),
+                         [=, &exponents, &result, &discarded]() {
+                             unsigned b_found;
+                             JobLogScope log_scope(discarded);
+                             cpu_factorize(n, prime_table, primes_num, schedule, &result, &b_found, nullptr,
+                                           &exponents);
+                             discarded.clear();
+                         }});
+    }
+
+    // the same step as one instance of the kernel on a host thread, a fresh kernel keeps no residue to extend
+    for (size_t i = 0; i < moduli.size(); i++) {
+        mpz_ptr n = moduli[i];
+        const unsigned B = 1u << 16;
+        b_schedule_t schedule = b_schedule_make(B_SCHEDULE_LINEAR, operand_bits[i], 0, B, B);
+        cases.push_back({"host_kernel/" + std::to_string(operand_bits[i]) + "/B=" + std::to_string(B),
+                         [=, &exponents, &result, &discarded]() {
+                             unsigned b_found;
+                             JobLogScope log_scope(discarded);
+                             HostKernel kernel(prime_table, 1);
+                             kernel.factorize(n, schedule, &result, &b_found, &exponents);
+                             discarded.clear();
+                         }});
+    }
+
+    // cpu_factorize_batch against BENCH_BATCH separate runs on the same moduli, one step to B with cached exponents
+    std::vector<__mpz_struct> batch(BENCH_BATCH * 3), batch_results(BENCH_BATCH);
+    for (auto &r : batch_results) mpz_init(&r);
+    const unsigned batch_bits[] = {72, 88, 128};
+    for (unsigned b = 0; b < 3; b++) {
+        const unsigned bits = batch_bits[b], B = 1u << 16;
+        mpz_t *group = (mpz_t *) &batch[b * BENCH_BATCH];
+        for (unsigned i = 0; i < BENCH_BATCH; i++) {
+            mpz_init(group[i]);
+            random_semiprime(group[i], bits, random);
+        }
+        b_schedule_t schedule = b_schedule_make(B_SCHEDULE_LINEAR, bits, 0, B, B);
+        const std::string suffix = std::to_string(bits) + "/B=" + std::to_string(B) + "/x" +
+                                   std::to_string(BENCH_BATCH);
+        cases.push_back({"batch_stage1/" + suffix, [=, &exponents, &batch_results]() {
+            unsigned b_found[BENCH_BATCH];
+            cpu_factorize_batch(group, BENCH_BATCH, prime_table, primes_num, schedule,
+                                (mpz_t *) batch_results.data(), b_found, &exponents);
+        }});
+        cases.push_back({"separate_stage1/" + suffix, [=, &exponents, &result, &discarded]() {
+            unsigned b_found;
+            JobLogScope log_scope(discarded);
+            for (unsigned i = 0; i < BENCH_BATCH; i++) {
+                cpu_factorize(group[i], prime_table, primes_num, schedule, &result, &b_found, nullptr, &exponents);
+            }
+            discarded.clear();
+        }});
+    }
+
+    cases.push_back({"primegen_fill", []() {
+        static primegen pg;
+        static bool initialized = false;
+        if (!initialized) {
+            primegen_init(&pg);
+            initialized = true;
+        }
+        primegen_fill(&pg); // primes of the next 1920 integers, the block sieve is amortized over the calls
+    }});
+    for (uint64 to : {(uint64) 1000000, (uint64) 100000000}) {
+        cases.push_back({"primegen_count/" + std::to_string((unsigned long long) to), [=]() {
+            primegen pg;
+            primegen_init(&pg);
+            primegen_count(&pg, to);
+        }});
+    }
+
+    cases.push_back({"generate_prime_table", [=]() {
+        unsigned num = MAX_PRIMES;
+        generate_prime_table(prime_table, num);
+    }});
+
+    std::vector<bench_result_t> results;
+    bool slower = false;
+    printf("%-28s %12s %14s %14s %14s %10s\n", "benchmark", "iterations", "min [ns]", "median [ns]", "ops/s",
+           baseline.empty() ? "" : "vs base");
+    for (auto &bench : cases) {
+        if (filter != nullptr && bench.name.find(filter) == std::string::npos) continue;
+
+        const bench_result_t result = run_case(bench, reps, min_time_ms * 1e6);
+        results.push_back(result);
+        printf("%-28s %12llu %14.1f %14.1f %14.1f", result.name.c_str(), result.iterations, result.min_ns,
+               result.median_ns, 1e9 / result.median_ns);
+
+        auto base = baseline.find(result.name);
+        if (base != baseline.end() && base->second > 0) {
+            const double change = (result.median_ns / base->second - 1.0) * 100.0;
+            printf(" %+9.1f%%%s", change, change > threshold ? " slower" : (change < -threshold ? " faster" : ""));
+            slower |= change > threshold;
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+
+    if (json_out != nullptr && save_results(json_out, results) != 0) {
+        return -1;
+    }
+
+    for (mpz_ptr n : moduli) {
+        mpz_clear(n);
+        free(n);
+    }
+    for (auto &n : batch) mpz_clear(&n);
+    for (auto &r : batch_results) mpz_clear(&r);
+    mpz_clear(e);
+    mpz_clear(tmp);
+    mpz_clear(result);
+    mpz_clear(converted);
+    gmp_randclear(random);
+    free(prime_table);
+    return slower ? 1 : 0;
+}
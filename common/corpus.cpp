@@ -0,0 +1,57 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "corpus.h"
+
+int corpus_load(const char *filename, std::string *version, std::vector<corpus_entry_t> &entries) {
+    FILE *file = fopen(filename, "r");
+    if (file == nullptr) {
+        fprintf(stderr, "Cannot open corpus %s\n", filename);
+        return -1;
+    }
+
+    version->clear();
+    char line[65536];
+    unsigned line_number = 0;
+    while (fgets(line, sizeof(line), file) != nullptr) {
+        line_number++;
+        if (line[0] == '#') {
+            const char *tag = strstr(line, "corpus ");
+            if (version->empty() && tag != nullptr) {
+                const char *word = strtok((char *) tag + strlen("corpus "), " \t\r\n");
+                if (word != nullptr) *version = word;
+            }
+            continue;
+        }
+
+        std::vector<char *> columns;
+        for (char *token = strtok(line, " \t\r\n"); token != nullptr; token = strtok(nullptr, " \t\r\n")) {
+            columns.push_back(token);
+        }
+        if (columns.empty()) continue;
+
+        char *end;
+        const unsigned long bits = strtoul(columns[0], &end, 10);
+        if (columns.size() < 4 || *end != '\0' || bits == 0 ||
+            strspn(columns[1], "0123456789:") != strlen(columns[1])) {
+            fprintf(stderr, "%s:%u: expected \"bits B1[:B2] N factors...\"\n", filename, line_number);
+            fclose(file);
+            return -1;
+        }
+
+        corpus_entry_t entry;
+        entry.bits = (unsigned) bits;
+        entry.smoothness = columns[1];
+        entry.number = columns[2];
+        entry.factors.assign(columns.begin() + 3, columns.end());
+        entries.push_back(entry);
+    }
+    fclose(file);
+
+    if (version->empty()) {
+        fprintf(stderr, "Corpus %s has no \"%s <version>\" header\n", filename, CORPUS_HEADER);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,30 @@
+#ifndef __CORPUS_H__
+#define __CORPUS_H__
+
+#include <string>
+#include <vector>
+
+#define CORPUS_HEADER "# pollard corpus" // followed by the version tag
+
+/*
+ * Benchmark corpus of moduli with known factors, written by test_data and read
+ * by e2e_bench and cuda_rsa -i. One modulus per line, hex:
+ *   <bits> <B1>[:<B2>] <N> <hidden p> <other primes ...>
+ * '#' starts a comment; the first "# ... corpus <tag>" comment is the version,
+ * a baseline is only comparable with the same one.
+ */
+struct corpus_entry_t {
+    unsigned bits;
+    std::string smoothness; // "B1" or "B1:B2" of the hidden factor
+    std::string number;
+    std::vector<std::string> factors;
+
+    // the bits/smoothness group results are reported by
+    std::string bucket() const {
+        return std::to_string(bits) + "/" + smoothness;
+    }
+};
+
+int corpus_load(const char *filename, std::string *version, std::vector<corpus_entry_t> &entries);
+
+#endif /* __CORPUS_H__ */
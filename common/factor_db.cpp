@@ -0,0 +1,197 @@
+#include <cstring>
+
+#include "factor_db.h"
+#include "gmp_arena.h"
+#include "hex.h"
+
+FactorDb::FactorDb() {
+    GmpHeapScope heap_scope;
+    mpz_init_set_ui(known_product, 1);
+}
+
+FactorDb::~FactorDb() {
+    if (log != nullptr) fclose(log);
+    GmpHeapScope heap_scope;
+    mpz_clear(known_product);
+}
+
+int FactorDb::open(const char *filename) {
+    std::lock_guard<std::mutex> guard(lock);
+    GmpHeapScope heap_scope;
+
+    mpz_t n, p, product;
+    mpz_init(n);
+    mpz_init(p);
+    mpz_init(product);
+
+    unsigned records = 0, rejected = 0;
+    bool torn = false; // the last line has no newline, a write was cut off
+    FILE *file = fopen(filename, "r");
+    if (file != nullptr) {
+        char line[16384];
+        while (fgets(line, sizeof(line), file) != nullptr) {
+            if (strchr(line, '\n') == nullptr) {
+                if (feof(file)) {
+                    fprintf(stderr, "Factor db %s: incomplete last record, skipped\n", filename);
+                    torn = true;
+                    break;
+                }
+                fprintf(stderr, "Factor db %s: line too long, skipped\n", filename);
+                int c;
+                while ((c = fgetc(file)) != EOF && c != '\n');
+                if (c == EOF) torn = true;
+                continue;
+            }
+
+            char *token = strtok(line, " \t\r\n");
+            if (token == nullptr || token[0] == '#' || mpz_set_str(n, token, 16) != 0) continue;
+
+            entry_t entry;
+            mpz_set_ui(product, 1);
+            bool valid = true;
+            while ((token = strtok(nullptr, " \t\r\n")) != nullptr) {
+                char *caret = strchr(token, '^');
+                if (caret == nullptr) {
+                    valid = false; // torn write at the end of the log
+                    break;
+                }
+                *caret = '\0';
+                char *end;
+                const auto power = (unsigned) strtoul(caret + 1, &end, 10);
+                if (power == 0 || *end != '\0' || mpz_set_str(p, token, 16) != 0 || mpz_cmp_ui(p, 1) <= 0 ||
+                    mpz_probab_prime_p(p, FACTOR_DB_PRIME_REPS) == 0) {
+                    valid = false;
+                    break;
+                }
+                entry.primes.push_back(to_hex(p));
+                entry.powers.push_back(power);
+                mpz_pow_ui(p, p, power);
+                mpz_mul(product, product, p);
+            }
+            // a partial record still has to divide its modulus
+            if (!valid || entry.primes.empty() || !mpz_divisible_p(n, product)) {
+                rejected++;
+                continue;
+            }
+
+            entry.complete = mpz_cmp(product, n) == 0;
+            insert(to_hex(n), entry);
+            records++;
+        }
+        fclose(file);
+    }
+
+    mpz_clear(n);
+    mpz_clear(p);
+    mpz_clear(product);
+
+    log = fopen(filename, "a");
+    if (log == nullptr) {
+        fprintf(stderr, "Unable to open factor db: %s\n", filename);
+        return -1;
+    }
+    if (ftell(log) == 0) {
+        fprintf(log, "%s\n", FACTOR_DB_HEADER);
+        fflush(log);
+    } else if (torn) {
+        fputc('\n', log); // the next record starts on a line of its own
+        fflush(log);
+    }
+
+    if (rejected > 0) {
+        fprintf(stderr, "Factor db %s: %u record(s) whose primes do not divide N, skipped\n", filename, rejected);
+    }
+    fprintf(stderr, "Loaded %u factor db records (%zu moduli, %zu primes) from: %s\n", records, index.size(),
+            known_list.size(), filename);
+    return 0;
+}
+
+// lock held and heap allocation active
+bool FactorDb::insert(const std::string &n_hex, entry_t &entry) {
+    auto it = index.find(n_hex);
+    if (it != index.end() && it->second.complete && !entry.complete) {
+        return false;
+    }
+
+    mpz_t p;
+    mpz_init(p);
+    for (auto &prime : entry.primes) {
+        if (known.insert(prime).second) {
+            known_list.push_back(prime);
+            mpz_set_str(p, prime.c_str(), 16);
+            mpz_mul(known_product, known_product, p);
+        }
+    }
+    mpz_clear(p);
+
+    index[n_hex] = std::move(entry);
+    return true;
+}
+
+bool FactorDb::lookup(mpz_t n, FactorList &factors) {
+    const std::string n_hex = to_hex(n);
+
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = index.find(n_hex);
+    if (it == index.end() || !it->second.complete) {
+        return false;
+    }
+
+    mpz_t prime;
+    mpz_init(prime);
+    for (size_t i = 0; i < it->second.primes.size(); i++) {
+        mpz_set_str(prime, it->second.primes[i].c_str(), 16);
+        factors.add(prime, it->second.powers[i]);
+    }
+    mpz_clear(prime);
+    return true;
+}
+
+void FactorDb::known_divisors(mpz_t n, std::vector<std::string> &primes) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (known_list.empty()) return;
+
+    mpz_t g;
+    mpz_init(g);
+    mpz_gcd(g, n, known_product);
+    if (mpz_cmp_ui(g, 1) > 0) {
+        for (auto &prime : known_list) {
+            mpz_set_str(g, prime.c_str(), 16);
+            if (mpz_divisible_p(n, g)) primes.push_back(prime);
+        }
+    }
+    mpz_clear(g);
+}
+
+int FactorDb::record(mpz_t n, const FactorList &factors) {
+    if (factors.empty()) return 0;
+
+    entry_t entry;
+    std::string line = to_hex(n);
+
+    for (size_t i = 0; i < factors.size(); i++) {
+        const std::string prime = to_hex(factors.prime(i));
+        entry.primes.push_back(prime);
+        entry.powers.push_back(factors.power(i));
+        line += " " + prime + "^" + std::to_string(factors.power(i));
+    }
+    mpz_t product;
+    mpz_init(product);
+    factors.product(product);
+    entry.complete = mpz_cmp(product, n) == 0;
+    mpz_clear(product);
+
+    std::lock_guard<std::mutex> guard(lock);
+    GmpHeapScope heap_scope;
+    if (!insert(line.substr(0, line.find(' ')), entry) || log == nullptr) {
+        return 0;
+    }
+    fprintf(log, "%s\n", line.c_str());
+    fflush(log);
+    return 0;
+}
+
+size_t FactorDb::size() {
+    std::lock_guard<std::mutex> guard(lock);
+    return index.size();
+}
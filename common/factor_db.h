@@ -0,0 +1,64 @@
+#ifndef __FACTOR_DB_H__
+#define __FACTOR_DB_H__
+
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <gmp.h>
+
+#include "factor_list.h"
+
+#define FACTOR_DB_HEADER "# pollard factor db v1"
+#define FACTOR_DB_PRIME_REPS 15 // Miller-Rabin rounds for the primes of a record read back
+
+/*
+ * Factorizations of earlier inputs. The file is an append-only log, one line
+ * per result: "<N> <p>^<e> <p>^<e> ..." in hex. It is replayed into a hash
+ * index keyed by N when opened; records whose primes are not primes dividing
+ * N and a last line cut off by a crash are skipped. A complete factorization
+ * is never replaced by a partial one. The primes of all records are also kept as one product so a
+ * new modulus sharing a factor with any earlier one is split by a single gcd.
+ * Thread-safe.
+ */
+class FactorDb {
+public:
+    FactorDb();
+
+    ~FactorDb();
+
+    int open(const char *filename);
+
+    bool lookup(mpz_t n, FactorList &factors);
+
+    void known_divisors(mpz_t n, std::vector<std::string> &primes);
+
+    int record(mpz_t n, const FactorList &factors);
+
+    size_t size();
+
+private:
+    struct entry_t {
+        std::vector<std::string> primes;
+        std::vector<unsigned> powers;
+        bool complete;
+    };
+
+    std::mutex lock;
+    FILE *log = nullptr;
+    std::unordered_map<std::string, entry_t> index;
+    std::unordered_set<std::string> known;
+    std::vector<std::string> known_list;
+    mpz_t known_product;
+
+    bool insert(const std::string &n_hex, entry_t &entry);
+
+    FactorDb(const FactorDb &) = delete;
+
+    FactorDb &operator=(const FactorDb &) = delete;
+};
+
+#endif /* __FACTOR_DB_H__ */
@@ -0,0 +1,35 @@
+#include "factor_list.h"
+#include "gmp_arena.h"
+
+FactorList::~FactorList() {
+    clear();
+}
+
+void FactorList::add(mpz_t prime, unsigned power) {
+    GmpHeapScope heap_scope;
+    auto value = new __mpz_struct;
+    mpz_init_set(value, prime);
+    primes.push_back(value);
+    powers.push_back(power);
+}
+
+void FactorList::clear() {
+    GmpHeapScope heap_scope;
+    for (mpz_ptr value : primes) {
+        mpz_clear(value);
+        delete value;
+    }
+    primes.clear();
+    powers.clear();
+}
+
+void FactorList::product(mpz_t result) const {
+    mpz_t power_value;
+    mpz_init(power_value);
+    mpz_set_ui(result, 1);
+    for (size_t i = 0; i < primes.size(); i++) {
+        mpz_pow_ui(power_value, primes[i], powers[i]);
+        mpz_mul(result, result, power_value);
+    }
+    mpz_clear(power_value);
+}
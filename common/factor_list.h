@@ -0,0 +1,52 @@
+#ifndef __FACTOR_LIST_H__
+#define __FACTOR_LIST_H__
+
+#include <cstddef>
+#include <vector>
+
+#include <gmp.h>
+
+/*
+ * Primes of one input with their powers, in the order they were found. The
+ * list grows with every factor; the values are kept on the heap so they
+ * outlive the job arena they were computed in.
+ */
+class FactorList {
+public:
+    FactorList() = default;
+
+    ~FactorList();
+
+    void add(mpz_t prime, unsigned power);
+
+    void clear();
+
+    size_t size() const {
+        return powers.size();
+    }
+
+    bool empty() const {
+        return powers.empty();
+    }
+
+    mpz_ptr prime(size_t i) const {
+        return primes[i];
+    }
+
+    unsigned power(size_t i) const {
+        return powers[i];
+    }
+
+    // product of prime ^ power over the list
+    void product(mpz_t result) const;
+
+private:
+    std::vector<mpz_ptr> primes;
+    std::vector<unsigned> powers;
+
+    FactorList(const FactorList &) = delete;
+
+    FactorList &operator=(const FactorList &) = delete;
+};
+
+#endif /* __FACTOR_LIST_H__ */
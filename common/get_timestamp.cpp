@@ -9,6 +9,7 @@
 #include <cstdio>
 #include <sys/time.h>
 #include "get_timestamp.h"
+#include "job_log.h"
 
 #ifdef _WIN32
 static LONGLONG gFrequency = -1;
@@ -17,10 +18,12 @@ static LONGLONG gFrequency = -1;
 void printTimeval(const timeval &stamp) {
     auto milli = stamp.tv_usec / 1000;
     char buffer [80];
-    strftime(buffer, 80, "%Y-%m-%d %H:%M:%S", localtime(&stamp.tv_sec));
+    struct tm local_stamp;
+    localtime_r(&stamp.tv_sec, &local_stamp); // jobs print timestamps concurrently
+    strftime(buffer, 80, "%Y-%m-%d %H:%M:%S", &local_stamp);
     char currentTime[84] = "";
     sprintf(currentTime, "%s:%03ld", buffer, milli);
-    printf("Time: %s \n", currentTime);
+    log_printf("Time: %s \n", currentTime);
 }
 
 long long get_timestamp() {
@@ -55,7 +58,7 @@ void print_timestamp() {
 #ifdef _WIN32
     SYSTEMTIME timestamp = { 0 };
     GetLocalTime(&timestamp);
-    printf("Time: %04u-%02u-%02u %02u:%02u:%02u.%03u\n", timestamp.wYear, timestamp.wMonth, timestamp.wDay, timestamp.wHour, timestamp.wMinute, timestamp.wSecond, timestamp.wMilliseconds);
+    log_printf("Time: %04u-%02u-%02u %02u:%02u:%02u.%03u\n", timestamp.wYear, timestamp.wMonth, timestamp.wDay, timestamp.wHour, timestamp.wMinute, timestamp.wSecond, timestamp.wMilliseconds);
 #else
     struct timeval stamp;
     gettimeofday(&stamp, nullptr);
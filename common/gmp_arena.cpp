@@ -0,0 +1,146 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <mutex>
+
+#include <gmp.h>
+
+#include "gmp_arena.h"
+
+static thread_local GmpArena *current_arena = nullptr;
+static std::atomic<bool> arena_installed(false);
+
+static unsigned size_class(size_t size) {
+    unsigned c = 4; // 16 bytes, room for the free list link
+    while (((size_t) 1 << c) < size) c++;
+    return c;
+}
+
+static void *arena_alloc_failed(size_t size) {
+    fprintf(stderr, "GMP arena: cannot allocate %lu bytes\n", (unsigned long) size);
+    abort();
+}
+
+GmpArena::GmpArena(size_t modulus_bits) {
+    memset(free_lists, 0, sizeof(free_lists));
+    const size_t limb_bytes = (modulus_bits / GMP_NUMB_BITS + 2) * sizeof(mp_limb_t);
+    next_chunk_size = limb_bytes * ARENA_CHUNK_MODULI;
+    if (next_chunk_size < ARENA_MIN_CHUNK) next_chunk_size = ARENA_MIN_CHUNK;
+}
+
+GmpArena::~GmpArena() {
+    for (auto &chunk : chunks) {
+        free(chunk.base);
+    }
+}
+
+void *GmpArena::allocate(size_t size) {
+    const unsigned c = size_class(size);
+    if (c >= ARENA_CLASSES) arena_alloc_failed(size);
+
+    if (free_lists[c] != nullptr) {
+        void *block = free_lists[c];
+        free_lists[c] = *(void **) block;
+        return block;
+    }
+
+    const size_t block_size = (size_t) 1 << c;
+    if (chunks.empty() || chunks.back().size - chunks.back().used < block_size) {
+        while (next_chunk_size < block_size) next_chunk_size *= 2;
+
+        chunk_t chunk;
+        chunk.base = (char *) malloc(next_chunk_size);
+        if (chunk.base == nullptr) arena_alloc_failed(next_chunk_size);
+        chunk.size = next_chunk_size;
+        chunk.used = 0;
+        chunks.push_back(chunk);
+        next_chunk_size *= 2;
+    }
+
+    chunk_t &chunk = chunks.back();
+    void *block = chunk.base + chunk.used;
+    chunk.used += block_size;
+    return block;
+}
+
+void *GmpArena::reallocate(void *ptr, size_t old_size, size_t new_size) {
+    if (size_class(old_size) == size_class(new_size)) return ptr;
+
+    void *block = allocate(new_size);
+    memcpy(block, ptr, old_size < new_size ? old_size : new_size);
+    release(ptr, old_size);
+    return block;
+}
+
+void GmpArena::release(void *ptr, size_t size) {
+    const unsigned c = size_class(size);
+    *(void **) ptr = free_lists[c];
+    free_lists[c] = ptr;
+}
+
+bool GmpArena::owns(const void *ptr) const {
+    const char *p = (const char *) ptr;
+    for (auto &chunk : chunks) {
+        if (p >= chunk.base && p < chunk.base + chunk.size) return true;
+    }
+    return false;
+}
+
+size_t GmpArena::reserved() const {
+    size_t total = 0;
+    for (auto &chunk : chunks) total += chunk.size;
+    return total;
+}
+
+// GMP memory functions, blocks that were not carved from the current arena stay on the heap
+
+static void *arena_allocate(size_t size) {
+    if (current_arena != nullptr) return current_arena->allocate(size);
+
+    void *block = malloc(size);
+    if (block == nullptr) arena_alloc_failed(size);
+    return block;
+}
+
+static void *arena_reallocate(void *ptr, size_t old_size, size_t new_size) {
+    if (current_arena != nullptr && current_arena->owns(ptr)) {
+        return current_arena->reallocate(ptr, old_size, new_size);
+    }
+
+    void *block = realloc(ptr, new_size);
+    if (block == nullptr) arena_alloc_failed(new_size);
+    return block;
+}
+
+static void arena_free(void *ptr, size_t size) {
+    if (current_arena != nullptr && current_arena->owns(ptr)) {
+        current_arena->release(ptr, size);
+        return;
+    }
+    free(ptr);
+}
+
+void gmp_arena_install() {
+    static std::once_flag installed;
+    std::call_once(installed, []() {
+        mp_set_memory_functions(arena_allocate, arena_reallocate, arena_free);
+        arena_installed = true;
+    });
+}
+
+GmpArenaScope::GmpArenaScope(GmpArena &arena) : previous(current_arena) {
+    if (arena_installed) current_arena = &arena;
+}
+
+GmpArenaScope::~GmpArenaScope() {
+    current_arena = previous;
+}
+
+GmpHeapScope::GmpHeapScope() : previous(current_arena) {
+    current_arena = nullptr;
+}
+
+GmpHeapScope::~GmpHeapScope() {
+    current_arena = previous;
+}
@@ -0,0 +1,81 @@
+#ifndef __GMP_ARENA_H__
+#define __GMP_ARENA_H__
+
+#include <cstddef>
+#include <vector>
+
+#define ARENA_CHUNK_MODULI 64 // first chunk holds this many modulus-sized numbers
+#define ARENA_MIN_CHUNK 4096
+#define ARENA_CLASSES 48      // power of two size classes
+
+/*
+ * Limb storage for a single factoring job. Blocks are carved from chunks sized
+ * after the modulus width and recycled through per-size-class free lists;
+ * everything is returned to the system in one step when the arena is destroyed.
+ * Not thread-safe, a job owns its arena.
+ */
+class GmpArena {
+public:
+    explicit GmpArena(size_t modulus_bits);
+
+    ~GmpArena();
+
+    void *allocate(size_t size);
+
+    void *reallocate(void *ptr, size_t old_size, size_t new_size);
+
+    void release(void *ptr, size_t size);
+
+    bool owns(const void *ptr) const;
+
+    size_t reserved() const;
+
+private:
+    struct chunk_t {
+        char *base;
+        size_t size;
+        size_t used;
+    };
+
+    std::vector<chunk_t> chunks;
+    void *free_lists[ARENA_CLASSES];
+    size_t next_chunk_size;
+
+    GmpArena(const GmpArena &) = delete;
+
+    GmpArena &operator=(const GmpArena &) = delete;
+};
+
+/*
+ * Routes GMP allocations made by the current thread to the arena while in scope,
+ * once gmp_arena_install has run; before that GMP keeps its own allocator.
+ * Every number allocated inside must be cleared or dropped before the scope ends.
+ */
+class GmpArenaScope {
+public:
+    explicit GmpArenaScope(GmpArena &arena);
+
+    ~GmpArenaScope();
+
+private:
+    GmpArena *previous;
+};
+
+/*
+ * Temporarily sends allocations back to the heap, used for results that
+ * outlive the job arena.
+ */
+class GmpHeapScope {
+public:
+    GmpHeapScope();
+
+    ~GmpHeapScope();
+
+private:
+    GmpArena *previous;
+};
+
+// replaces GMP's memory functions for the whole process, left to the owner of the process
+void gmp_arena_install();
+
+#endif /* __GMP_ARENA_H__ */
@@ -0,0 +1,10 @@
+#include <cstring>
+
+#include "hex.h"
+
+std::string to_hex(const mpz_t value) {
+    std::string hex(mpz_sizeinbase(value, 16) + 2, '\0');
+    mpz_get_str(&hex[0], 16, value);
+    hex.resize(strlen(hex.c_str()));
+    return hex;
+}
@@ -0,0 +1,11 @@
+#ifndef __HEX_H__
+#define __HEX_H__
+
+#include <string>
+
+#include <gmp.h>
+
+// lower case hex digits of a number, the form inputs, results and the factor db use
+std::string to_hex(const mpz_t value);
+
+#endif /* __HEX_H__ */
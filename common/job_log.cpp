@@ -0,0 +1,66 @@
+#include <cstdarg>
+#include <cstdio>
+
+#include <gmp.h>
+
+#include "job_log.h"
+
+static thread_local std::string *current_log = nullptr;
+
+void log_printf(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+
+    if (current_log == nullptr) {
+        vprintf(format, args);
+        va_end(args);
+        return;
+    }
+
+    char line[512];
+    va_list copy;
+    va_copy(copy, args);
+    const int len = vsnprintf(line, sizeof(line), format, args);
+    if (len >= (int) sizeof(line)) {
+        std::string long_line(len + 1, '\0');
+        vsnprintf(&long_line[0], long_line.size(), format, copy);
+        current_log->append(long_line.c_str(), len);
+    } else if (len > 0) {
+        current_log->append(line, len);
+    }
+    va_end(copy);
+    va_end(args);
+}
+
+void log_gmp_printf(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+
+    if (current_log == nullptr) {
+        gmp_vprintf(format, args);
+        va_end(args);
+        return;
+    }
+
+    char line[512];
+    va_list copy;
+    va_copy(copy, args);
+    const int len = gmp_vsnprintf(line, sizeof(line), format, args);
+    if (len >= (int) sizeof(line)) {
+        std::string long_line(len + 1, '\0');
+        gmp_vsnprintf(&long_line[0], long_line.size(), format, copy);
+        current_log->append(long_line.c_str(), len);
+    } else if (len > 0) {
+        current_log->append(line, len);
+    }
+    va_end(copy);
+    va_end(args);
+}
+
+JobLogScope::JobLogScope(std::string &buffer) : previous(current_log) {
+    current_log = &buffer;
+}
+
+JobLogScope::~JobLogScope() {
+    current_log = previous;
+}
@@ -0,0 +1,26 @@
+#ifndef __JOB_LOG_H__
+#define __JOB_LOG_H__
+
+#include <string>
+
+/*
+ * Progress output of a factoring job. Inside a JobLogScope the text is
+ * collected in the job buffer so concurrent jobs can be printed in input
+ * order, otherwise it goes straight to stdout.
+ */
+void log_printf(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+// log_printf with GMP's conversions (%Zx for an mpz_t), numbers of any size
+void log_gmp_printf(const char *format, ...);
+
+class JobLogScope {
+public:
+    explicit JobLogScope(std::string &buffer);
+
+    ~JobLogScope();
+
+private:
+    std::string *previous;
+};
+
+#endif /* __JOB_LOG_H__ */
@@ -0,0 +1,186 @@
+#include <algorithm>
+
+#include "job_scheduler.h"
+#include "get_timestamp.h"
+#include "numa.h"
+
+// heap order: the job that should run last compares smallest
+struct job_after_t {
+    template<class job_t>
+    bool operator()(const job_t &a, const job_t &b) const {
+        if (a.priority != b.priority) return a.priority < b.priority;
+        if (a.cost != b.cost) return a.cost > b.cost;
+        return a.seq > b.seq;
+    }
+};
+
+JobScheduler::JobScheduler(unsigned workers, unsigned classes, unsigned capacity, unsigned nodes)
+        : capacity(capacity > 0 ? capacity : 1), job_classes(classes > 0 ? classes : 1),
+          nodes(nodes > 0 ? nodes : 1), heaps(this->nodes * job_classes), class_stats(job_classes),
+          work_available(this->nodes), node_queued(this->nodes, 0), node_idle(this->nodes, 0) {
+    if (workers < 1) workers = 1;
+    for (unsigned i = 0; i < workers; i++) {
+        this->workers.emplace_back(&JobScheduler::run, this, i % this->nodes);
+    }
+}
+
+JobScheduler::~JobScheduler() {
+    wait();
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    for (auto &available : work_available) available.notify_all();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+// lock held: a node with an idle worker, else the shortest queue
+unsigned JobScheduler::place() const {
+    unsigned best = (unsigned) (next_seq % nodes);
+    for (unsigned k = 0; k < nodes; k++) {
+        const unsigned node = (unsigned) ((next_seq + k) % nodes);
+        if (node_idle[node] > 0) return node;
+        if (node_queued[node] < node_queued[best]) best = node;
+    }
+    return best;
+}
+
+// lock held: `from` or the next node with an idle worker, -1 for none
+int JobScheduler::idle_node(unsigned from) const {
+    for (unsigned k = 0; k < nodes; k++) {
+        const unsigned node = (from + k) % nodes;
+        if (node_idle[node] > 0) return (int) node;
+    }
+    return -1;
+}
+
+int JobScheduler::submit(unsigned job_class, int priority, double expected_cost, std::function<void()> task,
+                         bool block) {
+    if (job_class >= job_classes) job_class = job_classes - 1;
+
+    int wake = -1;
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        job_class_stats_t &stats = class_stats[job_class];
+        if (queued >= capacity) {
+            if (!block) {
+                stats.rejected++;
+                return -1;
+            }
+            space_available.wait(guard, [this]() { return queued < capacity; });
+        }
+
+        const unsigned node = place();
+        std::vector<job_t> &heap = heaps[node * job_classes + job_class];
+        heap.push_back(job_t{priority, expected_cost, next_seq++, get_timestamp(), std::move(task)});
+        std::push_heap(heap.begin(), heap.end(), job_after_t());
+        queued++;
+        node_queued[node]++;
+        stats.submitted++;
+        stats.depth++;
+        stats.max_depth = std::max(stats.max_depth, stats.depth);
+
+        // an idle worker of another node steals the job rather than leave it waiting
+        wake = idle_node(node);
+    }
+    if (wake >= 0) work_available[wake].notify_one();
+    return 0;
+}
+
+void JobScheduler::wait() {
+    std::unique_lock<std::mutex> guard(lock);
+    all_done.wait(guard, [this]() { return queued == 0 && running == 0; });
+}
+
+job_class_stats_t JobScheduler::stats(unsigned job_class) {
+    std::lock_guard<std::mutex> guard(lock);
+    return class_stats[job_class];
+}
+
+unsigned JobScheduler::classes() const {
+    return job_classes;
+}
+
+// lock held, at least one job queued; the worker's own node first, other nodes only when it is empty
+bool JobScheduler::pick(unsigned node, unsigned preferred, unsigned *job_class, job_t *job) {
+    const long long now = get_timestamp();
+    long long best_level = 0;
+    double best_cost = 0;
+    bool found = false;
+    unsigned from = node;
+
+    for (unsigned k = 0; k < nodes && !found; k++) {
+        from = (node + k) % nodes;
+        if (node_queued[from] == 0) continue;
+
+        for (unsigned c = 0; c < job_classes; c++) {
+            const std::vector<job_t> &heap = heaps[from * job_classes + c];
+            if (heap.empty()) continue;
+            const job_t &head = heap.front();
+            const long long level = head.priority + (now - head.enqueued_us) / SCHEDULER_AGING_US;
+
+            const bool better = !found || level > best_level ||
+                                (level == best_level && (c == preferred ||
+                                                         (*job_class != preferred && head.cost < best_cost)));
+            if (better) {
+                best_level = level;
+                best_cost = head.cost;
+                *job_class = c;
+                found = true;
+            }
+        }
+    }
+    if (!found) return false;
+
+    std::vector<job_t> &heap = heaps[from * job_classes + *job_class];
+    std::pop_heap(heap.begin(), heap.end(), job_after_t());
+    *job = std::move(heap.back());
+    heap.pop_back();
+    node_queued[from]--;
+    class_stats[*job_class].depth--;
+    return true;
+}
+
+void JobScheduler::run(unsigned node) {
+    // a refused binding leaves the worker where it is, it still prefers its node's queue
+    if (nodes > 1) numa_bind_thread(node);
+
+    unsigned previous = job_classes; // no class yet
+    std::unique_lock<std::mutex> guard(lock);
+    while (true) {
+        node_idle[node]++;
+        work_available[node].wait(guard, [this]() { return queued > 0 || stopping; });
+        node_idle[node]--;
+        if (queued == 0) return;
+
+        unsigned job_class = previous;
+        job_t job;
+        pick(node, previous, &job_class, &job);
+        queued--;
+        running++;
+        space_available.notify_one();
+        // one notify_one can be taken by a worker that was about to find the queues empty, pass it on
+        const int wake = queued > 0 ? idle_node(node) : -1;
+        if (wake >= 0) work_available[wake].notify_one();
+
+        const long long start = get_timestamp();
+        guard.unlock();
+        job.task();
+        job.task = nullptr;
+        const long long end = get_timestamp();
+        guard.lock();
+
+        job_class_stats_t &stats = class_stats[job_class];
+        stats.completed++;
+        stats.wait_total_us += start - job.enqueued_us;
+        stats.wait_max_us = std::max(stats.wait_max_us, start - job.enqueued_us);
+        stats.run_total_us += end - start;
+        stats.run_max_us = std::max(stats.run_max_us, end - start);
+        previous = job_class;
+
+        running--;
+        if (queued == 0 && running == 0) all_done.notify_all();
+    }
+}
@@ -0,0 +1,90 @@
+#ifndef __JOB_SCHEDULER_H__
+#define __JOB_SCHEDULER_H__
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define SCHEDULER_CAPACITY 1024     // queued jobs before submissions are held back
+#define SCHEDULER_AGING_US 1000000LL // a waiting job gains one priority level per second
+
+struct job_class_stats_t {
+    unsigned depth = 0;     // jobs queued now
+    unsigned max_depth = 0;
+    unsigned long long submitted = 0;
+    unsigned long long completed = 0;
+    unsigned long long rejected = 0; // refused while the scheduler was full
+    long long wait_total_us = 0;
+    long long wait_max_us = 0;
+    long long run_total_us = 0;
+    long long run_max_us = 0;
+};
+
+/*
+ * Factoring jobs queued by class (the kernel width of the input). Workers take
+ * the highest priority first and, among equal priorities, the job with the
+ * smallest expected cost; waiting raises the priority so large inputs are not
+ * starved. A worker stays on the class of its previous job while it ties with
+ * the best choice. At most `capacity` jobs are queued: submit() either waits
+ * for space or refuses the job.
+ *
+ * With several NUMA nodes every node has its own queues and workers bound to
+ * it (worker i on node i % nodes). A job goes to a node with an idle worker,
+ * else to the shortest node queue; workers take jobs of their own node and
+ * steal from other nodes only when their node has nothing queued. A worker
+ * that takes a job while more are queued wakes the next idle worker, so a
+ * wake-up that went to a worker finding the queues empty is not lost.
+ */
+class JobScheduler {
+public:
+    JobScheduler(unsigned workers, unsigned classes, unsigned capacity, unsigned nodes = 1);
+
+    ~JobScheduler();
+
+    int submit(unsigned job_class, int priority, double expected_cost, std::function<void()> task, bool block);
+
+    void wait();
+
+    job_class_stats_t stats(unsigned job_class);
+
+    unsigned classes() const;
+
+private:
+    struct job_t {
+        int priority;
+        double cost;
+        unsigned long long seq;
+        long long enqueued_us;
+        std::function<void()> task;
+    };
+
+    const unsigned capacity;
+    const unsigned job_classes;
+    const unsigned nodes;
+    std::vector<std::vector<job_t>> heaps; // node * job_classes + class
+    std::vector<job_class_stats_t> class_stats;
+    std::vector<std::thread> workers;
+
+    std::mutex lock;
+    std::vector<std::condition_variable> work_available; // by node
+    std::condition_variable space_available;
+    std::condition_variable all_done;
+    std::vector<unsigned> node_queued;
+    std::vector<unsigned> node_idle; // workers waiting for a job
+    unsigned queued = 0;
+    unsigned running = 0;
+    unsigned long long next_seq = 0;
+    bool stopping = false;
+
+    unsigned place() const;
+
+    bool pick(unsigned node, unsigned preferred, unsigned *job_class, job_t *job);
+
+    int idle_node(unsigned from) const;
+
+    void run(unsigned node);
+};
+
+#endif /* __JOB_SCHEDULER_H__ */
@@ -0,0 +1,190 @@
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+
+#include "json_line.h"
+
+namespace {
+
+struct parser_t {
+    const std::string &in;
+    size_t pos;
+    std::string *error;
+
+    void skip_space() {
+        while (pos < in.size() && isspace((unsigned char) in[pos])) pos++;
+    }
+
+    bool fail(const char *message) {
+        if (error != nullptr) *error = std::string(message) + " at offset " + std::to_string(pos);
+        return false;
+    }
+
+    bool expect(char c) {
+        skip_space();
+        if (pos >= in.size() || in[pos] != c) {
+            char message[32];
+            snprintf(message, sizeof(message), "expected '%c'", c);
+            return fail(message);
+        }
+        pos++;
+        return true;
+    }
+
+    static void append_utf8(std::string &out, unsigned code) {
+        if (code < 0x80) {
+            out.push_back((char) code);
+        } else if (code < 0x800) {
+            out.push_back((char) (0xC0 | (code >> 6)));
+            out.push_back((char) (0x80 | (code & 0x3F)));
+        } else {
+            out.push_back((char) (0xE0 | (code >> 12)));
+            out.push_back((char) (0x80 | ((code >> 6) & 0x3F)));
+            out.push_back((char) (0x80 | (code & 0x3F)));
+        }
+    }
+
+    bool string(std::string *out) {
+        if (!expect('"')) return false;
+        out->clear();
+        while (pos < in.size() && in[pos] != '"') {
+            char c = in[pos++];
+            if (c != '\\') {
+                out->push_back(c);
+                continue;
+            }
+            if (pos >= in.size()) break;
+            c = in[pos++];
+            switch (c) {
+                case 'b': out->push_back('\b'); break;
+                case 'f': out->push_back('\f'); break;
+                case 'n': out->push_back('\n'); break;
+                case 'r': out->push_back('\r'); break;
+                case 't': out->push_back('\t'); break;
+                case 'u': {
+                    if (pos + 4 > in.size()) return fail("truncated escape");
+                    unsigned code = 0;
+                    for (int i = 0; i < 4; i++) {
+                        const char h = in[pos++];
+                        if (!isxdigit((unsigned char) h)) return fail("bad escape");
+                        code = code * 16 + (isdigit((unsigned char) h) ? h - '0' : (tolower(h) - 'a' + 10));
+                    }
+                    append_utf8(*out, code);
+                    break;
+                }
+                default: out->push_back(c); break; // \" \\ \/
+            }
+        }
+        if (pos >= in.size()) return fail("unterminated string");
+        pos++;
+        return true;
+    }
+
+    bool scalar(json_type_t *type, std::string *text) {
+        skip_space();
+        if (pos >= in.size()) return fail("expected a value");
+        const char c = in[pos];
+        if (c == '"') {
+            *type = JSON_STRING;
+            return string(text);
+        }
+        if (c == '{' || c == '[') return fail("nested values are not supported");
+
+        const size_t start = pos;
+        while (pos < in.size() && (isalnum((unsigned char) in[pos]) || strchr("+-.", in[pos]) != nullptr)) pos++;
+        *text = in.substr(start, pos - start);
+        if (*text == "true" || *text == "false") {
+            *type = JSON_BOOL;
+        } else if (*text == "null") {
+            *type = JSON_NULL;
+        } else if (!text->empty() && (isdigit((unsigned char) (*text)[0]) || (*text)[0] == '-')) {
+            *type = JSON_NUMBER;
+        } else {
+            return fail("expected a value");
+        }
+        return true;
+    }
+
+    bool value(json_field_t *field) {
+        skip_space();
+        if (pos < in.size() && in[pos] == '[') {
+            pos++;
+            field->type = JSON_ARRAY;
+            skip_space();
+            if (pos < in.size() && in[pos] == ']') {
+                pos++;
+                return true;
+            }
+            while (true) {
+                json_type_t type;
+                std::string item;
+                if (!scalar(&type, &item)) return false;
+                field->items.push_back(item);
+                skip_space();
+                if (pos < in.size() && in[pos] == ',') {
+                    pos++;
+                    continue;
+                }
+                return expect(']');
+            }
+        }
+        return scalar(&field->type, &field->text);
+    }
+};
+
+}
+
+int json_parse_object(const std::string &line, json_object_t *object, std::string *error) {
+    parser_t parser{line, 0, error};
+    object->clear();
+
+    if (!parser.expect('{')) return -1;
+    parser.skip_space();
+    if (parser.pos < line.size() && line[parser.pos] == '}') {
+        parser.pos++;
+    } else {
+        while (true) {
+            std::string key;
+            json_field_t field;
+            if (!parser.string(&key) || !parser.expect(':') || !parser.value(&field)) return -1;
+            (*object)[key] = field;
+
+            parser.skip_space();
+            if (parser.pos < line.size() && line[parser.pos] == ',') {
+                parser.pos++;
+                continue;
+            }
+            if (!parser.expect('}')) return -1;
+            break;
+        }
+    }
+
+    parser.skip_space();
+    if (parser.pos != line.size()) {
+        parser.fail("trailing characters");
+        return -1;
+    }
+    return 0;
+}
+
+std::string json_quote(const std::string &text) {
+    std::string out = "\"";
+    for (char c : text) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if ((unsigned char) c < 0x20) {
+                    char escaped[8];
+                    snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char) c);
+                    out += escaped;
+                } else {
+                    out.push_back(c);
+                }
+        }
+    }
+    return out + "\"";
+}
@@ -0,0 +1,32 @@
+#ifndef __JSON_LINE_H__
+#define __JSON_LINE_H__
+
+#include <map>
+#include <string>
+#include <vector>
+
+enum json_type_t {
+    JSON_NULL,
+    JSON_BOOL,
+    JSON_NUMBER,
+    JSON_STRING,
+    JSON_ARRAY,
+};
+
+struct json_field_t {
+    json_type_t type = JSON_NULL;
+    std::string text;               // string contents, number literal, "true" / "false"
+    std::vector<std::string> items; // array elements, in the same form
+};
+
+typedef std::map<std::string, json_field_t> json_object_t;
+
+/*
+ * One JSON object per line with scalar or flat array members, the shape of
+ * request and result lines. Nested objects are rejected.
+ */
+int json_parse_object(const std::string &line, json_object_t *object, std::string *error);
+
+std::string json_quote(const std::string &text);
+
+#endif /* __JSON_LINE_H__ */
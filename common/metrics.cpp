@@ -0,0 +1,228 @@
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "metrics.h"
+
+static const char *stage_names[METRIC_STAGES] = {
+        "exponent", "modexp", "gcd", "primality", "kernel_launch", "kernel_sync", "prime_table"
+};
+
+typedef std::atomic<unsigned long long> metric_t;
+
+// only the owning thread writes a shard, a relaxed load and store is all an increment needs
+static inline void bump(metric_t &metric, unsigned long long value) {
+    metric.store(metric.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+struct metric_shard_t {
+    metric_t stage_count[METRIC_STAGES];
+    metric_t stage_ns[METRIC_STAGES];
+    metric_t stage_buckets[METRIC_STAGES][METRIC_TIME_BUCKETS];
+    metric_t found_b[METRIC_B_BUCKETS];
+    metric_t found_b_sum;
+    metric_t factored[METRIC_BIT_CLASSES];
+    metric_t failed[METRIC_BIT_CLASSES];
+};
+
+// plain totals, a snapshot of the shards or what exited threads left behind
+struct metric_totals_t {
+    unsigned long long stage_count[METRIC_STAGES] = {};
+    unsigned long long stage_ns[METRIC_STAGES] = {};
+    unsigned long long stage_buckets[METRIC_STAGES][METRIC_TIME_BUCKETS] = {};
+    unsigned long long found_b[METRIC_B_BUCKETS] = {};
+    unsigned long long found_b_sum = 0;
+    unsigned long long factored[METRIC_BIT_CLASSES] = {};
+    unsigned long long failed[METRIC_BIT_CLASSES] = {};
+};
+
+static std::mutex registry_lock;
+static std::vector<metric_shard_t *> live_shards;
+static metric_totals_t retired;
+
+static void add_shard(metric_totals_t &totals, const metric_shard_t &shard) {
+    for (unsigned s = 0; s < METRIC_STAGES; s++) {
+        totals.stage_count[s] += shard.stage_count[s].load(std::memory_order_relaxed);
+        totals.stage_ns[s] += shard.stage_ns[s].load(std::memory_order_relaxed);
+        for (unsigned i = 0; i < METRIC_TIME_BUCKETS; i++) {
+            totals.stage_buckets[s][i] += shard.stage_buckets[s][i].load(std::memory_order_relaxed);
+        }
+    }
+    for (unsigned i = 0; i < METRIC_B_BUCKETS; i++) {
+        totals.found_b[i] += shard.found_b[i].load(std::memory_order_relaxed);
+    }
+    totals.found_b_sum += shard.found_b_sum.load(std::memory_order_relaxed);
+    for (unsigned i = 0; i < METRIC_BIT_CLASSES; i++) {
+        totals.factored[i] += shard.factored[i].load(std::memory_order_relaxed);
+        totals.failed[i] += shard.failed[i].load(std::memory_order_relaxed);
+    }
+}
+
+// registers the shard of a thread on first use, folds it into the retired totals when the thread exits
+class ShardHolder {
+public:
+    metric_shard_t *shard;
+
+    ShardHolder() : shard(new metric_shard_t()) {
+        std::lock_guard<std::mutex> guard(registry_lock);
+        live_shards.push_back(shard);
+    }
+
+    ~ShardHolder() {
+        std::lock_guard<std::mutex> guard(registry_lock);
+        add_shard(retired, *shard);
+        live_shards.erase(std::find(live_shards.begin(), live_shards.end(), shard));
+        delete shard;
+    }
+};
+
+static metric_shard_t &local_shard() {
+    thread_local ShardHolder holder;
+    return *holder.shard;
+}
+
+// index of the power of two bucket above value, 0 for 0
+static unsigned log2_bucket(unsigned long long value, unsigned buckets) {
+    unsigned bucket = 0;
+    while (value > 0 && bucket + 1 < buckets) {
+        value >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+static long long now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void metrics_record(metric_stage_t stage, long long elapsed_ns) {
+    if (elapsed_ns < 0) elapsed_ns = 0;
+    metric_shard_t &shard = local_shard();
+    bump(shard.stage_count[stage], 1);
+    bump(shard.stage_ns[stage], (unsigned long long) elapsed_ns);
+    bump(shard.stage_buckets[stage][log2_bucket((unsigned long long) elapsed_ns / 1000, METRIC_TIME_BUCKETS)], 1);
+}
+
+void metrics_factor_found(unsigned b) {
+    metric_shard_t &shard = local_shard();
+    bump(shard.found_b[b > 1 ? log2_bucket(b - 1, METRIC_B_BUCKETS) : 0], 1);
+    bump(shard.found_b_sum, b);
+}
+
+void metrics_input_done(unsigned bits, bool factored) {
+    // inputs of up to 2^i bits, so 256 and 200 bits share a class but 257 does not
+    const unsigned bit_class = bits > 1 ? log2_bucket(bits - 1, METRIC_BIT_CLASSES) : 0;
+    metric_shard_t &shard = local_shard();
+    bump(factored ? shard.factored[bit_class] : shard.failed[bit_class], 1);
+}
+
+MetricTimer::MetricTimer(metric_stage_t stage) : stage(stage), start(now_ns()) {
+}
+
+MetricTimer::~MetricTimer() {
+    metrics_record(stage, now_ns() - start);
+}
+
+static metric_totals_t snapshot() {
+    std::lock_guard<std::mutex> guard(registry_lock);
+    metric_totals_t totals = retired;
+    for (const metric_shard_t *shard : live_shards) {
+        add_shard(totals, *shard);
+    }
+    return totals;
+}
+
+static std::string format(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+static std::string format(const char *format, ...) {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    return buffer;
+}
+
+std::string metrics_prometheus() {
+    const metric_totals_t totals = snapshot();
+    std::string out;
+
+    out += "# HELP pollard_stage_seconds Time spent in the hot path stages of factoring.\n";
+    out += "# TYPE pollard_stage_seconds histogram\n";
+    for (unsigned s = 0; s < METRIC_STAGES; s++) {
+        unsigned long long cumulative = 0;
+        for (unsigned i = 0; i + 1 < METRIC_TIME_BUCKETS; i++) {
+            cumulative += totals.stage_buckets[s][i];
+            out += format("pollard_stage_seconds_bucket{stage=\"%s\",le=\"%g\"} %llu\n", stage_names[s],
+                          (double) (1ull << i) * 1e-6, cumulative);
+        }
+        out += format("pollard_stage_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %llu\n", stage_names[s],
+                      totals.stage_count[s]);
+        out += format("pollard_stage_seconds_sum{stage=\"%s\"} %.9f\n", stage_names[s],
+                      (double) totals.stage_ns[s] * 1e-9);
+        out += format("pollard_stage_seconds_count{stage=\"%s\"} %llu\n", stage_names[s], totals.stage_count[s]);
+    }
+
+    out += "# HELP pollard_factor_b Stage 1 bound B at which factors were found.\n";
+    out += "# TYPE pollard_factor_b histogram\n";
+    unsigned long long found = 0;
+    for (unsigned i = 0; i + 1 < METRIC_B_BUCKETS; i++) {
+        found += totals.found_b[i];
+        out += format("pollard_factor_b_bucket{le=\"%llu\"} %llu\n", 1ull << i, found);
+    }
+    found += totals.found_b[METRIC_B_BUCKETS - 1];
+    out += format("pollard_factor_b_bucket{le=\"+Inf\"} %llu\n", found);
+    out += format("pollard_factor_b_sum %llu\n", totals.found_b_sum);
+    out += format("pollard_factor_b_count %llu\n", found);
+
+    out += "# HELP pollard_inputs_total Inputs finished, by size class and outcome.\n";
+    out += "# TYPE pollard_inputs_total counter\n";
+    for (unsigned i = 0; i < METRIC_BIT_CLASSES; i++) {
+        if (totals.factored[i] == 0 && totals.failed[i] == 0) continue;
+        out += format("pollard_inputs_total{bits=\"%llu\",result=\"factored\"} %llu\n", 1ull << i,
+                      totals.factored[i]);
+        out += format("pollard_inputs_total{bits=\"%llu\",result=\"failed\"} %llu\n", 1ull << i, totals.failed[i]);
+    }
+    return out;
+}
+
+int metrics_write_prometheus(const char *filename) {
+    const std::string text = metrics_prometheus();
+    const std::string tmp = std::string(filename) + ".tmp";
+
+    FILE *file = fopen(tmp.c_str(), "w");
+    if (file == nullptr) {
+        perror(tmp.c_str());
+        return -1;
+    }
+    const bool written = fwrite(text.data(), 1, text.size(), file) == text.size();
+    if (fclose(file) != 0 || !written || rename(tmp.c_str(), filename) != 0) {
+        perror(filename);
+        remove(tmp.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+void metrics_print_summary(FILE *out) {
+    const metric_totals_t totals = snapshot();
+
+    fprintf(out, "\n%-14s %10s %14s %14s\n", "stage", "calls", "total [ms]", "avg [us]");
+    for (unsigned s = 0; s < METRIC_STAGES; s++) {
+        if (totals.stage_count[s] == 0) continue;
+        fprintf(out, "%-14s %10llu %14.3f %14.3f\n", stage_names[s], totals.stage_count[s],
+                (double) totals.stage_ns[s] / 1e6, (double) totals.stage_ns[s] / 1e3 / totals.stage_count[s]);
+    }
+
+    fprintf(out, "\n%-8s %10s %10s\n", "bits", "factored", "failed");
+    for (unsigned i = 0; i < METRIC_BIT_CLASSES; i++) {
+        if (totals.factored[i] == 0 && totals.failed[i] == 0) continue;
+        fprintf(out, "<=%-6llu %10llu %10llu\n", 1ull << i, totals.factored[i], totals.failed[i]);
+    }
+}
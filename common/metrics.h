@@ -0,0 +1,58 @@
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include <cstdio>
+#include <string>
+
+#define METRIC_TIME_BUCKETS 32 // bucket i holds durations below 2^i microseconds
+#define METRIC_B_BUCKETS 32    // bucket i holds factors found with B up to 2^i
+#define METRIC_BIT_CLASSES 16  // bucket i holds inputs of up to 2^i bits
+
+enum metric_stage_t {
+    METRIC_EXPONENT,     // building E(B) or E(B) / E(B_reached)
+    METRIC_MODEXP,
+    METRIC_GCD,
+    METRIC_PRIMALITY,
+    METRIC_KERNEL_LAUNCH,
+    METRIC_KERNEL_SYNC,
+    METRIC_PRIME_TABLE,
+    METRIC_STAGES
+};
+
+/*
+ * Hot path counters and latency histograms. Every thread records into its own
+ * shard, registered once on first use, so recording is a few plain stores with
+ * no lock and no shared cache line; readers sum the shards. Shards outlive
+ * their threads so nothing recorded is lost when a worker pool shuts down.
+ */
+void metrics_record(metric_stage_t stage, long long elapsed_ns);
+
+void metrics_factor_found(unsigned b);
+
+void metrics_input_done(unsigned bits, bool factored);
+
+// times the enclosing block into a stage histogram
+class MetricTimer {
+public:
+    explicit MetricTimer(metric_stage_t stage);
+
+    ~MetricTimer();
+
+private:
+    const metric_stage_t stage;
+    const long long start;
+
+    MetricTimer(const MetricTimer &) = delete;
+
+    MetricTimer &operator=(const MetricTimer &) = delete;
+};
+
+// Prometheus text exposition format
+std::string metrics_prometheus();
+
+// written to a temporary file and renamed, a scraper never sees half of it
+int metrics_write_prometheus(const char *filename);
+
+void metrics_print_summary(FILE *out);
+
+#endif /* __METRICS_H__ */
@@ -0,0 +1,138 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "numa.h"
+
+static thread_local int bound_node = -1;
+
+int numa_parse_cpulist(const char *text, std::vector<unsigned> &cpus) {
+    cpus.clear();
+    const char *it = text;
+    while (*it != '\0' && *it != '\n') {
+        char *end;
+        const unsigned long first = strtoul(it, &end, 10);
+        if (end == it) return -1;
+        unsigned long last = first;
+        it = end;
+        if (*it == '-') {
+            last = strtoul(it + 1, &end, 10);
+            if (end == it + 1 || last < first) return -1;
+            it = end;
+        }
+        for (unsigned long cpu = first; cpu <= last; cpu++) cpus.push_back((unsigned) cpu);
+        if (*it == ',') it++;
+        else if (*it != '\0' && *it != '\n') return -1;
+    }
+    return 0;
+}
+
+static std::vector<numa_node_t> read_topology() {
+    std::vector<numa_node_t> nodes;
+    DIR *dir = opendir(NUMA_SYSFS_NODES);
+    if (dir != nullptr) {
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != nullptr) {
+            unsigned id;
+            char tail;
+            if (sscanf(entry->d_name, "node%u%c", &id, &tail) != 1) continue;
+
+            const std::string path = std::string(NUMA_SYSFS_NODES) + "/" + entry->d_name + "/cpulist";
+            FILE *file = fopen(path.c_str(), "r");
+            if (file == nullptr) continue;
+            char line[4096];
+            numa_node_t node;
+            node.id = id;
+            // memory-only nodes have an empty cpulist, no worker runs there
+            if (fgets(line, sizeof(line), file) != nullptr && numa_parse_cpulist(line, node.cpus) == 0 &&
+                !node.cpus.empty()) {
+                nodes.push_back(node);
+            }
+            fclose(file);
+        }
+        closedir(dir);
+    }
+    std::sort(nodes.begin(), nodes.end(), [](const numa_node_t &a, const numa_node_t &b) { return a.id < b.id; });
+
+    if (nodes.empty()) {
+        numa_node_t node;
+        node.id = 0;
+        const unsigned hw = std::thread::hardware_concurrency();
+        for (unsigned cpu = 0; cpu < (hw > 0 ? hw : 1); cpu++) node.cpus.push_back(cpu);
+        nodes.push_back(node);
+    }
+    return nodes;
+}
+
+const std::vector<numa_node_t> &numa_topology() {
+    static const std::vector<numa_node_t> nodes = read_topology();
+    return nodes;
+}
+
+unsigned numa_node_count() {
+    return (unsigned) numa_topology().size();
+}
+
+int numa_bind_thread(unsigned node) {
+    const auto &nodes = numa_topology();
+    if (node >= nodes.size()) return -1;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (unsigned cpu : nodes[node].cpus) {
+        if (cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+    }
+    const int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err != 0) {
+        fprintf(stderr, "Cannot bind a thread to NUMA node %u: %s\n", nodes[node].id, strerror(err));
+        return -1;
+    }
+    bound_node = (int) node;
+    return 0;
+}
+
+int numa_thread_node() {
+    return bound_node;
+}
+
+NumaReplicas::NumaReplicas(const void *data, size_t bytes) : original(data), bytes(bytes) {
+    const unsigned nodes = numa_node_count();
+    if (nodes < 2) return;
+
+    copies.assign(nodes, nullptr);
+    for (unsigned node = 0; node < nodes; node++) {
+        void *copy = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (copy == MAP_FAILED) {
+            fprintf(stderr, "Cannot map a replica for NUMA node %u, its threads read the original\n",
+                    numa_topology()[node].id);
+            continue;
+        }
+        // the first write decides where the pages live
+        std::thread writer([=]() {
+            numa_bind_thread(node);
+            memcpy(copy, data, bytes);
+        });
+        writer.join();
+        copies[node] = copy;
+    }
+}
+
+NumaReplicas::~NumaReplicas() {
+    for (void *copy : copies) {
+        if (copy != nullptr) munmap(copy, bytes);
+    }
+}
+
+const void *NumaReplicas::local() const {
+    const int node = numa_thread_node();
+    if (node < 0 || (unsigned) node >= copies.size() || copies[node] == nullptr) return original;
+    return copies[node];
+}
@@ -0,0 +1,61 @@
+#ifndef __NUMA_H__
+#define __NUMA_H__
+
+#include <cstddef>
+#include <vector>
+
+#define NUMA_SYSFS_NODES "/sys/devices/system/node"
+
+struct numa_node_t {
+    unsigned id; // node number in sysfs
+    std::vector<unsigned> cpus;
+};
+
+/*
+ * NUMA nodes with CPUs, read once from sysfs; a single node holding every
+ * CPU when the kernel exposes none. Nodes are addressed by their index in
+ * this list, not by their sysfs number.
+ */
+const std::vector<numa_node_t> &numa_topology();
+
+unsigned numa_node_count();
+
+// "0-3,8,10-11" as in a sysfs cpulist, 0 on success
+int numa_parse_cpulist(const char *text, std::vector<unsigned> &cpus);
+
+// restricts the calling thread to the CPUs of the node, -1 for an unknown node or a refused affinity
+int numa_bind_thread(unsigned node);
+
+// node the calling thread was bound to, -1 when it is not bound
+int numa_thread_node();
+
+/*
+ * Read-only data copied once per NUMA node. Each copy is written by a
+ * thread bound to its node into freshly mapped pages, so first touch
+ * places it there, and threads read the copy of the node they are bound
+ * to. With a single node the original is used as is.
+ */
+class NumaReplicas {
+public:
+    NumaReplicas(const void *data, size_t bytes);
+
+    ~NumaReplicas();
+
+    // the copy for the calling thread's node, the original for unbound threads
+    const void *local() const;
+
+    unsigned count() const {
+        return (unsigned) copies.size();
+    }
+
+private:
+    const void *original;
+    const size_t bytes;
+    std::vector<void *> copies; // by node index, empty on one node
+
+    NumaReplicas(const NumaReplicas &) = delete;
+
+    NumaReplicas &operator=(const NumaReplicas &) = delete;
+};
+
+#endif /* __NUMA_H__ */
@@ -2,6 +2,7 @@
 
 #include <cstdio>
 #include "prime_table.h"
+#include "trace.h"
 #include "../primegen/primegen.h"
 
 #define LOAD_FROM_BINARY 1
@@ -25,8 +26,8 @@ static int check_prime_table(const unsigned primes[], const unsigned primes_num)
     for (unsigned p = 0; p < primes_num; p++) {
         if (primes[p] <= 1 ||
             p > 0 && primes[p] < primes[p - 1]) {
-            printf("Invalid prime number %lu (0x%08lu) at position %u\n", (unsigned long) primes[p],
-                   (unsigned long) primes[p], p);
+            fprintf(stderr, "Invalid prime number %lu (0x%08lu) at position %u\n", (unsigned long) primes[p],
+                    (unsigned long) primes[p], p);
             return -1;
         }
     }
@@ -34,6 +35,7 @@ static int check_prime_table(const unsigned primes[], const unsigned primes_num)
 }
 
 int generate_prime_table(unsigned primes[], unsigned &primes_num) {
+    TRACE_SCOPE("generate_prime_table");
 #ifdef LOAD_FROM_BINARY
     const char primes_numbers_list_filename[] = "prime_numbers_list.bin";
 #else
@@ -71,14 +73,13 @@ int generate_prime_table(unsigned primes[], unsigned &primes_num) {
         };
 #endif
         fclose(pFile);
-        printf("Loaded %u prime numbers from file: %s\n", primes_num, primes_numbers_list_filename);
+        fprintf(stderr, "Loaded %u prime numbers from file: %s\n", primes_num, primes_numbers_list_filename);
     };
 
     if (!list_loades_from_file) {
-        printf("Generating prime table...");
-        fflush(stdout);
+        fprintf(stderr, "Generating prime table...");
         get_prime_table(primes, primes_num);
-        printf("Finished generating prime table!\n");
+        fprintf(stderr, "Finished generating prime table!\n");
     };
 
     if (!list_loades_from_file) {
@@ -118,7 +119,7 @@ int generate_prime_table(unsigned primes[], unsigned &primes_num) {
             fprintf(pFile, "\n");
 #endif
             fclose(pFile);
-            printf("Save %u/%u prime numbers to file: %s\n", p, primes_num, primes_numbers_list_filename);
+            fprintf(stderr, "Save %u/%u prime numbers to file: %s\n", p, primes_num, primes_numbers_list_filename);
         };
     };
 
@@ -127,6 +128,6 @@ int generate_prime_table(unsigned primes[], unsigned &primes_num) {
        return -1;
 #endif
 
-    printf("Last generated prime number: %u (0x%08x)\n", primes[primes_num - 1], primes[primes_num - 1]);
+    fprintf(stderr, "Last generated prime number: %u (0x%08x)\n", primes[primes_num - 1], primes[primes_num - 1]);
     return 0;
 }
@@ -0,0 +1,34 @@
+#include "submission_queue.h"
+
+SubmissionQueue::SubmissionQueue(unsigned depth) : depth(depth > 0 ? depth : 1) {
+}
+
+void SubmissionQueue::acquire() {
+    std::unique_lock<std::mutex> guard(lock);
+    const unsigned long long ticket = next_ticket++;
+    admitted.wait(guard, [this, ticket]() { return ticket == next_admit && in_flight < depth; });
+    next_admit++;
+    in_flight++;
+    admitted.notify_all(); // the next ticket may fit as well
+}
+
+void SubmissionQueue::release() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        in_flight--;
+    }
+    admitted.notify_all();
+}
+
+unsigned SubmissionQueue::waiting() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return (unsigned) (next_ticket - next_admit);
+}
+
+SubmissionSlot::SubmissionSlot(SubmissionQueue &queue) : queue(queue) {
+    queue.acquire();
+}
+
+SubmissionSlot::~SubmissionSlot() {
+    queue.release();
+}
@@ -0,0 +1,40 @@
+#ifndef __SUBMISSION_QUEUE_H__
+#define __SUBMISSION_QUEUE_H__
+
+#include <condition_variable>
+#include <mutex>
+
+/*
+ * Bounded FIFO admission to a shared device: at most `depth` submissions are in
+ * flight, the rest wait in arrival order.
+ */
+class SubmissionQueue {
+public:
+    explicit SubmissionQueue(unsigned depth);
+
+    void acquire();
+
+    void release();
+
+    unsigned waiting() const;
+
+private:
+    const unsigned depth;
+    mutable std::mutex lock;
+    std::condition_variable admitted;
+    unsigned long long next_ticket = 0;
+    unsigned long long next_admit = 0;
+    unsigned in_flight = 0;
+};
+
+class SubmissionSlot {
+public:
+    explicit SubmissionSlot(SubmissionQueue &queue);
+
+    ~SubmissionSlot();
+
+private:
+    SubmissionQueue &queue;
+};
+
+#endif /* __SUBMISSION_QUEUE_H__ */
@@ -0,0 +1,112 @@
+#include "thread_pool.h"
+#include "numa.h"
+
+static thread_local const WorkStealingPool *current_pool = nullptr;
+static thread_local unsigned current_worker = 0;
+
+WorkStealingPool::WorkStealingPool(unsigned threads, int node) : node(node) {
+    if (threads < 1) threads = 1;
+
+    for (unsigned i = 0; i < threads; i++) {
+        queues.emplace_back(new worker_queue_t);
+    }
+    for (unsigned i = 0; i < threads; i++) {
+        workers.emplace_back(&WorkStealingPool::run, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    wait();
+    {
+        std::lock_guard<std::mutex> guard(state_lock);
+        stopping = true;
+    }
+    work_available.notify_all();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+void WorkStealingPool::submit(std::function<void()> task) {
+    unsigned target;
+    {
+        std::lock_guard<std::mutex> guard(state_lock);
+        // tasks spawned by a worker stay local, outside submissions are spread round-robin
+        target = (current_pool == this) ? current_worker : next_queue++ % (unsigned) queues.size();
+        pending++;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(queues[target]->lock);
+        queues[target]->tasks.push_back(std::move(task));
+    }
+    {
+        // counted once it is in a deque, so a worker that claims it always finds a task
+        std::lock_guard<std::mutex> guard(state_lock);
+        queued++;
+    }
+    work_available.notify_one();
+}
+
+void WorkStealingPool::wait() {
+    std::unique_lock<std::mutex> guard(state_lock);
+    all_done.wait(guard, [this]() { return pending == 0; });
+}
+
+unsigned WorkStealingPool::size() const {
+    return (unsigned) workers.size();
+}
+
+bool WorkStealingPool::take(unsigned self, std::function<void()> &task) {
+    {
+        worker_queue_t &own = *queues[self];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    const unsigned count = (unsigned) queues.size();
+    for (unsigned i = 1; i < count; i++) {
+        worker_queue_t &victim = *queues[(self + i) % count];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::run(unsigned self) {
+    current_pool = this;
+    current_worker = self;
+    if (node >= 0) numa_bind_thread((unsigned) node);
+
+    while (true) {
+        {
+            // idle workers sleep here, a task is claimed before any deque is searched
+            std::unique_lock<std::mutex> guard(state_lock);
+            work_available.wait(guard, [this]() { return queued > 0 || stopping; });
+            if (stopping && queued == 0) return;
+            queued--;
+        }
+
+        // claims never outnumber the queued tasks, a search only misses one that moved while it looked
+        std::function<void()> task;
+        while (!take(self, task)) std::this_thread::yield();
+
+        task();
+
+        std::lock_guard<std::mutex> guard(state_lock);
+        if (--pending == 0) all_done.notify_all();
+    }
+}
+
+unsigned default_worker_count() {
+    const unsigned hw = std::thread::hardware_concurrency();
+    return hw > 0 ? hw : 1;
+}
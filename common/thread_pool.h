@@ -0,0 +1,54 @@
+#ifndef __THREAD_POOL_H__
+#define __THREAD_POOL_H__
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Fixed set of workers, each with its own task deque. A worker takes its newest
+ * task first and steals the oldest task of another worker when its deque runs dry.
+ * Workers of a pool created with a NUMA node index are bound to that node.
+ */
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(unsigned threads, int node = -1);
+
+    ~WorkStealingPool();
+
+    void submit(std::function<void()> task);
+
+    void wait();
+
+    unsigned size() const;
+
+private:
+    struct worker_queue_t {
+        std::mutex lock;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<worker_queue_t>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex state_lock;
+    std::condition_variable work_available;
+    std::condition_variable all_done;
+    unsigned queued = 0;  // tasks sitting in deques
+    unsigned pending = 0; // tasks submitted and not finished yet
+    unsigned next_queue = 0;
+    bool stopping = false;
+    const int node;
+
+    bool take(unsigned self, std::function<void()> &task);
+
+    void run(unsigned self);
+};
+
+unsigned default_worker_count();
+
+#endif /* __THREAD_POOL_H__ */
@@ -0,0 +1,109 @@
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <unistd.h>
+
+#include "trace.h"
+
+std::atomic<bool> trace_active(false);
+
+struct trace_event_t {
+    const char *name;
+    long long start_ns;
+    long long duration_ns;
+};
+
+// spans of one thread, the lock is only ever contended by trace_write
+struct trace_buffer_t {
+    std::mutex lock;
+    unsigned tid;
+    std::vector<trace_event_t> events;
+    size_t next = 0; // overwrite position once the ring is full
+};
+
+static std::mutex registry_lock;
+static std::vector<std::unique_ptr<trace_buffer_t>> buffers; // kept after their thread exits
+static size_t ring_size = TRACE_EVENTS_PER_THREAD;
+static long long trace_epoch_ns = 0;
+
+static long long now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static trace_buffer_t &local_buffer() {
+    thread_local trace_buffer_t *buffer = nullptr;
+    if (buffer == nullptr) {
+        std::lock_guard<std::mutex> guard(registry_lock);
+        buffers.emplace_back(new trace_buffer_t);
+        buffer = buffers.back().get();
+        buffer->tid = (unsigned) buffers.size();
+    }
+    return *buffer;
+}
+
+void trace_enable(size_t events_per_thread) {
+    {
+        std::lock_guard<std::mutex> guard(registry_lock);
+        ring_size = events_per_thread > 0 ? events_per_thread : 1;
+        trace_epoch_ns = now_ns();
+    }
+    trace_active.store(true);
+}
+
+void TraceSpan::begin() {
+    start = now_ns();
+}
+
+void TraceSpan::end() {
+    const trace_event_t event = {name, start - trace_epoch_ns, now_ns() - start};
+    trace_buffer_t &buffer = local_buffer();
+    std::lock_guard<std::mutex> guard(buffer.lock);
+    if (buffer.events.size() < ring_size) {
+        buffer.events.push_back(event);
+    } else {
+        buffer.events[buffer.next] = event;
+        buffer.next = (buffer.next + 1) % ring_size;
+    }
+}
+
+int trace_write(const char *filename) {
+    trace_active.store(false);
+
+    FILE *file = fopen(filename, "w");
+    if (file == nullptr) {
+        perror(filename);
+        return -1;
+    }
+
+    const int pid = (int) getpid();
+    fprintf(file, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    fprintf(file, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, \"args\": {\"name\": \"pollard\"}}", pid);
+
+    std::lock_guard<std::mutex> registry_guard(registry_lock);
+    for (auto &buffer : buffers) {
+        std::lock_guard<std::mutex> guard(buffer->lock);
+        fprintf(file, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %u, "
+                      "\"args\": {\"name\": \"thread %u\"}}", pid, buffer->tid, buffer->tid);
+
+        // oldest first, spans are recorded when they end so a parent follows its children
+        const size_t count = buffer->events.size();
+        for (size_t i = 0; i < count; i++) {
+            const trace_event_t &event = buffer->events[(buffer->next + i) % count];
+            fprintf(file, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": %d, \"tid\": %u, "
+                          "\"ts\": %lld.%03lld, \"dur\": %lld.%03lld}",
+                    event.name, pid, buffer->tid, event.start_ns / 1000, event.start_ns % 1000,
+                    event.duration_ns / 1000, event.duration_ns % 1000);
+        }
+    }
+    fprintf(file, "\n]}\n");
+
+    if (fclose(file) != 0) {
+        perror(filename);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,51 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <atomic>
+#include <cstddef>
+
+#define TRACE_EVENTS_PER_THREAD (1 << 16) // ring size, the oldest spans of a thread are overwritten
+
+/*
+ * Opt-in timeline of a run in Chrome / Perfetto trace-event format. Spans are
+ * kept in per-thread ring buffers on a monotonic clock and written out once at
+ * the end; while tracing is off a span costs one relaxed load.
+ *
+ *   TRACE_SCOPE("modexp");   // span from here to the end of the block
+ */
+extern std::atomic<bool> trace_active;
+
+void trace_enable(size_t events_per_thread = TRACE_EVENTS_PER_THREAD);
+
+// stops recording and writes every thread's spans as trace-event JSON
+int trace_write(const char *filename);
+
+class TraceSpan {
+public:
+    // name must outlive the trace, a string literal in practice
+    explicit TraceSpan(const char *name) : name(name), start(-1) {
+        if (trace_active.load(std::memory_order_relaxed)) begin();
+    }
+
+    ~TraceSpan() {
+        if (start >= 0) end();
+    }
+
+private:
+    const char *name;
+    long long start;
+
+    void begin();
+
+    void end();
+
+    TraceSpan(const TraceSpan &) = delete;
+
+    TraceSpan &operator=(const TraceSpan &) = delete;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceSpan TRACE_CONCAT(trace_span_, __LINE__)(name)
+
+#endif /* __TRACE_H__ */
@@ -0,0 +1,150 @@
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <list>
+#include <thread>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "unix_server.h"
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void on_stop_signal(int) {
+    stop_requested = 1;
+}
+
+void stop_unix_server() {
+    stop_requested = 1;
+}
+
+ClientConnection::ClientConnection(int fd) : fd(fd) {
+}
+
+ClientConnection::~ClientConnection() {
+    close(fd);
+}
+
+int ClientConnection::send_line(const std::string &line) {
+    std::lock_guard<std::mutex> guard(write_lock);
+    const std::string data = line + "\n";
+    size_t sent = 0;
+    while (sent < data.size()) {
+        const ssize_t res = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (res < 0 && errno == EINTR) continue;
+        if (res <= 0) return -1; // client went away, the result is dropped
+        sent += (size_t) res;
+    }
+    return 0;
+}
+
+void ClientConnection::shutdown_read() {
+    shutdown(fd, SHUT_RD);
+}
+
+static void read_lines(const std::shared_ptr<ClientConnection> &client, int fd, const line_handler_t &handler) {
+    std::string pending;
+    char buffer[65536];
+    while (true) {
+        const ssize_t res = recv(fd, buffer, sizeof(buffer), 0);
+        if (res < 0 && errno == EINTR) continue;
+        if (res <= 0) break;
+
+        pending.append(buffer, (size_t) res);
+        size_t start = 0, end;
+        while ((end = pending.find('\n', start)) != std::string::npos) {
+            std::string line = pending.substr(start, end - start);
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (!line.empty()) handler(client, line);
+            start = end + 1;
+        }
+        pending.erase(0, start);
+
+        if (pending.size() > SERVER_MAX_LINE) {
+            client->send_line("{\"error\": \"request line too long\"}");
+            break;
+        }
+    }
+}
+
+int serve_unix_socket(const char *path, const line_handler_t &handler) {
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+
+    const int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    unlink(path); // stale socket of an earlier server
+    if (bind(listen_fd, (sockaddr *) &address, sizeof(address)) != 0 || listen(listen_fd, SOMAXCONN) != 0) {
+        perror(path);
+        close(listen_fd);
+        return -1;
+    }
+
+    stop_requested = 0;
+    signal(SIGINT, on_stop_signal);
+    signal(SIGTERM, on_stop_signal);
+    printf("Listening on %s\n", path);
+    fflush(stdout);
+
+    struct client_t {
+        std::shared_ptr<ClientConnection> connection;
+        std::shared_ptr<std::atomic<bool>> finished;
+        std::thread reader;
+    };
+    std::list<client_t> clients;
+
+    while (!stop_requested) {
+        // reap the readers of disconnected clients
+        for (auto it = clients.begin(); it != clients.end();) {
+            if (it->finished->load()) {
+                it->reader.join();
+                it = clients.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        pollfd listen_poll = {listen_fd, POLLIN, 0};
+        if (poll(&listen_poll, 1, SERVER_POLL_MS) <= 0) continue;
+
+        const int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) continue;
+
+        client_t client;
+        client.connection = std::make_shared<ClientConnection>(fd);
+        client.finished = std::make_shared<std::atomic<bool>>(false);
+        auto connection = client.connection;
+        auto finished = client.finished;
+        client.reader = std::thread([connection, finished, fd, &handler]() {
+            read_lines(connection, fd, handler);
+            finished->store(true);
+        });
+        clients.push_back(std::move(client));
+    }
+
+    printf("Stopping server on %s\n", path);
+    close(listen_fd);
+    unlink(path);
+    for (auto &client : clients) {
+        client.connection->shutdown_read();
+        client.reader.join();
+    }
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    return 0;
+}
@@ -0,0 +1,47 @@
+#ifndef __UNIX_SERVER_H__
+#define __UNIX_SERVER_H__
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#define SERVER_MAX_LINE (1 << 20) // longer requests close the connection
+#define SERVER_POLL_MS 200        // how often the accept loop looks for a stop request
+
+/*
+ * Client end of the socket. Replies may be sent from any thread; the socket is
+ * closed when the last reference goes away, so work still running for a client
+ * that stopped sending can finish and reply.
+ */
+class ClientConnection {
+public:
+    explicit ClientConnection(int fd);
+
+    ~ClientConnection();
+
+    int send_line(const std::string &line);
+
+    void shutdown_read();
+
+private:
+    const int fd;
+    std::mutex write_lock;
+
+    ClientConnection(const ClientConnection &) = delete;
+
+    ClientConnection &operator=(const ClientConnection &) = delete;
+};
+
+typedef std::function<void(const std::shared_ptr<ClientConnection> &, const std::string &)> line_handler_t;
+
+/*
+ * Line-oriented server on a Unix-domain socket. Every client gets a reader
+ * thread that passes each received line to the handler. Runs until SIGINT,
+ * SIGTERM or stop_unix_server().
+ */
+int serve_unix_socket(const char *path, const line_handler_t &handler);
+
+void stop_unix_server();
+
+#endif /* __UNIX_SERVER_H__ */
@@ -3,330 +3,343 @@
 #include <cstring>
 #include <ctime>
 
-#include "common/get_timestamp.h"
-#include "common/prime_table.h"
-#include "pollard/kernel.h"
-#include "pollard/cpu_factor.h"
-
-#include <gmp.h>
+#include "common/corpus.h"
+#include "common/json_line.h"
+#include "common/metrics.h"
+#include "common/unix_server.h"
+#include "pollard/b_schedule.h"
+#include "pollard/libpollard.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <vector>
 
-#define B_MAX 33554432 // 2^25
-#define B_JUMP 2048
-#define B_START 2
-
-class FactorAlgorithm {
-public:
-    virtual int factorize_single(mpz_t n,
-                                 unsigned b_max,
-                                 unsigned b_start,
-                                 unsigned b_jump,
-                                 mpz_t *result,
-                                 unsigned *b_found) = 0;
-
-    virtual int initialize(const unsigned primes[], const unsigned primes_num) = 0;
-
-    virtual int clean() = 0;
-
-    int factorize(mpz_t n, mpz_t max_factor, std::vector<mpz_ptr> &all_factors, std::vector<unsigned> &all_powers) {
-        mpz_t new_n, q, mod, zero, one, two;
-
-        mpz_init(two);
-        mpz_init(q);
-        mpz_init(new_n);
-        mpz_init(zero);
-        mpz_init(one);
-        mpz_init(mod);
-        mpz_set(new_n, n);
-        mpz_set_ui(zero, 0);
-        mpz_set_ui(one, 1);
-        mpz_set_ui(two, 2);
-        unsigned int power_two = 0;
-        unsigned int b_start = B_START;
-        unsigned int factor_count = 0;
-
-        const long long t_start = get_timestamp();
-        fflush(stdout);
+#define MAX_STAT_CLASSES 16
 
-        while (mpz_cdiv_q_ui(q, new_n, 2) == 0) {
-            mpz_set(new_n, q);
-            power_two++;
-        }
-
-        if (power_two > 0) {
-            mpz_set(all_factors[factor_count], two);
-            all_powers.push_back(power_two);
-            factor_count++;
-        }
+static void print_scheduler_stats(pollard_context_t *context) {
+    pollard_class_stats_t stats[MAX_STAT_CLASSES];
+    const size_t classes = pollard_stats(context, stats, MAX_STAT_CLASSES);
 
-        int b_jump = B_JUMP;
-
-        printf("---------\n");
+    printf("\n%-6s %8s %8s %10s %10s %14s %14s %14s\n", "class", "depth", "max", "completed", "rejected",
+           "avg wait [ms]", "max wait [ms]", "avg run [ms]");
+    for (size_t c = 0; c < classes; c++) {
+        if (stats[c].submitted == 0 && stats[c].rejected == 0) continue;
+        const double completed = stats[c].completed > 0 ? (double) stats[c].completed : 1.0;
+        printf("%-6u %8u %8u %10llu %10llu %14.3f %14.3f %14.3f\n", stats[c].bits, stats[c].depth,
+               stats[c].max_depth, stats[c].completed, stats[c].rejected, stats[c].wait_total_us / completed / 1000.0,
+               stats[c].wait_max_us / 1000.0, stats[c].run_total_us / completed / 1000.0);
+    }
+}
 
-        while (true) {
-            mpz_t factor;
-            mpz_init(factor);
+static std::string scheduler_stats_json(pollard_context_t *context) {
+    pollard_class_stats_t stats[MAX_STAT_CLASSES];
+    const size_t classes = pollard_stats(context, stats, MAX_STAT_CLASSES);
+
+    std::string out;
+    for (size_t c = 0; c < classes; c++) {
+        if (c > 0) out += ", ";
+        out += "{\"bits\": " + std::to_string(stats[c].bits) +
+               ", \"depth\": " + std::to_string(stats[c].depth) +
+               ", \"max_depth\": " + std::to_string(stats[c].max_depth) +
+               ", \"submitted\": " + std::to_string(stats[c].submitted) +
+               ", \"completed\": " + std::to_string(stats[c].completed) +
+               ", \"rejected\": " + std::to_string(stats[c].rejected) +
+               ", \"wait_total_us\": " + std::to_string(stats[c].wait_total_us) +
+               ", \"wait_max_us\": " + std::to_string(stats[c].wait_max_us) +
+               ", \"run_total_us\": " + std::to_string(stats[c].run_total_us) +
+               ", \"run_max_us\": " + std::to_string(stats[c].run_max_us) + "}";
+    }
+    return "[" + out + "]";
+}
 
-            char num_str[1024] = {'\0'};
-            mpz_get_str(num_str, 16, new_n);
+// one request line of a server client, its numbers report back as they complete
+struct ServerRequest {
+    std::shared_ptr<ClientConnection> client;
+    std::string request_id;
+    std::vector<std::string> numbers;
+    std::atomic<unsigned> remaining{0};
+    std::atomic<unsigned> factored{0};
+};
 
-            if (mpz_probab_prime_p(new_n, 50) != 0) {
-                printf("Input is prime!\n");
-                mpz_set(all_factors[factor_count++], new_n);
-                all_powers.push_back(1);
-                return 0;
-            }
+struct ServerJob {
+    std::shared_ptr<ServerRequest> request;
+    size_t index;
+};
 
-            printf("Sub-factoring 0x%s\n", num_str);
-            fflush(stdout);
+static std::mutex server_output_lock;
 
-            const long long start_single = get_timestamp();
-            unsigned b_found = 0;
-            int returnVal = factorize_single(new_n, B_MAX, b_start, b_jump, &factor, &b_found);
-            if (returnVal != 0) {
-                return -1;
-            }
-            const long long elapsed_us_single = get_timestamp() - start_single;
-
-            if (mpz_probab_prime_p(factor, 50) == 0) {
-                b_jump = b_jump / 2;
-                if (b_jump < 2) {
-                    return -1;
-                }
-                continue;
-            } else {
-                b_jump = B_JUMP;
-            }
+static const char *metrics_file = nullptr;
+static std::mutex metrics_file_lock;
 
-            char factor_str[1024] = {'\0'};
-            mpz_get_str(factor_str, 16, factor);
-            printf("Single factor computed in %ld.%06ld s: 0x%s", (long) (elapsed_us_single / 1000000),
-                   (long) (elapsed_us_single % 1000000), factor_str);
-
-            unsigned int power = 0;
-            do {
-                mpz_cdiv_qr(q, mod, new_n, factor);
-                if (mpz_cmp(mod, zero) == 0) {
-                    power++;
-                    mpz_set(new_n, q);
-                } else {
-                    break;
-                }
-            } while (true);
-
-            if (power > 0) {
-                printf(" - correct\n");
-            } else {
-                printf(" - incorrect!\n");
-                return -1;
-            }
+static void write_metrics_file() {
+    if (metrics_file == nullptr) return;
+    std::lock_guard<std::mutex> guard(metrics_file_lock);
+    metrics_write_prometheus(metrics_file);
+}
 
-            mpz_set(all_factors[factor_count++], factor);
-            all_powers.push_back(power);
-
-            if (mpz_cmp(new_n, one) == 0) {
-                printf("All factors found!\n");
-                break;
-            } else if (mpz_probab_prime_p(new_n, 50) != 0) { // new_n is prime
-                printf("Quotient is prime!\n");
-                mpz_set(all_factors[factor_count++], new_n);
-                all_powers.push_back(1);
-                break;
-            } else if (mpz_cmp(factor, max_factor) >= 0) { // factor is greater than required
-                printf("Found all factors of required size!\n");
-                break;
-            }
-        }
+static const char *status_name(int status) {
+    switch (status) {
+        case POLLARD_FACTORED: return "factored";
+        case POLLARD_PARTIAL: return "partial";
+        case POLLARD_FAILED: return "failed";
+        default: return "error";
+    }
+}
 
-        const long long elapsed_us = get_timestamp() - t_start;
-        printf("---------\n");
-        printf("Factorization computed in %ld.%06ld s: ", (long) (elapsed_us / 1000000), (long) (elapsed_us % 1000000));
+static void server_job_done(void *user, const pollard_result_t *result) {
+    std::unique_ptr<ServerJob> job((ServerJob *) user);
+    ServerRequest &request = *job->request;
 
-        return 0;
+    {
+        std::lock_guard<std::mutex> guard(server_output_lock);
+        fputs(result->log, stdout);
+        fflush(stdout);
     }
-};
 
-class CPUFactorAlgorithm : public FactorAlgorithm {
-public:
-    const unsigned *dev_primes = nullptr;
-    unsigned int primes_num_p = 0;
-
-    int factorize_single(mpz_t n,
-                         unsigned b_max,
-                         unsigned b_start,
-                         unsigned b_jump,
-                         mpz_t *result,
-                         unsigned *b_found) override {
-        return cpu_factorize(n, dev_primes, primes_num_p, b_max, b_start, b_jump, result, b_found);
+    std::string factors;
+    for (size_t i = 0; i < result->factor_count; i++) {
+        if (i > 0) factors += ", ";
+        factors += "[" + json_quote(result->factors[i].prime) + ", " + std::to_string(result->factors[i].power) + "]";
     }
-
-    int initialize(const unsigned int *primes, const unsigned int primes_num) override {
-        dev_primes = primes;
-        primes_num_p = primes_num;
-        return 0;
+    if (result->status == POLLARD_FACTORED) request.factored++;
+
+    request.client->send_line("{\"request_id\": " + json_quote(request.request_id) +
+                              ", \"index\": " + std::to_string(job->index) +
+                              ", \"number\": " + json_quote(request.numbers[job->index]) +
+                              ", \"status\": \"" + status_name(result->status) +
+                              "\", \"factors\": [" + factors + "], \"elapsed_us\": " +
+                              std::to_string(result->elapsed_us) + "}");
+    if (--request.remaining == 0) {
+        request.client->send_line("{\"request_id\": " + json_quote(request.request_id) +
+                                  ", \"done\": true, \"factored\": " + std::to_string(request.factored.load()) +
+                                  ", \"total\": " + std::to_string(request.numbers.size()) + "}");
+        write_metrics_file();
     }
+}
 
-    int clean() override {
-        return 0;
+/*
+ * Resident mode: the prime table and the backend stay initialized and every
+ * client line {"request_id": ..., "numbers": [hex, ...]} ("number" for a single
+ * one, optional "n-1": true and "priority": int) is queued on the shared
+ * scheduler. Each number is answered by its own result line as soon as it is
+ * done, then a final {"request_id": ..., "done": true} line closes the request.
+ * {"request_id": ..., "stats": true} returns the scheduler statistics and
+ * {"request_id": ..., "metrics": true} the hot path metrics as Prometheus text;
+ * with -metrics the file is rewritten after every finished request. A full
+ * scheduler holds the client reader back, which pushes back on the client.
+ */
+static int run_server(const char *path, pollard_context_t *context, bool minus_one) {
+    if (pollard_prepare(context) != 0) {
+        return -1;
     }
-};
 
-class GPUFactorAlgorithm : public FactorAlgorithm {
-public:
-    unsigned *dev_primes = nullptr;
-    unsigned int primes_num_p = 0;
-
-    int factorize_single(mpz_t n,
-                         unsigned b_max,
-                         unsigned b_start,
-                         unsigned b_jump,
-                         mpz_t *result,
-                         unsigned *b_found) override {
-        return gpu_factorize(n, dev_primes, primes_num_p, b_max, b_start, b_jump, result, b_found);
-    }
+    auto handler = [&](const std::shared_ptr<ClientConnection> &client, const std::string &line) {
+        json_object_t object;
+        std::string error;
+        if (json_parse_object(line, &object, &error) != 0) {
+            client->send_line("{\"error\": " + json_quote("malformed request: " + error) + "}");
+            return;
+        }
 
-    int initialize(const unsigned int *primes, const unsigned int primes_num) override {
-        if (cudaInitialize() != 0) {
-            return -1;
+        auto request = std::make_shared<ServerRequest>();
+        request->client = client;
+        request->request_id = object["request_id"].text;
+        if (object["stats"].text == "true") {
+            client->send_line("{\"request_id\": " + json_quote(request->request_id) +
+                              ", \"classes\": " + scheduler_stats_json(context) + "}");
+            return;
+        }
+        if (object["metrics"].text == "true") {
+            client->send_line("{\"request_id\": " + json_quote(request->request_id) +
+                              ", \"metrics\": " + json_quote(metrics_prometheus()) + "}");
+            return;
         }
 
-        primes_num_p = primes_num;
-        dev_primes = allocate_primes(primes, primes_num_p);
-        if (dev_primes == nullptr) {
-            return -1;
+        if (object.count("numbers") != 0) {
+            request->numbers = object["numbers"].items;
+        } else if (object.count("number") != 0) {
+            request->numbers.push_back(object["number"].text);
         }
 
-        return 0;
-    }
+        bool request_minus_one = minus_one;
+        if (object.count("n-1") != 0) {
+            request_minus_one = object["n-1"].text == "true";
+        }
+        const int priority = object.count("priority") != 0 ? atoi(object["priority"].text.c_str()) : 0;
 
-    int clean() override {
-        return free_primes(dev_primes);
-    }
+        for (auto &number : request->numbers) {
+            if (number.empty() || number.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos) {
+                client->send_line("{\"request_id\": " + json_quote(request->request_id) +
+                                  ", \"error\": " + json_quote("not a hex number: " + number) + "}");
+                return;
+            }
+        }
+        if (request->numbers.empty()) {
+            client->send_line("{\"request_id\": " + json_quote(request->request_id) +
+                              ", \"error\": \"no numbers given\"}");
+            return;
+        }
+
+        request->remaining = (unsigned) request->numbers.size();
+        for (size_t i = 0; i < request->numbers.size(); i++) {
+            pollard_submit(context, request->numbers[i].c_str(), request_minus_one ? POLLARD_MINUS_ONE : 0, priority,
+                           server_job_done, new ServerJob{request, i});
+        }
+    };
+
+    const int res = serve_unix_socket(path, handler);
+    pollard_wait(context);
+    print_scheduler_stats(context);
+    metrics_print_summary(stdout);
+    write_metrics_file();
+    return res;
+}
+
+// command line inputs complete in any order and are printed in input order
+struct InputSlot {
+    std::mutex *lock;
+    std::condition_variable *done;
+    bool finished = false;
+    bool factored = false;
+    std::string log;
 };
 
+static void input_done(void *user, const pollard_result_t *result) {
+    auto *slot = (InputSlot *) user;
+    std::lock_guard<std::mutex> guard(*slot->lock);
+    slot->log = result->log;
+    slot->factored = result->status == POLLARD_FACTORED || result->status == POLLARD_PARTIAL;
+    slot->finished = true;
+    slot->done->notify_all();
+}
+
 int main(int argc, char *argv[]) {
     if (argc <= 1) {
-        fprintf(stderr, "Usage: %s [-n-1] (subtracts 1 from input number) [-cpu] (list of hex numbers to factor)\n", argv[0]);
+        fprintf(stderr,
+                "Usage: %s [-n-1] (subtracts 1 from input number) [-cpu] [-cpu-kernel] [-hybrid] [-no-numa] [-j threads] [-t search threads] [-schedule linear|geometric|cost] [-deadline ms] [-cost-model file] [-checkpoint dir] [-checkpoint-interval s] [-db file] [-queue jobs] [-metrics file] [-trace file] [-i corpus file] (list of hex numbers to factor | -serve socket)\n",
+                argv[0]);
         return -1;
     }
 
     srand(time(NULL));
 
-    FactorAlgorithm *alg;
-
-    if ((strcmp(argv[1], "-cpu")) != 0) {
-        alg = new GPUFactorAlgorithm;
-    } else {
-        alg = new CPUFactorAlgorithm;
+    pollard_options_t options;
+    pollard_options_init(&options);
+    options.gmp_arena = 1; // this process owns GMP's allocator
+    bool minus_one = false;
+    const char *serve_path = nullptr;
+    const char *corpus_file = nullptr;
+
+    int number_list_start = 1;
+    for (; number_list_start < argc && argv[number_list_start][0] == '-'; number_list_start++) {
+        const char *arg = argv[number_list_start];
+        if (strcmp(arg, "-cpu") == 0) {
+            options.use_cpu = 1;
+        } else if (strcmp(arg, "-cpu-kernel") == 0) {
+            options.use_cpu = 1;
+            options.host_kernel = 1;
+        } else if (strcmp(arg, "-hybrid") == 0) {
+            options.hybrid = 1;
+        } else if (strcmp(arg, "-no-numa") == 0) {
+            options.no_numa = 1;
+        } else if (strcmp(arg, "-n-1") == 0) {
+            minus_one = true;
+        } else if (strcmp(arg, "-j") == 0 && number_list_start + 1 < argc) {
+            options.job_threads = (unsigned) atoi(argv[++number_list_start]);
+        } else if (strcmp(arg, "-t") == 0 && number_list_start + 1 < argc) {
+            options.search_threads = (unsigned) atoi(argv[++number_list_start]);
+        } else if (strcmp(arg, "-deadline") == 0 && number_list_start + 1 < argc) {
+            options.deadline_ms = atoll(argv[++number_list_start]);
+        } else if (strcmp(arg, "-cost-model") == 0 && number_list_start + 1 < argc) {
+            options.cost_model_file = argv[++number_list_start];
+        } else if (strcmp(arg, "-checkpoint") == 0 && number_list_start + 1 < argc) {
+            options.checkpoint_dir = argv[++number_list_start];
+        } else if (strcmp(arg, "-checkpoint-interval") == 0 && number_list_start + 1 < argc) {
+            options.checkpoint_interval_s = atoll(argv[++number_list_start]);
+        } else if (strcmp(arg, "-serve") == 0 && number_list_start + 1 < argc) {
+            serve_path = argv[++number_list_start];
+        } else if (strcmp(arg, "-queue") == 0 && number_list_start + 1 < argc) {
+            options.queue_capacity = (unsigned) atoi(argv[++number_list_start]);
+        } else if (strcmp(arg, "-db") == 0 && number_list_start + 1 < argc) {
+            options.factor_db_file = argv[++number_list_start];
+        } else if (strcmp(arg, "-trace") == 0 && number_list_start + 1 < argc) {
+            options.trace_file = argv[++number_list_start];
+        } else if (strcmp(arg, "-i") == 0 && number_list_start + 1 < argc) {
+            corpus_file = argv[++number_list_start];
+        } else if (strcmp(arg, "-metrics") == 0 && number_list_start + 1 < argc) {
+            metrics_file = argv[++number_list_start];
+        } else if (strcmp(arg, "-schedule") == 0 && number_list_start + 1 < argc) {
+            b_schedule_kind_t schedule_kind;
+            if (b_schedule_parse(argv[++number_list_start], &schedule_kind) != 0) {
+                fprintf(stderr, "Unknown B schedule: %s\n", argv[number_list_start]);
+                return -1;
+            }
+            options.schedule = schedule_kind;
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", arg);
+            return -1;
+        }
     }
 
-    bool minus_one = (strcmp(argv[1], "-n-1") == 0);
-    int number_list_start = ((strcmp(argv[1], "-cpu") == 0 || (argc > 2 && strcmp(argv[2], "-cpu") == 0)) ? 2 : 1);
-    if (minus_one) {
-        number_list_start++;
+    // a corpus contributes its N column, the numbers on the command line follow
+    std::vector<std::string> numbers;
+    if (corpus_file != nullptr) {
+        std::string version;
+        std::vector<corpus_entry_t> entries;
+        if (corpus_load(corpus_file, &version, entries) != 0) {
+            return -1;
+        }
+        for (auto &entry : entries) numbers.push_back(entry.number);
     }
+    for (int num = number_list_start; num < argc; num++) numbers.emplace_back(argv[num]);
 
-    unsigned primes_num = MAX_PRIMES;
-    unsigned *prime_table = (unsigned *) calloc(primes_num, sizeof(unsigned));
-    if (generate_prime_table(prime_table, primes_num) != 0) {
+    pollard_context_t *context = pollard_create(&options);
+    if (context == nullptr) {
         return -1;
     }
 
-    mpz_t n, mod, two, max_factor;
-    mpz_t f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12;
-
-    mpz_init(n);
-    mpz_init(mod);
-    mpz_init(two);
-    mpz_init(max_factor);
-    mpz_init(f1);
-    mpz_init(f2);
-    mpz_init(f3);
-    mpz_init(f4);
-    mpz_init(f5);
-    mpz_init(f6);
-    mpz_init(f7);
-    mpz_init(f8);
-    mpz_init(f9);
-    mpz_init(f10);
-    mpz_init(f11);
-    mpz_init(f12);
-    mpz_set_ui(mod, 1);
-    mpz_set_ui(two, 2);
-
-    if (alg->initialize(prime_table, primes_num) != 0) {
-        free(prime_table);
-        return -1;
+    if (serve_path != nullptr) {
+        const int res = run_server(serve_path, context, minus_one);
+        pollard_destroy(context);
+        return res;
     }
 
-    unsigned factored_count = 0;
-    unsigned num = number_list_start;
-    for (; num < argc; num++) {
-        printf("\n<----------------------------------->\n");
-        print_timestamp();
-        const char *num_as_str = argv[num];
-        mpz_set_str(n, num_as_str, 16);
-
-        if (minus_one) {
-            mpz_sub_ui(max_factor, n, 1);
-            mpz_set(n, max_factor);
+    std::mutex done_lock;
+    std::condition_variable job_done;
+    std::vector<std::unique_ptr<InputSlot>> slots;
+    for (auto &number : numbers) {
+        slots.emplace_back(new InputSlot);
+        InputSlot &slot = *slots.back();
+        slot.lock = &done_lock;
+        slot.done = &job_done;
+        if (pollard_submit(context, number.c_str(), minus_one ? POLLARD_MINUS_ONE : 0, 0, input_done, &slot) != 0) {
+            slot.log = "\nNot a hex number: " + number + "\n";
+            slot.finished = true;
         }
+    }
 
-        mpz_pow_ui(max_factor, two, 63); //TODO generic, for now needs to be changed manually for bigger inputs
-
-        std::vector<mpz_ptr> all_factors(12);
+    unsigned factored_count = 0;
+    for (auto &slot : slots) {
         {
-            all_factors[0] = f1;
-            all_factors[1] = f2;
-            all_factors[2] = f3;
-            all_factors[3] = f4;
-            all_factors[4] = f5;
-            all_factors[5] = f6;
-            all_factors[6] = f7;
-            all_factors[7] = f8;
-            all_factors[8] = f9;
-            all_factors[9] = f10;
-            all_factors[10] = f11;
-            all_factors[11] = f12;
-        }
-
-        std::vector<unsigned> all_powers;
-
-        printf("Factoring 0x%s\n", num_as_str);
-        int resCode = alg->factorize(n, max_factor, all_factors, all_powers);
-        if (resCode != 0 && all_powers.empty()) {
-            fprintf(stderr, "Failed to factorize %d\n", resCode);
-            continue;
-        } else if (resCode != 0) {
-            printf("Only partial factorization found!\n");
-        }
-
-        for (int i = 0; i < all_powers.size(); ++i) {
-            char factor_str[1024] = {'\0'};
-            auto x = all_factors[i];
-            mpz_set(mod, x);
-            mpz_get_str(factor_str, 16, mod);
-            printf("0x%s ^ %d, ", factor_str, all_powers[i]);
+            std::unique_lock<std::mutex> guard(done_lock);
+            job_done.wait(guard, [&]() { return slot->finished; });
         }
-
-        if (all_powers.empty()) {
-            printf("Factors not found!\n");
-        } else {
-            factored_count++;
-            printf("\n");
-        }
-
-        print_timestamp();
+        fputs(slot->log.c_str(), stdout);
+        fflush(stdout);
+        if (slot->factored) factored_count++;
     }
 
-    printf("\n<----------------------------------->\n");
-    printf("Test run completed! Success rate %d/%d", factored_count, num - number_list_start);
-
-    alg->clean();
+    pollard_wait(context);
+    print_scheduler_stats(context);
+    metrics_print_summary(stdout);
+    write_metrics_file();
 
-    mpz_clear(n);
-    mpz_clear(mod);
+    printf("\n<----------------------------------->\n");
+    printf("Test run completed! Success rate %d/%d", factored_count, (int) slots.size());
 
-    free(prime_table);
+    pollard_destroy(context);
     return 0;
 }
@@ -0,0 +1,58 @@
+#include <cstring>
+
+#include "b_schedule.h"
+#include "../common/get_timestamp.h"
+
+static const char *schedule_names[] = {"linear", "geometric", "cost"};
+
+b_schedule_t b_schedule_make(b_schedule_kind_t kind, unsigned bits, unsigned b_start, unsigned b_jump,
+                             unsigned b_max) {
+    b_schedule_t schedule;
+    schedule.kind = kind;
+    schedule.b_start = b_start;
+    schedule.b_jump = b_jump > 0 ? b_jump : 1;
+    schedule.b_max = b_max;
+    schedule.ratio = B_SCHEDULE_GROWTH;
+
+    // a stage 1 step costs about B modular squarings of limbs^2 each, keep the linear
+    // part where one step stays within the budget and spread the rest geometrically
+    const unsigned limbs = (bits + 63) / 64 > 0 ? (bits + 63) / 64 : 1;
+    const unsigned knee_b = B_SCHEDULE_LINEAR_WORK / (limbs * limbs);
+    schedule.knee_steps = knee_b > b_start ? (knee_b - b_start) / schedule.b_jump : 0;
+    if (schedule.knee_steps < 4) schedule.knee_steps = 4;
+    schedule.deadline_us = 0;
+    schedule.first_step = 0;
+    schedule.end_step = 0;
+
+    return schedule;
+}
+
+b_schedule_t b_schedule_for_bits(unsigned bits, unsigned b_start, unsigned b_jump, unsigned b_max) {
+    const b_schedule_kind_t kind = bits <= B_SCHEDULE_LINEAR_BITS ? B_SCHEDULE_LINEAR : B_SCHEDULE_COST_MODEL;
+    return b_schedule_make(kind, bits, b_start, b_jump, b_max);
+}
+
+b_schedule_t b_schedule_slice(const b_schedule_t &schedule, unsigned first, unsigned end) {
+    b_schedule_t slice = schedule;
+    slice.first_step = schedule.first_step + first;
+    slice.end_step = schedule.first_step + (end > first ? end : first);
+    return slice;
+}
+
+bool b_schedule_expired(const b_schedule_t &schedule) {
+    return schedule.deadline_us != 0 && get_timestamp() >= schedule.deadline_us;
+}
+
+const char *b_schedule_name(b_schedule_kind_t kind) {
+    return schedule_names[kind];
+}
+
+int b_schedule_parse(const char *name, b_schedule_kind_t *kind) {
+    for (unsigned i = 0; i < sizeof(schedule_names) / sizeof(schedule_names[0]); i++) {
+        if (strcmp(name, schedule_names[i]) == 0) {
+            *kind = (b_schedule_kind_t) i;
+            return 0;
+        }
+    }
+    return -1;
+}
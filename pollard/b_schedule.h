@@ -0,0 +1,119 @@
+#ifndef __B_SCHEDULE_H__
+#define __B_SCHEDULE_H__
+
+#include <cmath>
+
+#ifdef __CUDACC__
+#define POLLARD_HOST_DEVICE __host__ __device__
+#else
+#define POLLARD_HOST_DEVICE
+#endif
+
+#define B_SCHEDULE_GROWTH 1.25f           // geometric ratio between consecutive B increments
+#define B_SCHEDULE_LINEAR_WORK (1u << 28) // cost model: B * limbs^2 budget of a single linear step
+#define B_SCHEDULE_LINEAR_BITS 128        // inputs up to this size are cheap enough for a linear schedule
+
+enum b_schedule_kind_t {
+    B_SCHEDULE_LINEAR,     // B_i = b_start + b_jump * (i + 1)
+    B_SCHEDULE_GEOMETRIC,  // increments grow by `ratio` each step
+    B_SCHEDULE_COST_MODEL, // linear up to `knee`, geometric above it
+};
+
+/*
+ * Sequence of stage 1 bounds tried for one input. Step i is handed to the i-th
+ * GPU instance, CPU worker or serial iteration; both backends consume the same
+ * schedule, usually drawing steps from a shared ticket counter.
+ */
+struct b_schedule_t {
+    b_schedule_kind_t kind;
+    unsigned b_start;
+    unsigned b_jump;
+    unsigned b_max;
+    float ratio;
+    unsigned knee_steps; // linear steps before the geometric part of the cost model
+    long long deadline_us; // host clock (get_timestamp), 0 for none; device code ignores it
+    unsigned first_step;   // step 0 is this step of the full sequence, the ones before went to another backend
+    unsigned end_step;     // full sequence steps from here on are left out, 0 for none
+};
+
+// b_jump * (ratio^(steps) - 1) / (ratio - 1), the sum of `steps` geometric increments
+POLLARD_HOST_DEVICE inline double b_schedule_geometric_span(const b_schedule_t &schedule, unsigned steps) {
+    return schedule.b_jump * (pow((double) schedule.ratio, (double) steps) - 1.0) / (schedule.ratio - 1.0);
+}
+
+POLLARD_HOST_DEVICE inline unsigned b_schedule_geometric_steps(const b_schedule_t &schedule, double span) {
+    if (span < schedule.b_jump) return 0;
+    const double steps = log(1.0 + span * (schedule.ratio - 1.0) / schedule.b_jump) / log((double) schedule.ratio);
+    return (unsigned) (steps + 1e-9);
+}
+
+// number of steps of the full sequence whose B does not exceed b_max
+POLLARD_HOST_DEVICE inline unsigned b_schedule_full_size(const b_schedule_t &schedule) {
+    if (schedule.b_max < schedule.b_start + schedule.b_jump) return 0;
+    const unsigned range = schedule.b_max - schedule.b_start;
+
+    switch (schedule.kind) {
+        case B_SCHEDULE_GEOMETRIC:
+            return b_schedule_geometric_steps(schedule, range);
+        case B_SCHEDULE_COST_MODEL: {
+            const unsigned linear = range / schedule.b_jump;
+            if (linear <= schedule.knee_steps) return linear;
+            return schedule.knee_steps +
+                   b_schedule_geometric_steps(schedule, range - (double) schedule.knee_steps * schedule.b_jump);
+        }
+        case B_SCHEDULE_LINEAR:
+        default:
+            return range / schedule.b_jump;
+    }
+}
+
+// number of steps between first_step and end_step
+POLLARD_HOST_DEVICE inline unsigned b_schedule_size(const b_schedule_t &schedule) {
+    unsigned size = b_schedule_full_size(schedule);
+    if (schedule.end_step != 0 && schedule.end_step < size) size = schedule.end_step;
+    return size > schedule.first_step ? size - schedule.first_step : 0;
+}
+
+// B of the given step, false once the schedule is exhausted
+POLLARD_HOST_DEVICE inline bool b_schedule_at(const b_schedule_t &schedule, unsigned step, unsigned *B) {
+    if (step >= b_schedule_size(schedule)) return false;
+    step += schedule.first_step;
+
+    double b;
+    switch (schedule.kind) {
+        case B_SCHEDULE_GEOMETRIC:
+            b = schedule.b_start + b_schedule_geometric_span(schedule, step + 1);
+            break;
+        case B_SCHEDULE_COST_MODEL:
+            if (step < schedule.knee_steps) {
+                b = schedule.b_start + (double) schedule.b_jump * (step + 1);
+            } else {
+                b = schedule.b_start + (double) schedule.b_jump * schedule.knee_steps +
+                    b_schedule_geometric_span(schedule, step - schedule.knee_steps + 1);
+            }
+            break;
+        case B_SCHEDULE_LINEAR:
+        default:
+            b = schedule.b_start + (double) schedule.b_jump * (step + 1);
+            break;
+    }
+
+    *B = b < schedule.b_max ? (unsigned) b : schedule.b_max;
+    return true;
+}
+
+b_schedule_t b_schedule_make(b_schedule_kind_t kind, unsigned bits, unsigned b_start, unsigned b_jump,
+                             unsigned b_max);
+
+b_schedule_t b_schedule_for_bits(unsigned bits, unsigned b_start, unsigned b_jump, unsigned b_max);
+
+// steps [first, end) of the schedule as a schedule of their own, with the same B values
+b_schedule_t b_schedule_slice(const b_schedule_t &schedule, unsigned first, unsigned end);
+
+bool b_schedule_expired(const b_schedule_t &schedule);
+
+const char *b_schedule_name(b_schedule_kind_t kind);
+
+int b_schedule_parse(const char *name, b_schedule_kind_t *kind);
+
+#endif /* __B_SCHEDULE_H__ */
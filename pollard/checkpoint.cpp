@@ -0,0 +1,175 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+#include "checkpoint.h"
+
+static void put_u32(std::string &out, uint32_t value) {
+    for (int i = 0; i < 4; i++) out.push_back((char) ((value >> (8 * i)) & 0xFF));
+}
+
+static void put_mpz(std::string &out, mpz_t value) {
+    std::string bytes((mpz_sizeinbase(value, 2) + 7) / 8, '\0');
+    size_t count = 0;
+    mpz_export(&bytes[0], &count, 1, 1, 0, 0, value);
+    bytes.resize(count);
+    put_u32(out, (uint32_t) count);
+    out += bytes;
+}
+
+static bool get_u32(const std::string &in, size_t &pos, uint32_t *value) {
+    if (pos + 4 > in.size()) return false;
+    *value = 0;
+    for (int i = 0; i < 4; i++) *value |= (uint32_t) (unsigned char) in[pos + i] << (8 * i);
+    pos += 4;
+    return true;
+}
+
+static bool get_bytes(const std::string &in, size_t &pos, std::string *bytes) {
+    uint32_t len;
+    if (!get_u32(in, pos, &len) || pos + len > in.size()) return false;
+    bytes->assign(in, pos, len);
+    pos += len;
+    return true;
+}
+
+static std::string modulus_bytes(mpz_t n) {
+    std::string out;
+    put_mpz(out, n);
+    return out.substr(4);
+}
+
+CheckpointStore::CheckpointStore(const char *directory, long long interval_us)
+        : interval_us(interval_us), directory(directory), writer(&CheckpointStore::run, this) {
+}
+
+CheckpointStore::~CheckpointStore() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    changed.notify_all();
+    writer.join();
+}
+
+std::string CheckpointStore::path_for(mpz_t n) const {
+    // FNV-1a of the modulus, the record itself holds N to rule out collisions
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (char c : modulus_bytes(n)) {
+        hash ^= (unsigned char) c;
+        hash *= 0x100000001b3ULL;
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.p1ck", (unsigned long long) hash);
+    return directory + name;
+}
+
+int CheckpointStore::load(mpz_t n, unsigned *base, unsigned *b, mpz_t residue) {
+    const std::string path = path_for(n);
+    {
+        // a record still waiting for the writer is the most recent one
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = pending.find(path);
+        if (it != pending.end() && it->second.empty()) return -1;
+    }
+    flush();
+
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == nullptr) return -1;
+
+    std::string record;
+    char buffer[4096];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) record.append(buffer, read);
+    fclose(file);
+
+    size_t pos = 4;
+    uint32_t version, base_value, b_value;
+    std::string n_bytes, residue_bytes;
+    if (record.compare(0, 4, "P1CK") != 0 ||
+        !get_u32(record, pos, &version) || version != CHECKPOINT_VERSION ||
+        !get_bytes(record, pos, &n_bytes) ||
+        !get_u32(record, pos, &base_value) ||
+        !get_u32(record, pos, &b_value) ||
+        !get_bytes(record, pos, &residue_bytes)) {
+        fprintf(stderr, "Ignoring malformed checkpoint %s\n", path.c_str());
+        return -1;
+    }
+
+    if (n_bytes != modulus_bytes(n)) {
+        return -1; // hash collision with another modulus
+    }
+
+    *base = base_value;
+    *b = b_value;
+    mpz_import(residue, residue_bytes.size(), 1, 1, 0, 0, residue_bytes.data());
+    return 0;
+}
+
+void CheckpointStore::save(mpz_t n, unsigned base, unsigned b, mpz_t residue) {
+    std::string record("P1CK");
+    put_u32(record, CHECKPOINT_VERSION);
+    put_mpz(record, n);
+    put_u32(record, base);
+    put_u32(record, b);
+    put_mpz(record, residue);
+
+    const std::string path = path_for(n);
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        pending[path].swap(record);
+    }
+    changed.notify_all();
+}
+
+void CheckpointStore::remove(mpz_t n) {
+    const std::string path = path_for(n);
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        pending[path].clear();
+    }
+    changed.notify_all();
+}
+
+void CheckpointStore::flush() {
+    std::unique_lock<std::mutex> guard(lock);
+    changed.wait(guard, [this]() { return pending.empty() && !writing; });
+}
+
+void CheckpointStore::run() {
+    std::unique_lock<std::mutex> guard(lock);
+    while (true) {
+        changed.wait(guard, [this]() { return !pending.empty() || stopping; });
+        if (pending.empty()) return;
+
+        std::map<std::string, std::string> batch;
+        batch.swap(pending);
+        writing = true;
+        guard.unlock();
+
+        for (auto &entry : batch) {
+            if (entry.second.empty()) {
+                ::remove(entry.first.c_str());
+                continue;
+            }
+
+            // write aside and rename, a crash never leaves a torn checkpoint behind
+            const std::string tmp_path = entry.first + ".tmp";
+            FILE *file = fopen(tmp_path.c_str(), "wb");
+            if (file == nullptr ||
+                fwrite(entry.second.data(), 1, entry.second.size(), file) != entry.second.size()) {
+                fprintf(stderr, "Unable to write checkpoint: %s\n", tmp_path.c_str());
+                if (file != nullptr) fclose(file);
+                continue;
+            }
+            fclose(file);
+            if (rename(tmp_path.c_str(), entry.first.c_str()) != 0) {
+                fprintf(stderr, "Unable to store checkpoint: %s\n", entry.first.c_str());
+            }
+        }
+
+        guard.lock();
+        writing = false;
+        changed.notify_all();
+    }
+}
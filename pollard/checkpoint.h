@@ -0,0 +1,55 @@
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <gmp.h>
+
+#define CHECKPOINT_INTERVAL_US 60000000LL // default time between checkpoints of one run
+#define CHECKPOINT_VERSION 1
+
+/*
+ * Stage 1 progress of one modulus: base^E(b) mod N. Checkpoints are kept in a
+ * directory, one file per modulus, and written by a background thread so the
+ * stage 1 loop only pays for serializing the residue. A newer checkpoint of
+ * the same modulus replaces a pending one.
+ *
+ * File layout, integers little-endian:
+ *   "P1CK" | u32 version | u32 len | N (big-endian bytes) | u32 base | u32 B | u32 len | residue
+ */
+class CheckpointStore {
+public:
+    const long long interval_us;
+
+    CheckpointStore(const char *directory, long long interval_us);
+
+    ~CheckpointStore();
+
+    int load(mpz_t n, unsigned *base, unsigned *b, mpz_t residue);
+
+    void save(mpz_t n, unsigned base, unsigned b, mpz_t residue);
+
+    void remove(mpz_t n);
+
+    void flush();
+
+private:
+    const std::string directory;
+
+    std::mutex lock;
+    std::condition_variable changed;
+    std::map<std::string, std::string> pending; // file name -> serialized record, empty to delete
+    bool writing = false;
+    bool stopping = false;
+    std::thread writer;
+
+    std::string path_for(mpz_t n) const;
+
+    void run();
+};
+
+#endif /* __CHECKPOINT_H__ */
@@ -1,86 +1,558 @@
 #include <cstdio>
 #include <cmath>
 #include <cassert>
+#include <climits>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
 #include <gmp.h>
 
-void primes_power(mpz_t *e, const unsigned int *primes, const unsigned primes_num, unsigned B, mpz_t *tmp) {
-    auto prime_i = (unsigned) primes[0];
+#include "cpu_factor.h"
+#include "b_schedule.h"
+#include "width_class.h"
+#include "../common/get_timestamp.h"
+#include "../common/gmp_arena.h"
+#include "../common/job_log.h"
+#include "../common/metrics.h"
+#include "../common/numa.h"
+#include "../common/thread_pool.h"
+#include "../common/trace.h"
+
+// largest power of p not exceeding B, 1 when p > B
+static unsigned long long prime_power_below(unsigned p, unsigned B) {
+    unsigned long long power = 1;
+    while (power * p <= B) power *= p;
+    return power;
+}
+
+// product of words[from, to), halves are multiplied recursively so the large products get GMP's fast multiplication
+static void product_tree(mpz_t *e, const std::vector<unsigned long> &words, size_t from, size_t to, mpz_t *tmp) {
+    if (to - from <= CPU_EXPONENT_LEAF) {
+        mpz_set_ui(*e, 1);
+        for (size_t i = from; i < to; i++) {
+            mpz_mul_ui(*tmp, *e, words[i]);
+            mpz_swap(*e, *tmp);
+        }
+        return;
+    }
 
-    mpz_set_ui(*e, 1);
+    const size_t middle = from + (to - from) / 2;
+    mpz_t right;
+    mpz_init(right);
+    product_tree(e, words, from, middle, tmp);
+    product_tree(&right, words, middle, to, tmp);
+    mpz_mul(*tmp, *e, right);
+    mpz_swap(*e, *tmp);
+    mpz_clear(right);
+}
 
-    for (unsigned i = 0; prime_i < B; i++) {
-        unsigned power = (unsigned) (log((double) B) / log((double) prime_i));
+// e = E(b_to) / E(b_from), E(B) being the product of the largest prime powers not exceeding B
+void primes_power_range(mpz_t *e, const unsigned int *primes, const unsigned primes_num, unsigned b_from,
+                        unsigned b_to, mpz_t *tmp) {
+    TRACE_SCOPE("exponent");
+    MetricTimer timer(METRIC_EXPONENT);
 
-        mpz_mul_ui(*tmp, *e, pow(prime_i, power));
-        mpz_set(*e, *tmp);
+    // prime powers packed into words, a word is full when the next power would overflow it
+    std::vector<unsigned long> words;
+    unsigned long word = 1;
+    for (unsigned i = 0; i < primes_num && primes[i] <= b_to; i++) {
+        const unsigned p = primes[i];
+        if ((unsigned long long) p * p > b_to && p <= b_from) {
+            // exponent stays 1, skip ahead to the primes above b_from
+            const unsigned *next = std::upper_bound(primes + i, primes + primes_num, b_from);
+            i = (unsigned) (next - primes) - 1;
+            continue;
+        }
 
+        const unsigned long long power = prime_power_below(p, b_to) / prime_power_below(p, b_from);
+        if (power > 1) {
+            if (word > ULONG_MAX / power) {
+                words.push_back(word);
+                word = 1;
+            }
+            word *= (unsigned long) power;
+        }
         assert(i + 1 < primes_num);
-        prime_i = primes[i + 1];
     }
+    if (word > 1) words.push_back(word);
+
+    product_tree(e, words, 0, words.size(), tmp);
+}
+
+void primes_power(mpz_t *e, const unsigned int *primes, const unsigned primes_num, unsigned B, mpz_t *tmp) {
+    primes_power_range(e, primes, primes_num, 1, B, tmp);
+}
+
+// E(b_to) / E(b_from) from the shared cache when there is one, built into e otherwise; `held` keeps a cached one alive
+static mpz_srcptr step_exponent(ExponentCache *exponents, const unsigned *primes, const unsigned primes_num,
+                                unsigned b_from, unsigned b_to, std::shared_ptr<const exponent_range_t> &held,
+                                mpz_t *e, mpz_t *tmp) {
+    if (exponents != nullptr) {
+        held = exponents->range(b_from, b_to);
+        return held->e;
+    }
+    primes_power_range(e, primes, primes_num, b_from, b_to, tmp);
+    return *e;
 }
 
-int cpu_factorize(mpz_t n, const unsigned primes[], const unsigned primes_num, unsigned b_max,
-               unsigned b_start,
-               unsigned b_jump,
-               mpz_t *result,
-               unsigned *b_found) {
-    unsigned B = b_start;
-    const unsigned max_it = 1;
-    unsigned iteration = 0;
-    long long int globalIteration = 0;
-    mpz_t a, d, e, b, tmp, one;
+/*
+ * Stage 1 is incremental: x = base^E(B) mod n is raised to E(B_next) / E(B) at
+ * every step of the schedule, so each prime power enters the exponent once and
+ * (base, B, x) is the whole state of the run. That state is what a checkpoint
+ * stores; a later run resumes from it, or extends it past its b_max.
+ */
+int cpu_factorize(mpz_t n, const unsigned primes[], const unsigned primes_num,
+                  const b_schedule_t &schedule,
+                  mpz_t *result,
+                  unsigned *b_found,
+                  CheckpointStore *checkpoints,
+                  ExponentCache *exponents) {
+    TRACE_SCOPE("cpu_factorize");
+    unsigned base = CPU_BASE;
+    unsigned B_reached = 1; // E(1) = 1, x = base
+    unsigned step = 0;
+    int res = -1;
+    mpz_t x, d, e, tmp;
 
-    mpz_init(a);
+    mpz_init(x);
     mpz_init(d);
     mpz_init(e);
-    mpz_init(b);
     mpz_init(tmp);
-    mpz_init(one);
-    mpz_init(*result);
 
-    mpz_set_ui(a, 2);
-    mpz_set_ui(one, 1);
+    if (checkpoints != nullptr && checkpoints->load(n, &base, &B_reached, x) == 0) {
+        log_printf("Resuming from checkpoint at B: %u\n", B_reached);
+    } else {
+        mpz_set_ui(x, base);
+    }
+    long long last_checkpoint = get_timestamp();
+
+    mpz_gcd_ui(d, n, base);
+    if (mpz_cmp_ui(d, 1) > 0 && mpz_cmp(d, n) < 0) {
+        mpz_set(*result, d);
+        *b_found = B_reached;
+        log_printf("Found with B: %u\n", B_reached);
+        res = 0;
+    }
 
-    primes_power(&e, primes, primes_num, B, &tmp);
-    for (iteration = 0; B < b_max; iteration++) {
-        mpz_gcd(d, a, n);
+    unsigned B = schedule.b_start;
+    unsigned retries = 0;
+    while (res != 0 && !b_schedule_expired(schedule)) {
+        if (B > B_reached) {
+            std::shared_ptr<const exponent_range_t> held;
+            mpz_srcptr step_e = step_exponent(exponents, primes, primes_num, B_reached, B, held, &e, &tmp);
+            {
+                TRACE_SCOPE("modexp");
+                MetricTimer timer(METRIC_MODEXP);
+                mpz_powm(x, x, step_e, n); // x = x ^ (E(B) / E(B_reached)) % n
+            }
+            B_reached = B;
 
-        if (mpz_cmp(d, one) > 0) {
-            mpz_set(*result, d);
-            *b_found = B;
-            printf("Found with B: %d\n", B);
-            return 0;
-        }
+            {
+                TRACE_SCOPE("gcd");
+                MetricTimer timer(METRIC_GCD);
+                mpz_sub_ui(tmp, x, 1);
+                mpz_gcd(d, tmp, n); // d = gcd(x - 1, n)
+            }
+
+            if (mpz_cmp_ui(d, 1) > 0 && mpz_cmp(d, n) < 0) {
+                mpz_set(*result, d);
+                *b_found = B;
+                log_printf("Found with B: %u\n", B);
+                res = 0;
+                break;
+            }
 
-        mpz_powm(b, a, e, n); // b = (a ^ e) % n
-        mpz_sub_ui(tmp, b, 1);
-        mpz_set(b, tmp);
+            if (mpz_cmp(d, n) == 0) {
+                // every p - 1 divides E(B) at once, another base may still separate them
+                if (++retries > CPU_BASE_RETRIES) break;
+                mpz_set_ui(x, ++base);
+                B_reached = 1; // recomputed from scratch up to the same B
+                continue;
+            }
 
-        mpz_gcd(d, b, n); // d = gcd(b, n)
+            if (checkpoints != nullptr && get_timestamp() - last_checkpoint >= checkpoints->interval_us) {
+                checkpoints->save(n, base, B_reached, x);
+                last_checkpoint = get_timestamp();
+            }
+        }
+
+        if (!b_schedule_at(schedule, step++, &B)) break;
+    }
 
-        if (mpz_cmp(d, one) > 0 && mpz_cmp(d, n) < 0) {
-            mpz_set(*result, d);
-            *b_found = B;
-            printf("B: %d\n", B);
-            return 0;
+    if (checkpoints != nullptr) {
+        if (res == 0) {
+            checkpoints->remove(n);
+        } else if (B_reached > 1) {
+            checkpoints->save(n, base, B_reached, x); // a later run extends it to a higher B
         }
+    }
+
+    if (res != 0) {
+        log_printf("Failed after %u B steps (B reached: %u)!\n", step, B_reached);
+    }
+
+    mpz_clear(x);
+    mpz_clear(d);
+    mpz_clear(e);
+    mpz_clear(tmp);
+    return res;
+}
+
+/*
+ * Moduli sharing one stage 1 residue x modulo their product. tree[0] is the
+ * product, node k has the products of the two halves of its range as
+ * children 2k + 1 and 2k + 2, the leaves are the moduli themselves.
+ */
+struct batch_group_t {
+    std::vector<size_t> members; // indices into the batch
+    std::vector<__mpz_struct> tree;
+    mpz_t x;
+};
+
+static void product_tree_build(std::vector<__mpz_struct> &tree, size_t node, mpz_t *n,
+                               const std::vector<size_t> &members, size_t from, size_t to) {
+    if (to - from == 1) {
+        mpz_set(&tree[node], n[members[from]]);
+        return;
+    }
+    const size_t middle = from + (to - from) / 2;
+    product_tree_build(tree, 2 * node + 1, n, members, from, middle);
+    product_tree_build(tree, 2 * node + 2, n, members, middle, to);
+    mpz_mul(&tree[node], &tree[2 * node + 1], &tree[2 * node + 2]);
+}
+
+// residues[from, to) = x modulo the members under `node`, reduced down the product tree
+static void remainder_tree(const std::vector<__mpz_struct> &tree, size_t node, mpz_srcptr x, size_t from, size_t to,
+                           std::vector<__mpz_struct> &residues) {
+    if (to - from == 1) {
+        mpz_mod(&residues[from], x, &tree[node]);
+        return;
+    }
+    mpz_t r;
+    mpz_init(r);
+    mpz_mod(r, x, &tree[node]);
+    const size_t middle = from + (to - from) / 2;
+    remainder_tree(tree, 2 * node + 1, r, from, middle, residues);
+    remainder_tree(tree, 2 * node + 2, r, middle, to, residues);
+    mpz_clear(r);
+}
 
-        mpz_set(b, a);
-        mpz_add_ui(tmp, b, 1); // tmp = a+1
+// the group over `members` from now on, x reduced modulo their product (which divides the previous one)
+static void group_set_members(batch_group_t &group, mpz_t *n, std::vector<size_t> members) {
+    for (auto &node : group.tree) mpz_clear(&node);
+    group.members.swap(members);
+    group.tree.assign(group.members.empty() ? 0 : 4 * group.members.size(), __mpz_struct());
+    for (auto &node : group.tree) mpz_init(&node);
+    if (group.members.empty()) return;
+    product_tree_build(group.tree, 0, n, group.members, 0, group.members.size());
+    mpz_mod(group.x, group.x, &group.tree[0]);
+}
+
+/*
+ * Stage 1 as in cpu_factorize, the exponent of every step built once for the
+ * whole batch and raised to modulo the product of each group of moduli; the
+ * remainder tree gives every modulus its own residue for the gcd. A modulus
+ * that leaves (factored, or gcd = n) is taken out of its group's product. The
+ * ones with gcd = n are rerun alone through cpu_factorize, which tries other
+ * bases. Nothing is logged per modulus, the jobs the moduli belong to do that.
+ */
+int cpu_factorize_batch(mpz_t *n, size_t count, const unsigned primes[], const unsigned primes_num,
+                        const b_schedule_t &schedule,
+                        mpz_t *results,
+                        unsigned *b_found,
+                        ExponentCache *exponents) {
+    TRACE_SCOPE("cpu_factorize_batch");
+    std::vector<char> rerun(count, 0);
+    std::vector<size_t> open;
+    size_t widest = 0;
+    int found = 0;
+    mpz_t d, e, tmp;
+    mpz_init(d);
+    mpz_init(e);
+    mpz_init(tmp);
 
-        if ((mpz_cmp(d, n) == 0 && mpz_cmp(tmp, n) < 0)  || (iteration > max_it)) {
-            B += (globalIteration / 16 + 1) * b_jump;
-            primes_power(&e, primes, primes_num, B, &tmp);
-            iteration = 0;
-        } else if (mpz_cmp(d, one) == 0) {
-            mpz_add_ui(tmp, a, 1);
-            mpz_set(a, tmp);
+    for (size_t i = 0; i < count; i++) {
+        b_found[i] = 0;
+        widest = std::max(widest, mpz_sizeinbase(n[i], 2));
+        mpz_gcd_ui(d, n[i], CPU_BASE);
+        if (mpz_cmp_ui(d, 1) > 0 && mpz_cmp(d, n[i]) < 0) {
+            mpz_set(results[i], d);
+            b_found[i] = 1;
+            found++;
         } else {
+            open.push_back(i);
+        }
+    }
+
+    const size_t group_size = cpu_batch_group((unsigned) widest);
+    std::vector<batch_group_t> groups((open.size() + group_size - 1) / group_size);
+    for (size_t g = 0; g < groups.size(); g++) {
+        const auto first = open.begin() + g * group_size;
+        mpz_init_set_ui(groups[g].x, CPU_BASE);
+        group_set_members(groups[g], n, std::vector<size_t>(first, first + std::min(group_size, open.size() -
+                                                                                             g * group_size)));
+    }
+    std::vector<__mpz_struct> residues(std::min(group_size, open.size()));
+    for (auto &r : residues) mpz_init(&r);
+
+    unsigned B = schedule.b_start;
+    unsigned B_reached = 1;
+    unsigned step = 0;
+    size_t remaining = open.size();
+    while (remaining > 0 && !b_schedule_expired(schedule)) {
+        if (B > B_reached) {
+            std::shared_ptr<const exponent_range_t> held;
+            mpz_srcptr step_e = step_exponent(exponents, primes, primes_num, B_reached, B, held, &e, &tmp);
+            for (auto &group : groups) {
+                if (group.members.empty()) continue;
+                {
+                    TRACE_SCOPE("modexp");
+                    MetricTimer timer(METRIC_MODEXP);
+                    mpz_powm(group.x, group.x, step_e, &group.tree[0]);
+                    remainder_tree(group.tree, 0, group.x, 0, group.members.size(), residues);
+                }
+
+                std::vector<size_t> kept;
+                for (size_t j = 0; j < group.members.size(); j++) {
+                    const size_t i = group.members[j];
+                    {
+                        TRACE_SCOPE("gcd");
+                        MetricTimer timer(METRIC_GCD);
+                        mpz_sub_ui(tmp, &residues[j], 1);
+                        mpz_gcd(d, tmp, n[i]);
+                    }
+
+                    if (mpz_cmp_ui(d, 1) > 0 && mpz_cmp(d, n[i]) < 0) {
+                        mpz_set(results[i], d);
+                        b_found[i] = B;
+                        found++;
+                    } else if (mpz_cmp(d, n[i]) == 0) {
+                        rerun[i] = 1;
+                    } else {
+                        kept.push_back(i);
+                        continue;
+                    }
+                    remaining--;
+                }
+                if (kept.size() != group.members.size()) group_set_members(group, n, kept);
+            }
+            B_reached = B;
+        }
+
+        if (!b_schedule_at(schedule, step++, &B)) break;
+    }
+
+    for (auto &group : groups) {
+        group_set_members(group, n, std::vector<size_t>());
+        mpz_clear(group.x);
+    }
+    for (auto &r : residues) mpz_clear(&r);
+
+    std::string discarded; // the rerun's log is about another job's input
+    JobLogScope log_scope(discarded);
+    for (size_t i = 0; i < count; i++) {
+        if (rerun[i] && cpu_factorize(n[i], primes, primes_num, schedule, &results[i], &b_found[i], nullptr,
+                                      exponents) == 0) {
+            found++;
+        }
+    }
+
+    mpz_clear(d);
+    mpz_clear(e);
+    mpz_clear(tmp);
+    return found;
+}
+
+int cpu_factorize_parallel(mpz_t n, const unsigned primes[], const unsigned primes_num,
+                           const b_schedule_t &schedule,
+                           unsigned threads,
+                           mpz_t *result,
+                           unsigned *b_found,
+                           ExponentCache *exponents,
+                           const std::atomic<bool> *cancel) {
+    TRACE_SCOPE("cpu_factorize_parallel");
+    const size_t n_bits = mpz_sizeinbase(n, 2);
+
+    std::atomic<unsigned> work_counter(0);
+    std::atomic<bool> completed(false);
+    std::mutex found_lock;
+    unsigned found_b = 0;
+    mpz_t found; // written by a worker, so every allocation of it comes from the heap
+    {
+        GmpHeapScope heap_scope;
+        mpz_init(found);
+    }
+
+    {
+        WorkStealingPool pool(threads, numa_thread_node()); // on the node of the job and its prime table
+        for (unsigned t = 0; t < pool.size(); t++) {
+            pool.submit([&]() {
+                GmpArena arena(n_bits);
+                GmpArenaScope arena_scope(arena);
+
+                mpz_t a, d, e, b, tmp;
+                mpz_init(a);
+                mpz_init(d);
+                mpz_init(e);
+                mpz_init(b);
+                mpz_init(tmp);
+
+                unsigned B;
+                while (!completed.load(std::memory_order_relaxed) && !b_schedule_expired(schedule) &&
+                       (cancel == nullptr || !cancel->load(std::memory_order_relaxed))) {
+                    const unsigned ticket = work_counter.fetch_add(1);
+                    if (!b_schedule_at(schedule, ticket, &B)) break;
+                    mpz_set_ui(a, 2 + ticket);
+
+                    mpz_gcd(d, a, n);
+                    if (mpz_cmp_ui(d, 1) <= 0) {
+                        std::shared_ptr<const exponent_range_t> held;
+                        mpz_srcptr full_e = step_exponent(exponents, primes, primes_num, 1, B, held, &e, &tmp);
+                        {
+                            TRACE_SCOPE("modexp");
+                            MetricTimer timer(METRIC_MODEXP);
+                            mpz_powm(b, a, full_e, n); // b = (a ^ e) % n
+                        }
+                        TRACE_SCOPE("gcd");
+                        MetricTimer timer(METRIC_GCD);
+                        mpz_sub_ui(b, b, 1);
+                        mpz_gcd(d, b, n); // d = gcd(b, n)
+                    }
+
+                    if (mpz_cmp_ui(d, 1) > 0 && mpz_cmp(d, n) < 0) {
+                        std::lock_guard<std::mutex> guard(found_lock);
+                        if (!completed.exchange(true)) {
+                            GmpHeapScope heap_scope;
+                            mpz_set(found, d);
+                            found_b = B;
+                        }
+                    }
+                }
+
+                mpz_clear(a);
+                mpz_clear(d);
+                mpz_clear(e);
+                mpz_clear(b);
+                mpz_clear(tmp);
+            });
+        }
+    }
+
+    int res = -1;
+    if (completed.load()) {
+        mpz_set(*result, found);
+        *b_found = found_b;
+        log_printf("Found with B: %d (%u B values claimed)\n", found_b, work_counter.load());
+        res = 0;
+    } else if (cancel != nullptr && cancel->load()) {
+        log_printf("CPU search cancelled after %u B values\n", work_counter.load());
+    } else {
+        log_printf("Failed after %u B values!\n", b_schedule_size(schedule));
+    }
+
+    GmpHeapScope heap_scope;
+    mpz_clear(found);
+    return res;
+}
+
+CpuBatcher::CpuBatcher(const unsigned *primes, unsigned primes_num, ExponentCache *exponents,
+                       std::function<unsigned(unsigned)> queued, long long wait_us)
+        : primes(primes), primes_num(primes_num), exponents(exponents), queued(std::move(queued)), wait_us(wait_us) {
+}
+
+static bool same_schedule(const b_schedule_t &a, const b_schedule_t &b) {
+    return a.kind == b.kind && a.b_start == b.b_start && a.b_jump == b.b_jump && a.b_max == b.b_max &&
+           a.ratio == b.ratio && a.knee_steps == b.knee_steps && a.deadline_us == b.deadline_us &&
+           a.first_step == b.first_step && a.end_step == b.end_step;
+}
+
+bool CpuBatcher::accepts(mpz_t n, const b_schedule_t &schedule) const {
+    return schedule.deadline_us == 0 && cpu_batch_group((unsigned) mpz_sizeinbase(n, 2)) > 1;
+}
+
+int CpuBatcher::factorize(mpz_t n, const b_schedule_t &schedule, mpz_t *result, unsigned *b_found) {
+    TRACE_SCOPE("cpu_batch");
+    const unsigned group = cpu_batch_group((unsigned) mpz_sizeinbase(n, 2));
+    const unsigned job_class = width_class_of(n);
+
+    std::unique_lock<std::mutex> guard(lock);
+    std::shared_ptr<batch_t> batch;
+    for (auto &candidate : open) {
+        if (candidate->group == group && same_schedule(candidate->schedule, schedule)) {
+            batch = candidate;
             break;
         }
     }
+    const bool leader = batch == nullptr;
+    if (leader) {
+        batch = std::make_shared<batch_t>();
+        batch->group = group;
+        batch->schedule = schedule;
+        open.push_back(batch);
+    }
+
+    const size_t index = batch->n.size();
+    {
+        GmpHeapScope heap_scope; // read and written by the thread running the batch
+        batch->n.emplace_back();
+        mpz_init_set(&batch->n.back(), n);
+        batch->results.emplace_back();
+        mpz_init(&batch->results.back());
+    }
+    batch->b_found.push_back(0);
+    if (batch->n.size() >= group) { // full, no one else joins and the leader runs it now
+        open.erase(std::find(open.begin(), open.end(), batch));
+        changed.notify_all();
+    }
+
+    if (leader) {
+        const long long give_up = get_timestamp() + wait_us;
+        while (batch->n.size() < group && queued && queued(job_class) > 0 && get_timestamp() < give_up) {
+            changed.wait_for(guard, std::chrono::microseconds(CPU_BATCH_WAIT_US / 10));
+        }
+        const auto position = std::find(open.begin(), open.end(), batch);
+        if (position != open.end()) open.erase(position);
+        if (batch->n.size() > 1) batch_count++;
+
+        guard.unlock();
+        run(*batch);
+        guard.lock();
+        batch->done = true;
+        changed.notify_all();
+    } else {
+        changed.wait(guard, [&]() { return batch->done; });
+    }
+    guard.unlock();
+
+    const size_t size = batch->n.size();
+    int res = -1;
+    if (batch->b_found[index] != 0) {
+        mpz_set(*result, &batch->results[index]);
+        *b_found = batch->b_found[index];
+        log_printf("Found with B: %u (batch of %zu)\n", *b_found, size);
+        res = 0;
+    } else {
+        log_printf("Failed in a batch of %zu (B up to %u)!\n", size, schedule.b_max);
+    }
+
+    GmpHeapScope heap_scope;
+    mpz_clear(&batch->n[index]);
+    mpz_clear(&batch->results[index]);
+    return res;
+}
+
+void CpuBatcher::run(batch_t &batch) {
+    GmpHeapScope heap_scope; // the batch's numbers, not those of the job that happens to run it
+    cpu_factorize_batch((mpz_t *) batch.n.data(), batch.n.size(), primes, primes_num, batch.schedule,
+                        (mpz_t *) batch.results.data(), batch.b_found.data(), exponents);
+}
 
-    printf("Failed after %lld iterations!\n", globalIteration);
-    return -1;
+unsigned long long CpuBatcher::batches() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return batch_count;
 }
@@ -1,13 +1,112 @@
 #ifndef __CPU_FACTOR_H__
 #define __CPU_FACTOR_H__
 
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
 #include <gmp.h>
 
+#include "b_schedule.h"
+#include "checkpoint.h"
+#include "exponent_cache.h"
+
+#define CPU_BASE 2         // stage 1 base of the serial backend
+#define CPU_BASE_RETRIES 3 // further bases tried when gcd(x - 1, n) = n
+#define CPU_EXPONENT_LEAF 32 // words multiplied in sequence at the leaves of the exponent product tree
+#define CPU_BATCH_BITS 96          // above this one powm per modulus beats a powm modulo their product
+#define CPU_BATCH_PRODUCT_BITS 256 // size up to which moduli are multiplied into one batch modulus
+#define CPU_BATCH_WAIT_US 1000     // longest a batch waits for queued jobs of its width to join
+
+/*
+ * Moduli of `bits` raised together modulo their product, the crossover of
+ * cpu_factorize_batch: a product modulus only pays while it saves limbs over
+ * the separate moduli, 1 above CPU_BATCH_BITS.
+ */
+inline unsigned cpu_batch_group(unsigned bits) {
+    return bits == 0 || bits > CPU_BATCH_BITS ? 1 : CPU_BATCH_PRODUCT_BITS / bits;
+}
+
+// e = E(b_to) / E(b_from), E(B) being the product of the largest prime powers not exceeding B
+void primes_power_range(mpz_t *e, const unsigned int *primes, const unsigned primes_num, unsigned b_from,
+                        unsigned b_to, mpz_t *tmp);
+
+void primes_power(mpz_t *e, const unsigned int *primes, const unsigned primes_num, unsigned B, mpz_t *tmp);
+
 int cpu_factorize(mpz_t n, const unsigned int primes[], const unsigned primes_num,
-                  unsigned b_max,
-                  unsigned b_start,
-                  unsigned b_jump,
+                  const b_schedule_t &schedule,
                   mpz_t *result,
-                  unsigned *b_found);
+                  unsigned *b_found,
+                  CheckpointStore *checkpoints = nullptr,
+                  ExponentCache *exponents = nullptr);
+
+/*
+ * Stage 1 of `count` moduli on one schedule, the number of them factored:
+ * results[i] and b_found[i] as cpu_factorize sets them, b_found[i] = 0
+ * without a factor. Up to cpu_batch_group moduli share one residue modulo
+ * their product.
+ */
+int cpu_factorize_batch(mpz_t *n, size_t count, const unsigned int primes[], const unsigned primes_num,
+                        const b_schedule_t &schedule,
+                        mpz_t *results,
+                        unsigned *b_found,
+                        ExponentCache *exponents = nullptr);
+
+// `cancel` set by another thread stops the workers after their current B
+int cpu_factorize_parallel(mpz_t n, const unsigned int primes[], const unsigned primes_num,
+                           const b_schedule_t &schedule,
+                           unsigned threads,
+                           mpz_t *result,
+                           unsigned *b_found,
+                           ExponentCache *exponents = nullptr,
+                           const std::atomic<bool> *cancel = nullptr);
+
+/*
+ * Serial stage 1 calls of concurrent jobs gathered into cpu_factorize_batch.
+ * A call on a modulus narrow enough to batch opens a batch for its group size
+ * and schedule, or joins the open one. The batch runs once it holds
+ * cpu_batch_group moduli, once `queued` (the jobs of a width class waiting to
+ * run) reports none left to join, or after `wait_us`; the call that
+ * opened it runs it, the others wait for their results.
+ */
+class CpuBatcher {
+public:
+    CpuBatcher(const unsigned *primes, unsigned primes_num, ExponentCache *exponents,
+               std::function<unsigned(unsigned)> queued, long long wait_us = CPU_BATCH_WAIT_US);
+
+    // false when n is too wide to batch or the schedule has a deadline, the caller runs cpu_factorize
+    bool accepts(mpz_t n, const b_schedule_t &schedule) const;
+
+    int factorize(mpz_t n, const b_schedule_t &schedule, mpz_t *result, unsigned *b_found);
+
+    unsigned long long batches() const;
+
+private:
+    struct batch_t {
+        unsigned group;
+        b_schedule_t schedule;
+        std::vector<__mpz_struct> n; // heap copies, every caller sets up and clears its own
+        std::vector<__mpz_struct> results;
+        std::vector<unsigned> b_found;
+        bool done = false;
+    };
+
+    const unsigned *primes;
+    const unsigned primes_num;
+    ExponentCache *exponents;
+    const std::function<unsigned(unsigned)> queued;
+    const long long wait_us;
+
+    mutable std::mutex lock;
+    std::condition_variable changed;
+    std::vector<std::shared_ptr<batch_t>> open;
+    unsigned long long batch_count = 0; // batches of more than one modulus
+
+    void run(batch_t &batch);
+};
 
 #endif /* __CPU_FACTOR_H__ */
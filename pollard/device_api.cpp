@@ -0,0 +1,87 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "device_api.h"
+
+int HostDeviceApi::counted_alloc(void **ptr, size_t bytes) {
+    *ptr = malloc(bytes > 0 ? bytes : 1);
+    if (*ptr == nullptr) {
+        fprintf(stderr, "Cannot allocate %zu bytes of host device memory\n", bytes);
+        return -1;
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    allocation_count++;
+    live_count++;
+    return 0;
+}
+
+void HostDeviceApi::counted_free(void *ptr) {
+    if (ptr == nullptr) return;
+    free(ptr);
+    std::lock_guard<std::mutex> guard(lock);
+    live_count--;
+}
+
+int HostDeviceApi::device_alloc(void **ptr, size_t bytes) {
+    return counted_alloc(ptr, bytes);
+}
+
+void HostDeviceApi::device_free(void *ptr) {
+    counted_free(ptr);
+}
+
+int HostDeviceApi::pinned_alloc(void **ptr, size_t bytes) {
+    return counted_alloc(ptr, bytes);
+}
+
+void HostDeviceApi::pinned_free(void *ptr) {
+    counted_free(ptr);
+}
+
+int HostDeviceApi::mapped_alloc(void **host, void **device, size_t bytes) {
+    if (counted_alloc(host, bytes) != 0) return -1;
+    *device = *host;
+    return 0;
+}
+
+void HostDeviceApi::mapped_free(void *host) {
+    counted_free(host);
+}
+
+int HostDeviceApi::stream_create(device_stream_t *stream) {
+    std::lock_guard<std::mutex> guard(lock);
+    *stream = (device_stream_t) (size_t) ++stream_count; // only ever compared
+    allocation_count++;
+    live_count++;
+    return 0;
+}
+
+void HostDeviceApi::stream_destroy(device_stream_t) {
+    std::lock_guard<std::mutex> guard(lock);
+    live_count--;
+}
+
+int HostDeviceApi::copy_async(void *dst, const void *src, size_t bytes, device_copy_kind_t, device_stream_t) {
+    memcpy(dst, src, bytes);
+    return 0;
+}
+
+int HostDeviceApi::memset_async(void *ptr, int value, size_t bytes, device_stream_t) {
+    memset(ptr, value, bytes);
+    return 0;
+}
+
+int HostDeviceApi::stream_synchronize(device_stream_t) {
+    return 0;
+}
+
+unsigned long long HostDeviceApi::allocations() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return allocation_count;
+}
+
+unsigned long long HostDeviceApi::live() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return live_count;
+}
@@ -0,0 +1,93 @@
+#ifndef __DEVICE_API_H__
+#define __DEVICE_API_H__
+
+#include <cstddef>
+#include <mutex>
+
+typedef void *device_stream_t;
+
+enum device_copy_kind_t {
+    COPY_HOST_TO_DEVICE,
+    COPY_DEVICE_TO_HOST
+};
+
+/*
+ * The device calls a GpuContext makes. kernel.cu implements them over the
+ * CUDA runtime; every call returns 0 or -1 and reports its own error.
+ */
+class DeviceApi {
+public:
+    virtual ~DeviceApi() = default;
+
+    virtual int device_alloc(void **ptr, size_t bytes) = 0;
+
+    virtual void device_free(void *ptr) = 0;
+
+    // page-locked host memory, copies from it run asynchronously
+    virtual int pinned_alloc(void **ptr, size_t bytes) = 0;
+
+    virtual void pinned_free(void *ptr) = 0;
+
+    // host memory read and written by kernels in place, *device is its address on the device
+    virtual int mapped_alloc(void **host, void **device, size_t bytes) = 0;
+
+    virtual void mapped_free(void *host) = 0;
+
+    virtual int stream_create(device_stream_t *stream) = 0;
+
+    virtual void stream_destroy(device_stream_t stream) = 0;
+
+    virtual int copy_async(void *dst, const void *src, size_t bytes, device_copy_kind_t kind,
+                           device_stream_t stream) = 0;
+
+    virtual int memset_async(void *ptr, int value, size_t bytes, device_stream_t stream) = 0;
+
+    virtual int stream_synchronize(device_stream_t stream) = 0;
+};
+
+/*
+ * Device memory on the host heap and streams that run every operation at
+ * once: the context's buffer and stream bookkeeping without a GPU. Counts
+ * what is allocated so leaks and pool misses show up.
+ */
+class HostDeviceApi : public DeviceApi {
+public:
+    int device_alloc(void **ptr, size_t bytes) override;
+
+    void device_free(void *ptr) override;
+
+    int pinned_alloc(void **ptr, size_t bytes) override;
+
+    void pinned_free(void *ptr) override;
+
+    int mapped_alloc(void **host, void **device, size_t bytes) override;
+
+    void mapped_free(void *host) override;
+
+    int stream_create(device_stream_t *stream) override;
+
+    void stream_destroy(device_stream_t stream) override;
+
+    int copy_async(void *dst, const void *src, size_t bytes, device_copy_kind_t kind,
+                   device_stream_t stream) override;
+
+    int memset_async(void *ptr, int value, size_t bytes, device_stream_t stream) override;
+
+    int stream_synchronize(device_stream_t stream) override;
+
+    unsigned long long allocations() const; // allocation calls of any kind, streams included
+
+    unsigned long long live() const; // allocations not freed yet
+
+private:
+    mutable std::mutex lock;
+    unsigned long long allocation_count = 0;
+    unsigned long long live_count = 0;
+    unsigned stream_count = 0;
+
+    int counted_alloc(void **ptr, size_t bytes);
+
+    void counted_free(void *ptr);
+};
+
+#endif /* __DEVICE_API_H__ */
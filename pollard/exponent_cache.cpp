@@ -0,0 +1,117 @@
+#include <cstring>
+
+#include "exponent_cache.h"
+#include "cpu_factor.h"
+#include "limbs.h"
+#include "../common/gmp_arena.h"
+
+exponent_range_t::exponent_range_t() {
+    GmpHeapScope heap_scope; // cached past the job that builds it
+    mpz_init(e);
+}
+
+exponent_range_t::~exponent_range_t() {
+    mpz_clear(e);
+}
+
+ExponentCache::ExponentCache(const unsigned *primes, unsigned primes_num, size_t max_bytes)
+        : primes(primes), primes_num(primes_num), max_bytes(max_bytes) {
+}
+
+std::shared_ptr<const exponent_range_t> ExponentCache::range(unsigned b_from, unsigned b_to) {
+    const range_key_t key(b_from, b_to);
+    std::shared_ptr<exponent_range_t> entry;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto found = ranges.find(key);
+        if (found != ranges.end()) {
+            hit_count++;
+            recent.splice(recent.begin(), recent, found->second.position);
+            entry = found->second.entry;
+        } else {
+            miss_count++;
+            entry = std::make_shared<exponent_range_t>();
+            recent.push_front(key);
+            ranges[key] = range_slot_t{entry, recent.begin(), 0};
+        }
+    }
+
+    bool built_here = false;
+    std::call_once(entry->built, [&]() {
+        GmpHeapScope heap_scope;
+        mpz_t tmp;
+        mpz_init(tmp);
+        primes_power_range(&entry->e, primes, primes_num, b_from, b_to, &tmp);
+        mpz_clear(tmp);
+        built_here = true;
+    });
+
+    if (built_here) {
+        std::lock_guard<std::mutex> guard(lock);
+        auto found = ranges.find(key);
+        if (found != ranges.end() && found->second.entry == entry) {
+            found->second.bytes = mpz_size(entry->e) * sizeof(mp_limb_t);
+            bytes += found->second.bytes;
+            evict();
+        }
+    }
+    return entry;
+}
+
+// least recently used entries go first, the newest one always stays
+void ExponentCache::evict() {
+    while (bytes > max_bytes && recent.size() > 1) {
+        auto found = ranges.find(recent.back());
+        bytes -= found->second.bytes;
+        ranges.erase(found);
+        recent.pop_back();
+    }
+}
+
+std::shared_ptr<const prime_groups_t> ExponentCache::prime_groups(unsigned group_bits, unsigned b_max) {
+    std::shared_ptr<prime_groups_t> table;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        std::shared_ptr<prime_groups_t> &slot = groups[range_key_t(group_bits, b_max)];
+        if (!slot) slot = std::make_shared<prime_groups_t>();
+        table = slot;
+    }
+
+    std::call_once(table->built, [&]() {
+        GmpHeapScope heap_scope;
+        table->group_bits = group_bits;
+        table->words_per_group = group_bits * 2 / 32; // the kernel loads a full instance-sized number
+        std::vector<uint32_t> group_words(table->words_per_group);
+
+        mpz_t product, tmp;
+        mpz_init_set_ui(product, 1);
+        mpz_init(tmp);
+        unsigned first = 0;
+        for (unsigned i = 0; i < primes_num && primes[i] <= b_max; i++) {
+            mpz_mul_ui(tmp, product, primes[i]);
+            if (mpz_sizeinbase(tmp, 2) > group_bits && i > first) {
+                from_mpz(product, group_words.data(), table->words_per_group);
+                table->words.insert(table->words.end(), group_words.begin(), group_words.end());
+                table->starts.push_back(first);
+                first = i;
+                mpz_set_ui(tmp, primes[i]);
+            }
+            mpz_swap(product, tmp);
+        }
+        // the last run is left out unless it is full, the kernel multiplies the primes of a partial one itself
+        table->starts.push_back(first);
+        mpz_clear(product);
+        mpz_clear(tmp);
+    });
+    return table;
+}
+
+unsigned long long ExponentCache::hits() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return hit_count;
+}
+
+unsigned long long ExponentCache::misses() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return miss_count;
+}
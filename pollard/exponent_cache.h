@@ -0,0 +1,92 @@
+#ifndef __EXPONENT_CACHE_H__
+#define __EXPONENT_CACHE_H__
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <gmp.h>
+
+#define EXPONENT_CACHE_BYTES (256u << 20) // exponent ranges kept for reuse, entries in use outlive eviction
+
+// E(b_to) / E(b_from), immutable once built
+struct exponent_range_t {
+    mpz_t e;
+    std::once_flag built;
+
+    exponent_range_t();
+
+    ~exponent_range_t();
+};
+
+/*
+ * The prime table cut into runs of consecutive primes whose product stays
+ * below 2^group_bits, each product zero-extended to words_per_group 32-bit
+ * words. Primes above sqrt(B) enter E(B) with exponent 1, so for any B the
+ * groups between sqrt(B) and B are the same numbers; the kernel loads them
+ * instead of multiplying the primes again.
+ */
+struct prime_groups_t {
+    unsigned group_bits;
+    unsigned words_per_group;
+    std::vector<uint32_t> words;
+    std::vector<unsigned> starts; // prime index of every group's first prime, one past the last group at the end
+    std::once_flag built;
+
+    unsigned count() const {
+        return starts.empty() ? 0 : (unsigned) starts.size() - 1;
+    }
+};
+
+/*
+ * Stage 1 exponents depend on B and the prime table alone, not on the modulus
+ * or the base, so every job of a context shares them: a schedule step is
+ * built by the first job that reaches it and read by all the others. Entries
+ * are built outside the cache lock, concurrent requests for the same entry
+ * wait for the first one.
+ */
+class ExponentCache {
+public:
+    ExponentCache(const unsigned *primes, unsigned primes_num, size_t max_bytes = EXPONENT_CACHE_BYTES);
+
+    std::shared_ptr<const exponent_range_t> range(unsigned b_from, unsigned b_to);
+
+    std::shared_ptr<const prime_groups_t> prime_groups(unsigned group_bits, unsigned b_max);
+
+    unsigned long long hits() const;
+
+    unsigned long long misses() const;
+
+private:
+    typedef std::pair<unsigned, unsigned> range_key_t;
+
+    struct range_slot_t {
+        std::shared_ptr<exponent_range_t> entry;
+        std::list<range_key_t>::iterator position;
+        size_t bytes; // 0 until built
+    };
+
+    const unsigned *primes;
+    const unsigned primes_num;
+    const size_t max_bytes;
+
+    mutable std::mutex lock;
+    std::map<range_key_t, range_slot_t> ranges;
+    std::list<range_key_t> recent; // most recently used first
+    size_t bytes = 0;
+    std::map<range_key_t, std::shared_ptr<prime_groups_t>> groups; // by (group_bits, b_max)
+    unsigned long long hit_count = 0;
+    unsigned long long miss_count = 0;
+
+    void evict();
+
+    ExponentCache(const ExponentCache &) = delete;
+
+    ExponentCache &operator=(const ExponentCache &) = delete;
+};
+
+#endif /* __EXPONENT_CACHE_H__ */
@@ -0,0 +1,396 @@
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+
+#include "factor_algorithm.h"
+#include "cpu_factor.h"
+#include "kernel.h"
+#include "small_factor.h"
+#include "../common/get_timestamp.h"
+#include "../common/gmp_arena.h"
+#include "../common/job_log.h"
+#include "../common/metrics.h"
+#include "../common/trace.h"
+
+static int is_probable_prime(mpz_t n) {
+    TRACE_SCOPE("primality");
+    MetricTimer timer(METRIC_PRIMALITY);
+    return mpz_probab_prime_p(n, 50);
+}
+
+int FactorAlgorithm::factorize(mpz_t n, mpz_t max_factor, FactorList &factors) {
+    TRACE_SCOPE("factorize");
+    // all temporaries of this job live in the arena, results are stored on the heap
+    GmpArena arena(mpz_sizeinbase(n, 2));
+    GmpArenaScope arena_scope(arena);
+
+    mpz_t new_n, q, mod, zero, one, two, factor;
+
+    mpz_init(factor);
+    mpz_init(two);
+    mpz_init(q);
+    mpz_init(new_n);
+    mpz_init(zero);
+    mpz_init(one);
+    mpz_init(mod);
+    mpz_set(new_n, n);
+    mpz_set_ui(zero, 0);
+    mpz_set_ui(one, 1);
+    mpz_set_ui(two, 2);
+    unsigned int power_two = 0;
+    unsigned int b_start = B_START;
+
+    auto done = [&](int code) {
+        mpz_clear(factor);
+        mpz_clear(two);
+        mpz_clear(q);
+        mpz_clear(new_n);
+        mpz_clear(zero);
+        mpz_clear(one);
+        mpz_clear(mod);
+        return code;
+    };
+
+    const long long t_start = get_timestamp();
+    const long long deadline = budget_us > 0 ? t_start + budget_us : 0;
+    unsigned passes_left = PLAN_MAX_PASSES;
+    fflush(stdout);
+
+    while (mpz_cdiv_q_ui(q, new_n, 2) == 0) {
+        mpz_set(new_n, q);
+        power_two++;
+    }
+
+    if (power_two > 0) {
+        factors.add(two, power_two);
+    }
+
+    if (factor_db != nullptr) {
+        std::vector<std::string> known;
+        factor_db->known_divisors(new_n, known);
+        for (auto &prime : known) {
+            mpz_set_str(factor, prime.c_str(), 16);
+            unsigned int power = 0;
+            while (mpz_divisible_p(new_n, factor)) {
+                mpz_divexact(new_n, new_n, factor);
+                power++;
+            }
+            log_printf("Known factor from the factor db: 0x%s ^ %u\n", prime.c_str(), power);
+            factors.add(factor, power);
+        }
+        if (!known.empty() && mpz_cmp(new_n, one) == 0) {
+            log_printf("All factors found!\n");
+        }
+    }
+
+    int b_jump = B_JUMP;
+
+    log_printf("---------\n");
+
+    while (mpz_cmp(new_n, one) > 0) {
+        if (is_probable_prime(new_n) != 0) {
+            log_printf("Input is prime!\n");
+            factors.add(new_n, 1);
+            return done(0);
+        }
+
+        if (deadline != 0 && get_timestamp() >= deadline) {
+            log_gmp_printf("Deadline reached, unfactored cofactor 0x%Zx\n", new_n);
+            return done(-1);
+        }
+
+        log_gmp_printf("Sub-factoring 0x%Zx\n", new_n);
+        fflush(stdout);
+
+        const long long start_single = get_timestamp();
+        unsigned b_found = 0;
+        int returnVal;
+        if (mpz_sizeinbase(new_n, 2) <= SMALL_FACTOR_BITS) { // small cofactor, split it on native words
+            TRACE_SCOPE("small_factorize");
+            returnVal = small_factorize(new_n, &factor);
+        } else {
+            const auto bits = (unsigned) mpz_sizeinbase(new_n, 2);
+            b_schedule_t schedule = fixed_schedule
+                                    ? b_schedule_make(schedule_kind, bits, b_start, b_jump, B_MAX)
+                                    : b_schedule_for_bits(bits, b_start, b_jump, B_MAX);
+            if (cost_model != nullptr && deadline != 0) {
+                const factor_plan_t plan = plan_for_deadline(*cost_model, schedule, bits, plan_workers,
+                                                             deadline - get_timestamp(), incremental());
+                log_printf("Plan: B1 %u, %u pass(es), expected %lld us per pass, P(success) %.3f\n",
+                           plan.b1, plan.passes, plan.expected_us, plan.success);
+                schedule.b_max = plan.b1;
+                schedule.deadline_us = deadline;
+                if (b_jump == B_JUMP) passes_left = plan.passes;
+            }
+            TRACE_SCOPE("b_search");
+            returnVal = factorize_single(new_n, schedule, &factor, &b_found);
+        }
+        if (returnVal != 0) {
+            if (deadline != 0 && get_timestamp() >= deadline) {
+                log_gmp_printf("Deadline reached, unfactored cofactor 0x%Zx\n", new_n);
+            }
+            return done(returnVal == GPU_DEVICE_ERROR ? GPU_DEVICE_ERROR : -1);
+        }
+        const long long elapsed_us_single = get_timestamp() - start_single;
+
+        if (is_probable_prime(factor) == 0) {
+            b_jump = b_jump / 2;
+            if (b_jump < 2 || --passes_left == 0) {
+                return done(-1);
+            }
+            continue;
+        } else {
+            b_jump = B_JUMP;
+        }
+
+        log_gmp_printf("Single factor computed in %ld.%06ld s: 0x%Zx", (long) (elapsed_us_single / 1000000),
+                       (long) (elapsed_us_single % 1000000), factor);
+
+        unsigned int power = 0;
+        {
+            TRACE_SCOPE("divide");
+            do {
+                mpz_cdiv_qr(q, mod, new_n, factor);
+                if (mpz_cmp(mod, zero) == 0) {
+                    power++;
+                    mpz_set(new_n, q);
+                } else {
+                    break;
+                }
+            } while (true);
+        }
+
+        if (power > 0) {
+            log_printf(" - correct\n");
+            metrics_factor_found(b_found);
+        } else {
+            log_printf(" - incorrect!\n");
+            return done(-1);
+        }
+
+        factors.add(factor, power);
+
+        if (mpz_cmp(new_n, one) == 0) {
+            log_printf("All factors found!\n");
+            break;
+        } else if (is_probable_prime(new_n) != 0) { // new_n is prime
+            log_printf("Quotient is prime!\n");
+            factors.add(new_n, 1);
+            break;
+        } else if (mpz_cmp(factor, max_factor) >= 0) { // factor is greater than required
+            log_printf("Found all factors of required size!\n");
+            break;
+        }
+    }
+
+    const long long elapsed_us = get_timestamp() - t_start;
+    log_printf("---------\n");
+    log_printf("Factorization computed in %ld.%06ld s: ", (long) (elapsed_us / 1000000), (long) (elapsed_us % 1000000));
+
+    return done(0);
+}
+
+void FactorAlgorithm::replicate_primes(const unsigned *primes, unsigned primes_num) {
+    if (!numa || numa_node_count() < 2) return;
+    prime_replicas.reset(new NumaReplicas(primes, primes_num * sizeof(primes[0])));
+}
+
+const unsigned *FactorAlgorithm::local_primes(const unsigned *primes) const {
+    return prime_replicas != nullptr ? (const unsigned *) prime_replicas->local() : primes;
+}
+
+int CPUFactorAlgorithm::factorize_single(mpz_t n,
+                                         const b_schedule_t &schedule,
+                                         mpz_t *result,
+                                         unsigned *b_found) {
+    const unsigned *primes = local_primes(dev_primes);
+    if (threads > 1 && checkpoints == nullptr) {
+        return cpu_factorize_parallel(n, primes, primes_num_p, schedule, threads, result, b_found, exponents.get());
+    }
+    if (batcher != nullptr && checkpoints == nullptr && batcher->accepts(n, schedule)) {
+        return batcher->factorize(n, schedule, result, b_found);
+    }
+    return cpu_factorize(n, primes, primes_num_p, schedule, result, b_found, checkpoints, exponents.get());
+}
+
+int CPUFactorAlgorithm::initialize(const unsigned int *primes, const unsigned int primes_num) {
+    dev_primes = primes;
+    primes_num_p = primes_num;
+    exponents.reset(new ExponentCache(primes, primes_num));
+    replicate_primes(primes, primes_num);
+    if (queued_jobs) batcher.reset(new CpuBatcher(primes, primes_num, exponents.get(), queued_jobs));
+    return 0;
+}
+
+int CPUFactorAlgorithm::clean() {
+    batcher.reset();
+    return 0;
+}
+
+int HostKernelFactorAlgorithm::factorize_single(mpz_t n,
+                                                const b_schedule_t &schedule,
+                                                mpz_t *result,
+                                                unsigned *b_found) {
+    return kernel->factorize(n, schedule, result, b_found, exponents.get(), local_primes(nullptr));
+}
+
+int HostKernelFactorAlgorithm::initialize(const unsigned int *primes, const unsigned int primes_num) {
+    exponents.reset(new ExponentCache(primes, primes_num));
+    kernel.reset(new HostKernel(primes, threads));
+    replicate_primes(primes, primes_num);
+    return 0;
+}
+
+int HostKernelFactorAlgorithm::clean() {
+    kernel.reset();
+    return 0;
+}
+
+// gpu_factorize cancelled at the schedule's deadline, which then counts as a failure like on the CPU
+static int gpu_factorize_timed(const gpu_backend_t &device, GpuContext &context, GpuDeadlines *deadlines, mpz_t n,
+                               const b_schedule_t &schedule, mpz_t *result, unsigned *b_found,
+                               ExponentCache *exponents, GpuCancel &cancel) {
+    const bool timed = deadlines != nullptr && schedule.deadline_us != 0;
+    if (timed) deadlines->arm(&cancel, schedule.deadline_us);
+    int res = device.search(context, n, schedule, result, b_found, exponents, &cancel);
+    if (timed) deadlines->disarm(&cancel);
+
+    if (res == 0 && *b_found == 0 && b_schedule_expired(schedule)) {
+        log_printf("GPU search stopped at the deadline\n");
+        res = -1;
+    }
+    return res;
+}
+
+int GPUFactorAlgorithm::factorize_single(mpz_t n,
+                                         const b_schedule_t &schedule,
+                                         mpz_t *result,
+                                         unsigned *b_found) {
+    SubmissionSlot slot(device_queue); // host work of other jobs overlaps, launches are queued
+    GpuCancel cancel;
+    return gpu_factorize_timed(device, *context, deadlines.get(), n, schedule, result, b_found, exponents.get(),
+                               cancel);
+}
+
+int GPUFactorAlgorithm::initialize(const unsigned int *primes, const unsigned int primes_num) {
+    exponents.reset(new ExponentCache(primes, primes_num)); // host table, groups are uploaded per width class
+    context.reset(device.create(primes, primes_num));
+    if (context == nullptr) {
+        return -1;
+    }
+    deadlines.reset(new GpuDeadlines);
+
+    return 0;
+}
+
+int GPUFactorAlgorithm::clean() {
+    deadlines.reset();
+    context.reset();
+    return 0;
+}
+
+int HybridFactorAlgorithm::factorize_single(mpz_t n,
+                                            const b_schedule_t &schedule,
+                                            mpz_t *result,
+                                            unsigned *b_found) {
+    // B grows with the step, the CPU takes the steps up to cpu_b_max
+    const unsigned steps = b_schedule_size(schedule);
+    unsigned cpu_steps = 0, B;
+    while (cpu_steps < steps && b_schedule_at(schedule, cpu_steps, &B) && B <= cpu_b_max) cpu_steps++;
+
+    const unsigned *primes = local_primes(dev_primes);
+    if (context == nullptr || cpu_steps == steps) {
+        return cpu_factorize_parallel(n, primes, primes_num_p, schedule, threads, result, b_found, exponents.get());
+    }
+    if (cpu_steps == 0) {
+        SubmissionSlot slot(device_queue);
+        GpuCancel cancel;
+        return gpu_factorize_timed(device, *context, deadlines.get(), n, schedule, result, b_found, exponents.get(),
+                                   cancel);
+    }
+
+    const b_schedule_t cpu_part = b_schedule_slice(schedule, 0, cpu_steps);
+    const b_schedule_t gpu_part = b_schedule_slice(schedule, cpu_steps, steps);
+    b_schedule_at(schedule, cpu_steps - 1, &B);
+    log_printf("B up to %u on %u CPU worker(s), %u steps above on the GPU\n", B, threads, steps - cpu_steps);
+
+    std::atomic<bool> gpu_found(false);
+    GpuCancel gpu_cancel;
+    std::string gpu_log; // printed after the CPU part, the job log belongs to this thread
+    unsigned gpu_b = 0;
+    int gpu_res = -1;
+    mpz_t gpu_factor;
+    {
+        GmpHeapScope heap_scope; // written by the launching thread, outside this job's arena
+        mpz_init(gpu_factor);
+    }
+
+    std::mutex launch_lock;
+    std::condition_variable launch_finished;
+    bool launched = false;
+    launchers->submit([&]() {
+        {
+            JobLogScope log_scope(gpu_log);
+            SubmissionSlot slot(device_queue);
+            // a launch still queued when the CPU side found the factor is skipped
+            if (!gpu_cancel.cancelled()) {
+                gpu_res = gpu_factorize_timed(device, *context, deadlines.get(), n, gpu_part, &gpu_factor, &gpu_b,
+                                              exponents.get(), gpu_cancel);
+            }
+            if (gpu_res == 0 && gpu_b != 0) gpu_found = true;
+        }
+        std::lock_guard<std::mutex> guard(launch_lock);
+        launched = true;
+        launch_finished.notify_one();
+    });
+    const int cpu_res = cpu_factorize_parallel(n, primes, primes_num_p, cpu_part, threads, result, b_found,
+                                               exponents.get(), &gpu_found);
+    if (cpu_res == 0) gpu_cancel.cancel();
+    {
+        std::unique_lock<std::mutex> guard(launch_lock);
+        launch_finished.wait(guard, [&]() { return launched; });
+    }
+    log_printf("%s", gpu_log.c_str());
+
+    int res = 0;
+    if (cpu_res == 0) {
+        // the CPU factor is in result already
+    } else if (gpu_found) {
+        mpz_set(*result, gpu_factor);
+        *b_found = gpu_b;
+    } else if (gpu_res == 0) {
+        mpz_set_ui(*result, 0); // no factor on either side, a finer schedule is tried as with the GPU alone
+        *b_found = 0;
+    } else {
+        res = gpu_res == GPU_DEVICE_ERROR ? GPU_DEVICE_ERROR : -1;
+    }
+
+    GmpHeapScope heap_scope;
+    mpz_clear(gpu_factor);
+    return res;
+}
+
+int HybridFactorAlgorithm::initialize(const unsigned int *primes, const unsigned int primes_num) {
+    dev_primes = primes;
+    primes_num_p = primes_num;
+    exponents.reset(new ExponentCache(primes, primes_num));
+    replicate_primes(primes, primes_num);
+    context.reset(device.create(primes, primes_num));
+    if (context == nullptr) {
+        fprintf(stderr, "No usable GPU, the hybrid backend searches on the CPU only\n");
+    } else {
+        deadlines.reset(new GpuDeadlines);
+        launchers.reset(new WorkStealingPool(DEVICE_QUEUE_DEPTH));
+    }
+    return 0;
+}
+
+int HybridFactorAlgorithm::clean() {
+    launchers.reset();
+    deadlines.reset();
+    context.reset();
+    return 0;
+}
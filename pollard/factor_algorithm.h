@@ -0,0 +1,152 @@
+#ifndef __FACTOR_ALGORITHM_H__
+#define __FACTOR_ALGORITHM_H__
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <gmp.h>
+
+#include "b_schedule.h"
+#include "checkpoint.h"
+#include "cpu_factor.h"
+#include "exponent_cache.h"
+#include "gpu_context.h"
+#include "host_kernel.h"
+#include "kernel.h"
+#include "planner.h"
+#include "../common/factor_db.h"
+#include "../common/factor_list.h"
+#include "../common/numa.h"
+#include "../common/submission_queue.h"
+#include "../common/thread_pool.h"
+
+#define B_MAX 33554432 // 2^25
+#define B_JUMP 2048
+#define B_START 2
+#define DEVICE_QUEUE_DEPTH GPU_STREAMS // launches in flight on the shared device, one per stream
+#define HYBRID_CPU_B 65536 // the hybrid backend runs the schedule steps up to this B on CPU workers
+
+class FactorAlgorithm {
+public:
+    bool fixed_schedule = false; // otherwise the schedule is picked per input size
+    b_schedule_kind_t schedule_kind = B_SCHEDULE_LINEAR;
+    const cost_model_t *cost_model = nullptr; // B1 is planned against budget_us when set
+    long long budget_us = 0;
+    unsigned plan_workers = 1;
+    FactorDb *factor_db = nullptr; // primes of earlier results are divided out before any search
+    std::unique_ptr<ExponentCache> exponents; // stage 1 exponents shared by all jobs, set up by initialize
+    bool numa = false; // host backends copy the prime table to every NUMA node
+    std::unique_ptr<NumaReplicas> prime_replicas;
+
+    virtual ~FactorAlgorithm() = default;
+
+    virtual int factorize_single(mpz_t n,
+                                 const b_schedule_t &schedule,
+                                 mpz_t *result,
+                                 unsigned *b_found) = 0;
+
+    virtual int initialize(const unsigned primes[], const unsigned primes_num) = 0;
+
+    // stage 1 extends one residue across the schedule instead of starting over at every B
+    virtual bool incremental() const {
+        return false;
+    }
+
+    virtual int clean() = 0;
+
+    int factorize(mpz_t n, mpz_t max_factor, FactorList &factors);
+
+    // with `numa` on a multi-node machine, one copy of the table per node
+    void replicate_primes(const unsigned *primes, unsigned primes_num);
+
+    // the copy of the calling thread's node, `primes` itself without copies
+    const unsigned *local_primes(const unsigned *primes) const;
+};
+
+class CPUFactorAlgorithm : public FactorAlgorithm {
+public:
+    const unsigned *dev_primes = nullptr;
+    unsigned int primes_num_p = 0;
+    unsigned threads = 1; // workers per input pulling B from the shared work queue
+    CheckpointStore *checkpoints = nullptr; // resumable runs take the serial stage 1
+    std::function<unsigned(unsigned)> queued_jobs; // jobs of a width class waiting, set when several run at once
+    std::unique_ptr<CpuBatcher> batcher; // serial stage 1 of narrow inputs, set up with queued_jobs
+
+    int factorize_single(mpz_t n,
+                         const b_schedule_t &schedule,
+                         mpz_t *result,
+                         unsigned *b_found) override;
+
+    bool incremental() const override {
+        return threads <= 1 || checkpoints != nullptr;
+    }
+
+    int initialize(const unsigned int *primes, const unsigned int primes_num) override;
+
+    int clean() override;
+};
+
+// the GPU kernel's search on host workers, for nodes without a device
+class HostKernelFactorAlgorithm : public FactorAlgorithm {
+public:
+    unsigned threads = 1; // persistent kernel instances per input
+    std::unique_ptr<HostKernel> kernel;
+
+    int factorize_single(mpz_t n,
+                         const b_schedule_t &schedule,
+                         mpz_t *result,
+                         unsigned *b_found) override;
+
+    int initialize(const unsigned int *primes, const unsigned int primes_num) override;
+
+    int clean() override;
+};
+
+class GPUFactorAlgorithm : public FactorAlgorithm {
+public:
+    gpu_backend_t device = {gpu_context_create, gpu_factorize};
+    std::unique_ptr<GpuContext> context; // prime table, streams and buffers shared by all launches
+    std::unique_ptr<GpuDeadlines> deadlines; // stops launches at the deadline of their schedule
+    SubmissionQueue device_queue{DEVICE_QUEUE_DEPTH};
+
+    int factorize_single(mpz_t n,
+                         const b_schedule_t &schedule,
+                         mpz_t *result,
+                         unsigned *b_found) override;
+
+    int initialize(const unsigned int *primes, const unsigned int primes_num) override;
+
+    int clean() override;
+};
+
+/*
+ * Both sides on every input: CPU workers take the schedule steps up to
+ * cpu_b_max, cheap and the likeliest to finish first, while the GPU runs
+ * the steps above. The first factor found stops the other side. Without a
+ * device the whole schedule runs on the CPU workers. Launches are made by
+ * DEVICE_QUEUE_DEPTH launcher threads kept for the backend's lifetime.
+ */
+class HybridFactorAlgorithm : public FactorAlgorithm {
+public:
+    const unsigned *dev_primes = nullptr;
+    unsigned int primes_num_p = 0;
+    unsigned threads = 1; // CPU workers per input
+    unsigned cpu_b_max = HYBRID_CPU_B;
+    gpu_backend_t device = {gpu_context_create, gpu_factorize};
+    std::unique_ptr<GpuContext> context; // nullptr when there is no device
+    std::unique_ptr<GpuDeadlines> deadlines;
+    SubmissionQueue device_queue{DEVICE_QUEUE_DEPTH};
+    std::unique_ptr<WorkStealingPool> launchers; // set up with the device
+
+    int factorize_single(mpz_t n,
+                         const b_schedule_t &schedule,
+                         mpz_t *result,
+                         unsigned *b_found) override;
+
+    int initialize(const unsigned int *primes, const unsigned int primes_num) override;
+
+    int clean() override;
+};
+
+#endif /* __FACTOR_ALGORITHM_H__ */
@@ -0,0 +1,93 @@
+#include <cstdio>
+
+#include "factor_job.h"
+#include "../common/get_timestamp.h"
+#include "../common/job_log.h"
+
+FactorJob::FactorJob(const char *input, bool minus_one) : input(input), minus_one(minus_one) {
+    mpz_init(n);
+    mpz_init(max_factor);
+}
+
+FactorJob::~FactorJob() {
+    mpz_clear(n);
+    mpz_clear(max_factor);
+}
+
+bool FactorJob::lookup(FactorDb *db) {
+    JobLogScope log_scope(log);
+    begin();
+
+    if (!db->lookup(n, factors)) {
+        log.clear();
+        return false;
+    }
+
+    log_printf("---------\n");
+    log_printf("Factorization found in the factor db: ");
+    finish(0);
+    return true;
+}
+
+void FactorJob::run(FactorAlgorithm *alg, FactorDb *db) {
+    JobLogScope log_scope(log);
+    begin();
+
+    int resCode = alg->factorize(n, max_factor, factors);
+    device_error = resCode == GPU_DEVICE_ERROR;
+    if (db != nullptr) {
+        db->record(n, factors);
+    }
+    finish(resCode);
+}
+
+// the factors found multiply back to n
+bool FactorJob::complete() {
+    if (factors.empty()) return false;
+
+    mpz_t product;
+    mpz_init(product);
+    factors.product(product);
+    const bool equal = mpz_cmp(product, n) == 0;
+    mpz_clear(product);
+    return equal;
+}
+
+void FactorJob::begin() {
+    log_printf("\n<----------------------------------->\n");
+    print_timestamp();
+    mpz_set_str(n, input, 16);
+
+    if (minus_one) {
+        mpz_sub_ui(n, n, 1);
+    }
+
+    // a factor of half the input's size ends the search
+    const size_t bits = mpz_sizeinbase(n, 2);
+    mpz_set_ui(max_factor, 0);
+    mpz_setbit(max_factor, bits / 2 > MAX_FACTOR_MIN_BITS ? bits / 2 - 1 : MAX_FACTOR_MIN_BITS - 1);
+
+    log_printf("Factoring 0x%s\n", input);
+}
+
+void FactorJob::finish(int resCode) {
+    if (resCode != 0 && factors.empty()) {
+        fprintf(stderr, "Failed to factorize 0x%s: %d\n", input, resCode);
+        return;
+    } else if (resCode != 0) {
+        log_printf("Only partial factorization found!\n");
+    }
+
+    for (size_t i = 0; i < factors.size(); ++i) {
+        log_gmp_printf("0x%Zx ^ %u, ", factors.prime(i), factors.power(i));
+    }
+
+    if (factors.empty()) {
+        log_printf("Factors not found!\n");
+    } else {
+        factored = true;
+        log_printf("\n");
+    }
+
+    print_timestamp();
+}
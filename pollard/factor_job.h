@@ -0,0 +1,45 @@
+#ifndef __FACTOR_JOB_H__
+#define __FACTOR_JOB_H__
+
+#include <string>
+
+#include <gmp.h>
+
+#include "factor_algorithm.h"
+#include "../common/factor_db.h"
+#include "../common/factor_list.h"
+
+#define MAX_FACTOR_MIN_BITS 64 // max_factor is 2^(bits / 2 - 1) of the input, never below 2^63
+
+// state of one input number, owned by the worker that factors it
+struct FactorJob {
+    const char *input;
+    bool minus_one;
+    mpz_t n, max_factor;
+    FactorList factors;
+    std::string log;
+    bool factored = false;
+    bool device_error = false; // the search stopped on an error the device reported
+
+    FactorJob(const char *input, bool minus_one);
+
+    ~FactorJob();
+
+    // answers the job from the factor db alone, no prime table or device needed
+    bool lookup(FactorDb *db);
+
+    void run(FactorAlgorithm *alg, FactorDb *db);
+
+    bool complete();
+
+private:
+    void begin();
+
+    void finish(int resCode);
+
+    FactorJob(const FactorJob &) = delete;
+
+    FactorJob &operator=(const FactorJob &) = delete;
+};
+
+#endif /* __FACTOR_JOB_H__ */
@@ -0,0 +1,244 @@
+#include <cstdio>
+#include <cstring>
+
+#include "gpu_context.h"
+
+GpuContext::GpuContext(DeviceApi &api, size_t report_bytes) : api(api), report_bytes(report_bytes) {
+}
+
+int GpuContext::initialize() {
+    for (unsigned i = 0; i < GPU_STREAMS; i++) {
+        gpu_stream_slot_t slot = {};
+        void *staging = nullptr, *completed = nullptr, *report = nullptr;
+        if (api.stream_create(&slot.stream) != 0) return -1;
+        slots.push_back(slot); // freed by the destructor from here on
+        gpu_stream_slot_t &owned = slots.back();
+        if (api.pinned_alloc(&staging, GPU_STAGING_BYTES) != 0) return -1;
+        owned.staging = (char *) staging;
+        if (api.mapped_alloc(&completed, (void **) &owned.completed_device, sizeof(bool)) != 0) return -1;
+        owned.completed = (volatile bool *) completed;
+        *owned.completed = false;
+        if (api.device_alloc((void **) &owned.work_counter, sizeof(unsigned)) != 0) return -1;
+        if (report_bytes > 0) {
+            if (api.mapped_alloc(&report, &owned.report_device, report_bytes) != 0) return -1;
+            owned.report = report;
+        }
+        leased.push_back(false);
+    }
+    return 0;
+}
+
+GpuContext::~GpuContext() {
+    for (auto &slot : slots) {
+        api.stream_synchronize(slot.stream);
+    }
+    for (auto &buffer : buffer_class) {
+        api.device_free(buffer.first);
+    }
+    for (auto &entry : groups) {
+        if (entry.second.words != nullptr) api.device_free((void *) entry.second.words);
+        if (entry.second.starts != nullptr) api.device_free((void *) entry.second.starts);
+    }
+    if (device_primes != nullptr) api.device_free(device_primes);
+    for (auto &slot : slots) {
+        if (slot.staging != nullptr) api.pinned_free(slot.staging);
+        if (slot.completed != nullptr) api.mapped_free((void *) slot.completed);
+        if (slot.work_counter != nullptr) api.device_free(slot.work_counter);
+        if (slot.report != nullptr) api.mapped_free(slot.report);
+        api.stream_destroy(slot.stream);
+    }
+}
+
+static size_t size_class(size_t bytes) {
+    size_t size = GPU_POOL_MIN_BYTES;
+    while (size < bytes) size *= 2;
+    return size;
+}
+
+void *GpuContext::acquire(size_t bytes) {
+    const size_t size = size_class(bytes);
+    {
+        std::lock_guard<std::mutex> guard(pool_lock);
+        auto found = free_buffers.find(size);
+        if (found != free_buffers.end() && !found->second.empty()) {
+            void *buffer = found->second.back();
+            found->second.pop_back();
+            return buffer;
+        }
+    }
+
+    void *buffer = nullptr;
+    if (api.device_alloc(&buffer, size) != 0) return nullptr;
+    std::lock_guard<std::mutex> guard(pool_lock);
+    buffer_class[buffer] = size;
+    return buffer;
+}
+
+void GpuContext::release(void *buffer) {
+    if (buffer == nullptr) return;
+    std::lock_guard<std::mutex> guard(pool_lock);
+    free_buffers[buffer_class.at(buffer)].push_back(buffer);
+}
+
+gpu_stream_slot_t *GpuContext::lease() {
+    std::unique_lock<std::mutex> guard(slots_lock);
+    unsigned index = 0;
+    slot_free.wait(guard, [this, &index]() {
+        for (index = 0; index < leased.size(); index++) {
+            if (!leased[index]) return true;
+        }
+        return false;
+    });
+    leased[index] = true;
+    return &slots[index];
+}
+
+void GpuContext::give_back(gpu_stream_slot_t *slot) {
+    {
+        std::lock_guard<std::mutex> guard(slots_lock);
+        leased[slot - slots.data()] = false;
+    }
+    slot_free.notify_one();
+}
+
+int GpuContext::upload(void *device, const void *host, size_t bytes, gpu_stream_slot_t &slot) {
+    const size_t half = GPU_STAGING_BYTES / 2;
+    unsigned which = 0;
+    for (size_t offset = 0; offset < bytes; offset += half, which ^= 1) {
+        const size_t chunk = bytes - offset < half ? bytes - offset : half;
+        char *staging = slot.staging + which * half;
+        memcpy(staging, (const char *) host + offset, chunk); // the other half is still being copied
+        if (api.stream_synchronize(slot.stream) != 0 ||
+            api.copy_async((char *) device + offset, staging, chunk, COPY_HOST_TO_DEVICE, slot.stream) != 0) {
+            return -1;
+        }
+    }
+    return api.stream_synchronize(slot.stream);
+}
+
+int GpuContext::load_primes(const unsigned *table, unsigned primes_num) {
+    const size_t bytes = primes_num * sizeof(table[0]);
+    if (api.device_alloc((void **) &device_primes, bytes) != 0) {
+        fprintf(stderr, "Unable to allocate device prime table!\n");
+        return -1;
+    }
+    GpuStreamLease lease(*this);
+    if (upload(device_primes, table, bytes, lease.slot) != 0) {
+        fprintf(stderr, "Unable to copy the prime table to the device!\n");
+        return -1;
+    }
+    return 0;
+}
+
+prime_groups_view_t GpuContext::prime_groups(ExponentCache *exponents, unsigned group_bits, unsigned b_max) {
+    prime_groups_view_t view = {nullptr, nullptr, 0};
+    if (exponents == nullptr) return view;
+
+    unsigned cover = 1; // every B_max up to a power of two shares one table
+    while (cover < b_max && cover < 0x80000000u) cover *= 2;
+
+    std::lock_guard<std::mutex> guard(groups_lock);
+    auto found = groups.find(std::make_pair(group_bits, cover));
+    if (found != groups.end()) return found->second;
+
+    auto table = exponents->prime_groups(group_bits, cover);
+    if (table->count() > 0) {
+        uint32_t *words = nullptr;
+        unsigned *starts = nullptr;
+        const size_t words_bytes = table->words.size() * sizeof(uint32_t);
+        const size_t starts_bytes = table->starts.size() * sizeof(unsigned);
+        GpuStreamLease lease(*this);
+        if (api.device_alloc((void **) &words, words_bytes) != 0 ||
+            api.device_alloc((void **) &starts, starts_bytes) != 0 ||
+            upload(words, table->words.data(), words_bytes, lease.slot) != 0 ||
+            upload(starts, table->starts.data(), starts_bytes, lease.slot) != 0) {
+            fprintf(stderr, "Cannot upload prime groups, multiplying primes on the device\n");
+            if (words != nullptr) api.device_free(words);
+            if (starts != nullptr) api.device_free(starts);
+            return view;
+        }
+        view.words = words;
+        view.starts = starts;
+        view.count = table->count();
+    }
+    groups[std::make_pair(group_bits, cover)] = view;
+    return view;
+}
+
+void GpuCancel::attach(volatile bool *completed) {
+    std::lock_guard<std::mutex> guard(lock);
+    flag = completed;
+    if (requested) *flag = true;
+}
+
+void GpuCancel::detach() {
+    std::lock_guard<std::mutex> guard(lock);
+    flag = nullptr;
+}
+
+void GpuCancel::cancel() {
+    std::lock_guard<std::mutex> guard(lock);
+    requested = true;
+    if (flag != nullptr) *flag = true;
+}
+
+bool GpuCancel::cancelled() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return requested;
+}
+
+GpuDeadlines::GpuDeadlines(long long (*clock)()) : clock(clock), timer(&GpuDeadlines::run, this) {
+}
+
+GpuDeadlines::~GpuDeadlines() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    changed.notify_all();
+    timer.join();
+}
+
+void GpuDeadlines::arm(GpuCancel *cancel, long long deadline_us) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        armed.emplace(deadline_us, cancel);
+    }
+    changed.notify_all();
+}
+
+void GpuDeadlines::disarm(GpuCancel *cancel) {
+    std::lock_guard<std::mutex> guard(lock);
+    for (auto it = armed.begin(); it != armed.end(); ++it) {
+        if (it->second == cancel) {
+            armed.erase(it);
+            return;
+        }
+    }
+}
+
+void GpuDeadlines::expire() {
+    std::lock_guard<std::mutex> guard(lock);
+    expire_locked(clock());
+}
+
+// lock held; cancelled under the lock, so a disarmed cancel is never touched again
+void GpuDeadlines::expire_locked(long long now) {
+    while (!armed.empty() && armed.begin()->first <= now) {
+        armed.begin()->second->cancel();
+        armed.erase(armed.begin());
+    }
+}
+
+void GpuDeadlines::run() {
+    std::unique_lock<std::mutex> guard(lock);
+    while (!stopping) {
+        if (armed.empty()) {
+            changed.wait(guard);
+            continue;
+        }
+        const long long now = clock();
+        expire_locked(now);
+        if (!armed.empty()) changed.wait_for(guard, std::chrono::microseconds(armed.begin()->first - now));
+    }
+}
@@ -0,0 +1,174 @@
+#ifndef __GPU_CONTEXT_H__
+#define __GPU_CONTEXT_H__
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "../common/get_timestamp.h"
+#include "device_api.h"
+#include "exponent_cache.h"
+#include "residue_store.h"
+#include "stage1_loop.h"
+
+#define GPU_STREAMS 2                 // launches of consecutive jobs overlap on separate streams
+#define GPU_STAGING_BYTES (1u << 20)  // pinned staging per stream, uploads alternate between its halves
+#define GPU_POOL_MIN_BYTES 256        // pooled device buffers come in powers of two from this size
+
+// a stream and what a launch on it needs, allocated once with the context
+struct gpu_stream_slot_t {
+    device_stream_t stream;
+    char *staging;                   // GPU_STAGING_BYTES of pinned memory
+    volatile bool *completed;        // mapped, set by the kernel on a factor, the host may poll or set it
+    bool *completed_device;
+    unsigned *work_counter;          // device
+    void *report;                    // mapped error report of the launch, report_bytes
+    void *report_device;
+};
+
+/*
+ * Device state that outlives a single factorization: the prime table, the
+ * prime groups per width, GPU_STREAMS stream slots, a pool of device
+ * buffers and the stage 1 residues of recent launches. A call leases a
+ * slot, takes its buffers from the pool and puts everything back, so
+ * consecutive calls allocate nothing and calls on different slots overlap.
+ * Thread safe; the DeviceApi must outlive it.
+ */
+class GpuContext {
+public:
+    explicit GpuContext(DeviceApi &api, size_t report_bytes = 0);
+
+    ~GpuContext();
+
+    int initialize();
+
+    DeviceApi &device() {
+        return api;
+    }
+
+    // device buffer of at least `bytes`, a released one of the same size class when there is one
+    void *acquire(size_t bytes);
+
+    void release(void *buffer);
+
+    // blocks until a slot is free
+    gpu_stream_slot_t *lease();
+
+    void give_back(gpu_stream_slot_t *slot);
+
+    // host to device through the slot's pinned staging, filling one half while the other is copied
+    int upload(void *device, const void *host, size_t bytes, gpu_stream_slot_t &slot);
+
+    int load_primes(const unsigned *table, unsigned primes_num);
+
+    const unsigned *primes() const {
+        return device_primes;
+    }
+
+    // record buffers in the sets come from the pool
+    ResidueStore &residues() {
+        return residue_store;
+    }
+
+    // device copy of the exponent cache's groups, uploaded on first use; count 0 without groups
+    prime_groups_view_t prime_groups(ExponentCache *exponents, unsigned group_bits, unsigned b_max);
+
+private:
+    DeviceApi &api;
+    const size_t report_bytes;
+    unsigned *device_primes = nullptr;
+
+    std::mutex slots_lock;
+    std::condition_variable slot_free;
+    std::vector<gpu_stream_slot_t> slots;
+    std::vector<bool> leased;
+
+    std::mutex pool_lock;
+    std::map<size_t, std::vector<void *>> free_buffers; // by size class
+    std::map<void *, size_t> buffer_class;
+
+    ResidueStore residue_store;
+
+    std::mutex groups_lock;
+    std::map<std::pair<unsigned, unsigned>, prime_groups_view_t> groups; // by (group bits, B cover)
+
+    GpuContext(const GpuContext &) = delete;
+
+    GpuContext &operator=(const GpuContext &) = delete;
+};
+
+class GpuStreamLease {
+public:
+    GpuContext &context;
+    gpu_stream_slot_t &slot;
+
+    explicit GpuStreamLease(GpuContext &context) : context(context), slot(*context.lease()) {
+    }
+
+    ~GpuStreamLease() {
+        context.give_back(&slot);
+    }
+};
+
+/*
+ * Stops a launch from another thread. The kernel's instances poll the
+ * mapped completion flag of their slot; cancel() sets it for the launch
+ * attached now, or for the next one as soon as it attaches.
+ */
+class GpuCancel {
+public:
+    void attach(volatile bool *completed);
+
+    void detach();
+
+    void cancel();
+
+    bool cancelled() const;
+
+private:
+    mutable std::mutex lock;
+    volatile bool *flag = nullptr;
+    bool requested = false;
+};
+
+/*
+ * Deadlines of running launches. One timer thread cancels every armed
+ * GpuCancel whose host clock deadline (get_timestamp) has passed, so a
+ * launch stops at its deadline even though device code has no clock of
+ * its own. A cancel must be disarmed before it goes out of scope. The
+ * clock can be replaced, tests advance one of their own and call expire().
+ */
+class GpuDeadlines {
+public:
+    explicit GpuDeadlines(long long (*clock)() = get_timestamp);
+
+    ~GpuDeadlines();
+
+    void arm(GpuCancel *cancel, long long deadline_us);
+
+    void disarm(GpuCancel *cancel);
+
+    // cancels every armed launch whose deadline has passed by the clock, as the timer thread does
+    void expire();
+
+private:
+    long long (*const clock)();
+    std::mutex lock;
+    std::condition_variable changed;
+    std::multimap<long long, GpuCancel *> armed;
+    bool stopping = false;
+    std::thread timer;
+
+    void expire_locked(long long now);
+
+    void run();
+
+    GpuDeadlines(const GpuDeadlines &) = delete;
+
+    GpuDeadlines &operator=(const GpuDeadlines &) = delete;
+};
+
+#endif /* __GPU_CONTEXT_H__ */
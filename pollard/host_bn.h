@@ -0,0 +1,200 @@
+#ifndef __HOST_BN_H__
+#define __HOST_BN_H__
+
+#include <cstdint>
+#include <cstring>
+
+#include <gmp.h>
+
+#include "stage1_loop.h"
+
+static_assert(GMP_NUMB_BITS == 64 && GMP_NAIL_BITS == 0, "host_bn_t packs 64-bit GMP limbs");
+
+/*
+ * Fixed-width numbers for the kernel on host threads (pollard/host_kernel.h):
+ * what one CGBN instance holds in its registers, as 64-bit limbs on the
+ * stack, with the CGBN calls of the kernel implemented over mpn. Montgomery
+ * products are reduced by word-wise REDC with R = 2^(64 * LIMBS); R differs
+ * from CGBN's 2^BITS when BITS is not a multiple of 64, which only shows in
+ * the Montgomery domain, never in a residue that leaves it.
+ */
+template<uint32_t width>
+struct host_fixed_bn_t {
+    static const uint32_t LIMBS = (width + 63) / 64;
+    mp_limb_t limbs[LIMBS];
+};
+
+template<uint32_t width>
+struct host_fixed_env_t {
+    static const uint32_t LIMBS = host_fixed_bn_t<width>::LIMBS;
+    mp_limb_t np0;                     // -N^-1 mod 2^64
+    mp_limb_t product[2 * LIMBS + 1];  // double-width product being reduced
+    mp_limb_t quotient[2 * LIMBS + 1];
+    mpz_t g;                           // gcd result
+
+    host_fixed_env_t() {
+        mpz_init(g);
+    }
+
+    ~host_fixed_env_t() {
+        mpz_clear(g);
+    }
+
+    host_fixed_env_t(const host_fixed_env_t &) = delete;
+
+    host_fixed_env_t &operator=(const host_fixed_env_t &) = delete;
+};
+
+template<uint32_t width>
+struct host_fixed_ops {
+    typedef host_fixed_env_t<width> env_t;
+    typedef host_fixed_bn_t<width> bn_t;
+    static const uint32_t LIMBS = bn_t::LIMBS;
+
+    static void to_mpz(mpz_t r, const bn_t &a) {
+        mpz_import(r, LIMBS, -1, sizeof(mp_limb_t), 0, 0, a.limbs);
+    }
+
+    // s has at most `width` bits
+    static void from_mpz(bn_t &r, mpz_t s) {
+        size_t count;
+        mpz_export(r.limbs, &count, -1, sizeof(mp_limb_t), 0, 0, s);
+        for (; count < LIMBS; count++) r.limbs[count] = 0;
+    }
+
+    // limbs of `a` up to its top non-zero one, 0 for zero
+    static mp_size_t size(const bn_t &a) {
+        mp_size_t count = LIMBS;
+        while (count > 0 && a.limbs[count - 1] == 0) count--;
+        return count;
+    }
+
+    // r = t / R mod n for t < n * R, t is clobbered
+    static void redc(env_t &env, bn_t &r, mp_limb_t *t, const bn_t &n) {
+        mp_limb_t carry = 0;
+        for (uint32_t i = 0; i < LIMBS; i++) {
+            const mp_limb_t c = mpn_addmul_1(t + i, n.limbs, LIMBS, t[i] * env.np0);
+            carry += mpn_add_1(t + i + LIMBS, t + i + LIMBS, LIMBS - i, c);
+        }
+        if (carry != 0 || mpn_cmp(t + LIMBS, n.limbs, LIMBS) >= 0) {
+            mpn_sub_n(r.limbs, t + LIMBS, n.limbs, LIMBS);
+        } else {
+            memcpy(r.limbs, t + LIMBS, sizeof(r.limbs));
+        }
+    }
+
+    static void set(env_t &, bn_t &r, const bn_t &a) {
+        memcpy(r.limbs, a.limbs, sizeof(r.limbs));
+    }
+
+    static void set_ui32(env_t &, bn_t &r, uint32_t value) {
+        memset(r.limbs, 0, sizeof(r.limbs));
+        r.limbs[0] = value;
+    }
+
+    static void mul_ui32(env_t &, bn_t &r, const bn_t &a, uint32_t value) {
+        mpn_mul_1(r.limbs, a.limbs, LIMBS, value);
+        if (width % 64 != 0) r.limbs[LIMBS - 1] &= (((mp_limb_t) 1) << (width % 64)) - 1; // CGBN keeps the low bits
+    }
+
+    static void sub_ui32(env_t &, bn_t &r, const bn_t &a, uint32_t value) {
+        mpn_sub_1(r.limbs, a.limbs, LIMBS, value);
+    }
+
+    // width / 32 little-endian words, the layout of cgbn_mem_t
+    static void load(env_t &, bn_t &r, const uint32_t *words) {
+        memset(r.limbs, 0, sizeof(r.limbs));
+        for (uint32_t i = 0; i < width / 32; i++) {
+            r.limbs[i / 2] |= ((mp_limb_t) words[i]) << (32 * (i % 2));
+        }
+    }
+
+    static void store(env_t &, uint32_t *words, const bn_t &a) {
+        for (uint32_t i = 0; i < width / 32; i++) {
+            words[i] = (uint32_t) (a.limbs[i / 2] >> (32 * (i % 2)));
+        }
+    }
+
+    static uint32_t bits(env_t &, const bn_t &a) {
+        for (uint32_t i = LIMBS; i > 0; i--) {
+            if (a.limbs[i - 1] != 0) return 64 * i - (uint32_t) __builtin_clzll(a.limbs[i - 1]);
+        }
+        return 0;
+    }
+
+    // len of 1 to 32 bits
+    static uint32_t extract_bits(env_t &, const bn_t &a, uint32_t start, uint32_t len) {
+        const uint32_t limb = start / 64, shift = start % 64;
+        mp_limb_t value = a.limbs[limb] >> shift;
+        if (shift + len > 64 && limb + 1 < LIMBS) value |= a.limbs[limb + 1] << (64 - shift);
+        return (uint32_t) (value & ((((mp_limb_t) 1) << len) - 1));
+    }
+
+    static bool equals_ui32(env_t &, const bn_t &a, uint32_t value) {
+        if (a.limbs[0] != value) return false;
+        for (uint32_t i = 1; i < LIMBS; i++) {
+            if (a.limbs[i] != 0) return false;
+        }
+        return true;
+    }
+
+    // sign of a - value
+    static int compare_ui32(env_t &, const bn_t &a, uint32_t value) {
+        if (size(a) > 1 || a.limbs[0] > value) return 1;
+        return a.limbs[0] == value ? 0 : -1;
+    }
+
+    static int compare(env_t &, const bn_t &a, const bn_t &b) {
+        return mpn_cmp(a.limbs, b.limbs, LIMBS);
+    }
+
+    static void gcd(env_t &env, bn_t &r, const bn_t &a, const bn_t &b) {
+        mpz_t a_view, b_view;
+        mpz_gcd(env.g, mpz_roinit_n(a_view, a.limbs, size(a)), mpz_roinit_n(b_view, b.limbs, size(b)));
+        from_mpz(r, env.g);
+    }
+
+    // r = a mod n
+    static void rem(env_t &env, bn_t &r, const bn_t &a, const bn_t &n) {
+        const mp_size_t a_size = size(a), n_size = size(n);
+        if (a_size < n_size) {
+            set(env, r, a);
+            return;
+        }
+        bn_t remainder = {};
+        mpn_tdiv_qr(env.quotient, remainder.limbs, 0, a.limbs, a_size, n.limbs, n_size);
+        set(env, r, remainder);
+    }
+
+    // r = a * R mod n, n odd; returns the low word of -n^-1 as CGBN does
+    static uint32_t bn2mont(env_t &env, bn_t &r, const bn_t &a, const bn_t &n) {
+        mp_limb_t inverse = n.limbs[0]; // n * n = 1 mod 8, every step doubles the correct low bits
+        for (int i = 0; i < 5; i++) inverse *= 2 - n.limbs[0] * inverse;
+        env.np0 = -inverse;
+
+        memset(env.product, 0, LIMBS * sizeof(mp_limb_t));
+        memcpy(env.product + LIMBS, a.limbs, sizeof(a.limbs));
+        bn_t remainder = {};
+        mpn_tdiv_qr(env.quotient, remainder.limbs, 0, env.product, 2 * LIMBS, n.limbs, size(n));
+        set(env, r, remainder);
+        return (uint32_t) env.np0;
+    }
+
+    static void mont2bn(env_t &env, bn_t &r, const bn_t &a, const bn_t &n, uint32_t) {
+        memcpy(env.product, a.limbs, sizeof(a.limbs));
+        memset(env.product + LIMBS, 0, LIMBS * sizeof(mp_limb_t));
+        redc(env, r, env.product, n);
+    }
+
+    static void mont_mul(env_t &env, bn_t &r, const bn_t &a, const bn_t &b, const bn_t &n, uint32_t) {
+        mpn_mul_n(env.product, a.limbs, b.limbs, LIMBS);
+        redc(env, r, env.product, n);
+    }
+
+    static void mont_sqr(env_t &env, bn_t &r, const bn_t &a, const bn_t &n, uint32_t) {
+        mpn_sqr(env.product, a.limbs, LIMBS);
+        redc(env, r, env.product, n);
+    }
+};
+
+#endif /* __HOST_BN_H__ */
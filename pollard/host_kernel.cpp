@@ -0,0 +1,198 @@
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "host_kernel.h"
+#include "host_bn.h"
+#include "limbs.h"
+#include "stage1_instance.h"
+#include "width_class.h"
+#include "../common/job_log.h"
+#include "../common/metrics.h"
+#include "../common/numa.h"
+#include "../common/thread_pool.h"
+#include "../common/trace.h"
+
+// the completion flag and factor_result_t of a launch
+template<class params>
+struct host_completion_t {
+    std::atomic<bool> completed{false};
+    std::mutex lock;
+    uint32_t factor[params::BITS / 32] = {};
+    unsigned b = 0;
+};
+
+struct host_modexp_scope_t {
+    TraceSpan span{"modexp"};
+    MetricTimer timer{METRIC_MODEXP};
+};
+
+struct host_gcd_scope_t {
+    TraceSpan span{"gcd"};
+    MetricTimer timer{METRIC_GCD};
+};
+
+// the control of a stage 1 instance (stage1_instance.h) on a host worker
+template<class params>
+struct host_control_t {
+    typedef host_fixed_ops<params::BITS> ops;
+    typedef host_modexp_scope_t modexp_scope_t;
+    typedef host_gcd_scope_t gcd_scope_t;
+
+    host_completion_t<params> &completion;
+    std::atomic<unsigned> &work_counter;
+    const b_schedule_t &schedule;
+
+    bool operator()() const {
+        return completion.completed.load(std::memory_order_relaxed);
+    }
+
+    // steps are claimed until the deadline, a claimed step runs to its end
+    bool claim(unsigned *ticket) {
+        if (b_schedule_expired(schedule)) return false;
+        *ticket = work_counter.fetch_add(1);
+        return true;
+    }
+
+    bool leader() const {
+        return true;
+    }
+
+    // the first factor is kept, the search is over for every worker either way
+    bool found(typename ops::env_t &env, const typename ops::bn_t &d, unsigned B) {
+        std::lock_guard<std::mutex> guard(completion.lock);
+        if (!completion.completed.exchange(true)) {
+            ops::store(env, completion.factor, d);
+            completion.b = B;
+        }
+        return true;
+    }
+};
+
+HostKernel::HostKernel(const unsigned *primes, unsigned threads)
+        : primes(primes), workers(threads > 0 ? threads : default_worker_count()) {
+}
+
+HostKernel::~HostKernel() {
+    std::vector<void *> released;
+    store.drain(released);
+    for (void *records : released) free(records);
+}
+
+template<class params>
+int HostKernel::factorize_param(mpz_t n, const b_schedule_t &schedule, mpz_t *factor, unsigned *b_found,
+                                ExponentCache *exponents, const unsigned *table) {
+    typedef host_fixed_ops<params::BITS> ops;
+    typedef residue_record_t<params> record_t;
+    TRACE_SCOPE("host_factorize");
+
+    // the prime groups the GPU context would upload for this width and B_max
+    std::shared_ptr<const prime_groups_t> held;
+    prime_groups_view_t groups = {nullptr, nullptr, 0};
+    if (exponents != nullptr) {
+        unsigned cover = 1;
+        while (cover < schedule.b_max && cover < 0x80000000u) cover *= 2;
+        held = exponents->prime_groups(params::BITS / 2, cover);
+        groups = {held->words.data(), held->starts.data(), held->count()};
+    }
+
+    const unsigned steps = b_schedule_size(schedule);
+    std::vector<unsigned> step_b(steps);
+    for (unsigned i = 0; i < steps; i++) b_schedule_at(schedule, i, &step_b[i]);
+    residue_plan_t plan;
+    std::vector<void *> released;
+    store.plan(n, params::BITS, step_b, &plan, released);
+    for (void *buffer : released) free(buffer);
+    released.clear();
+
+    auto *sources = (record_t *) plan.sources;
+    const unsigned record_count = store.records(steps);
+    auto *records = (record_t *) calloc(record_count > 0 ? record_count : 1, sizeof(record_t));
+    if (records == nullptr) {
+        fprintf(stderr, "Cannot allocate %u host residue records\n", record_count);
+        free(sources);
+        return -1;
+    }
+
+    typename ops::bn_t N;
+    ops::from_mpz(N, n);
+    if (plan.reduce) { // the sources belong to a multiple of n
+        typename ops::env_t env;
+        typename ops::bn_t x;
+        for (unsigned i = 0; i < plan.count; i++) {
+            ops::load(env, x, sources[i].x);
+            ops::rem(env, x, x, N);
+            ops::store(env, sources[i].x, x);
+        }
+    }
+    const residue_launch_t<params> launch = {sources, plan.source.data(), records, store.stride(steps)};
+
+    // persistent instances, one per worker, claiming B from the shared work counter
+    host_completion_t<params> completion;
+    std::atomic<unsigned> work_counter(0);
+    {
+        WorkStealingPool pool(workers, numa_thread_node());
+        for (unsigned t = 0; t < pool.size(); t++) {
+            pool.submit([&]() {
+                typename ops::env_t env;
+                host_control_t<params> control = {completion, work_counter, schedule};
+                stage1_instance_loop<ops, params>(env, N, table, groups, launch, schedule, control);
+            });
+        }
+    }
+
+    // this call's residues replace the ones it extended
+    free(sources);
+    store.store(n, params::BITS, step_b, records, released);
+    for (void *buffer : released) free(buffer);
+
+    if (!completion.completed.load() && b_schedule_expired(schedule)) {
+        log_printf("Failed after %u B values!\n", work_counter.load());
+        return -1;
+    }
+
+    to_mpz(*factor, completion.factor, params::BITS / 32);
+    log_printf("Found with B: %d (%u B values claimed)\n", completion.b, work_counter.load());
+    *b_found = completion.b;
+    return 0;
+}
+
+int HostKernel::factorize(mpz_t n, const b_schedule_t &schedule, mpz_t *factor, unsigned *b_found,
+                          ExponentCache *exponents, const unsigned *table) {
+    if (table == nullptr) table = primes;
+
+    if (!width_class_fits(n)) {
+        fprintf(stderr, "Input of %u bits exceeds the widest kernel instance (%u bits)\n",
+                (unsigned) mpz_sizeinbase(n, 2), width_class_bits[WIDTH_CLASSES - 1]);
+        return -1;
+    }
+
+    // one instance per width class, also the ones gpu_factorize runs on a wider instance; TPI only sets the window
+    switch (width_class_of(n)) {
+        case 0:
+            return factorize_param<pollard_params_t<4, 96>>(n, schedule, factor, b_found, exponents, table);
+        case 1:
+            return factorize_param<pollard_params_t<4, 128>>(n, schedule, factor, b_found, exponents, table);
+        case 2:
+            return factorize_param<pollard_params_t<8, 192>>(n, schedule, factor, b_found, exponents, table);
+        case 3:
+            return factorize_param<pollard_params_t<8, 256>>(n, schedule, factor, b_found, exponents, table);
+        case 4:
+            return factorize_param<pollard_params_t<16, 384>>(n, schedule, factor, b_found, exponents, table);
+        case 5:
+            return factorize_param<pollard_params_t<16, 512>>(n, schedule, factor, b_found, exponents, table);
+        case 6:
+            return factorize_param<pollard_params_t<32, 768>>(n, schedule, factor, b_found, exponents, table);
+        case 7:
+            return factorize_param<pollard_params_t<32, 1024>>(n, schedule, factor, b_found, exponents, table);
+        case 8:
+            return factorize_param<pollard_params_t<32, 2048>>(n, schedule, factor, b_found, exponents, table);
+        case 9:
+            return factorize_param<pollard_params_t<32, 4096>>(n, schedule, factor, b_found, exponents, table);
+        default:
+            return factorize_param<pollard_params_t<32, 8192>>(n, schedule, factor, b_found, exponents, table);
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef __HOST_KERNEL_H__
+#define __HOST_KERNEL_H__
+
+#include <gmp.h>
+
+#include "b_schedule.h"
+#include "exponent_cache.h"
+#include "residue_store.h"
+
+/*
+ * The GPU kernel's search on host threads. Each worker runs one persistent
+ * instance: it claims the next B of the schedule, starts from its own base
+ * or extends a stored residue, runs stage1_power at the same
+ * pollard_params_t width as gpu_factorize over the fixed-width numbers of
+ * host_bn.h and stops every other worker once it has a factor. Residues of
+ * a call stay here for later calls on the same modulus or a cofactor, as
+ * they stay on the device. Nodes without a GPU get the kernel's search this
+ * way, and device results can be cross-checked on them.
+ */
+class HostKernel {
+public:
+    HostKernel(const unsigned *primes, unsigned threads);
+
+    ~HostKernel();
+
+    // like gpu_factorize: 0 with factor 0 when the schedule ran out, -1 on errors and expired deadlines;
+    // `table` is a copy of the prime table local to the caller, the kernel's own when nullptr
+    int factorize(mpz_t n, const b_schedule_t &schedule, mpz_t *factor, unsigned *b_found,
+                  ExponentCache *exponents, const unsigned *table = nullptr);
+
+    unsigned threads() const {
+        return workers;
+    }
+
+    ResidueStore &residues() {
+        return store;
+    }
+
+private:
+    const unsigned *primes;
+    const unsigned workers;
+    ResidueStore store; // records are malloc'd
+
+    template<class params>
+    int factorize_param(mpz_t n, const b_schedule_t &schedule, mpz_t *factor, unsigned *b_found,
+                        ExponentCache *exponents, const unsigned *table);
+
+    HostKernel(const HostKernel &) = delete;
+
+    HostKernel &operator=(const HostKernel &) = delete;
+};
+
+#endif /* __HOST_KERNEL_H__ */
@@ -3,22 +3,30 @@
 
 #include <cstdio>
 #include <cmath>
+#include <cstring>
+#include <memory>
+#include <vector>
 
 #include "kernel.h"
+#include "gpu_context.h"
+#include "limbs.h"
+#include "../common/job_log.h"
+#include "../common/metrics.h"
+#include "../common/trace.h"
 
 #include <gmp.h>
+#include <cooperative_groups.h>
 #include "cgbn/cgbn.h"
+#include "b_schedule.h"
+#include "stage1_instance.h"
+#include "width_class.h"
 
 #define THREADS_PER_BLOCK 128
+#define PERSISTENT_THREADS 1 // instances pull B from a work queue instead of a static assignment
 
-#define CGBN_CHECK(report) cgbn_check(report, __FILE__, __LINE__)
+namespace cg = cooperative_groups;
 
-template<uint32_t tpi, uint32_t bits>
-class pollard_params_t {
-public:
-    static const uint32_t TPI = tpi;                   // threads per instance
-    static const uint32_t BITS = bits;                 // instance size
-};
+#define CGBN_CHECK(report) cgbn_check(report, __FILE__, __LINE__)
 
 template<class params>
 struct factor_result_t {
@@ -26,42 +34,165 @@ struct factor_result_t {
     unsigned b;
 };
 
-void cgbn_check(cgbn_error_report_t *report, const char *file = nullptr, int32_t line = 0) {
+// 0 when no instance reported a CGBN error, otherwise the report goes to stderr and -1 back to the caller
+int cgbn_check(cgbn_error_report_t *report, const char *file = nullptr, int32_t line = 0) {
     // check for cgbn errors
 
     if (cgbn_error_report_check(report)) {
-        printf("\n");
-        printf("CGBN error occurred: %s\n", cgbn_error_string(report));
+        fprintf(stderr, "CGBN error occurred: %s\n", cgbn_error_string(report));
 
         if (report->_instance != 0xFFFFFFFF) {
-            printf("Error reported by instance %d", report->_instance);
+            fprintf(stderr, "Error reported by instance %d", report->_instance);
             if (report->_blockIdx.x != 0xFFFFFFFF || report->_threadIdx.x != 0xFFFFFFFF)
-                printf(", ");
+                fprintf(stderr, ", ");
             if (report->_blockIdx.x != 0xFFFFFFFF)
-                printf("blockIdx=(%d, %d, %d) ", report->_blockIdx.x, report->_blockIdx.y, report->_blockIdx.z);
+                fprintf(stderr, "blockIdx=(%d, %d, %d) ", report->_blockIdx.x, report->_blockIdx.y,
+                        report->_blockIdx.z);
             if (report->_threadIdx.x != 0xFFFFFFFF)
-                printf("threadIdx=(%d, %d, %d)", report->_threadIdx.x, report->_threadIdx.y, report->_threadIdx.z);
-            printf("\n");
+                fprintf(stderr, "threadIdx=(%d, %d, %d)", report->_threadIdx.x, report->_threadIdx.y,
+                        report->_threadIdx.z);
+            fprintf(stderr, "\n");
         } else {
-            printf("Error reported by blockIdx=(%d %d %d)", report->_blockIdx.x, report->_blockIdx.y,
-                   report->_blockIdx.z);
-            printf("threadIdx=(%d %d %d)\n", report->_threadIdx.x, report->_threadIdx.y, report->_threadIdx.z);
+            fprintf(stderr, "Error reported by blockIdx=(%d %d %d)", report->_blockIdx.x, report->_blockIdx.y,
+                    report->_blockIdx.z);
+            fprintf(stderr, "threadIdx=(%d %d %d)\n", report->_threadIdx.x, report->_threadIdx.y,
+                    report->_threadIdx.z);
         }
         if (file != nullptr)
-            printf("file %s, line %d\n", file, line);
-        exit(1);
+            fprintf(stderr, "file %s, line %d\n", file, line);
+        return -1;
     }
+    return 0;
+}
+
+// whole instance agrees on the flag, its threads must not diverge inside CGBN calls
+template<class tile_t>
+__device__ __forceinline__ bool instance_completed(const tile_t &tile, volatile bool *completed) {
+    return tile.any(*completed);
 }
 
+// CGBN side of the stage 1 loop and its instance driver, the host reference in stage1_host.h mirrors the loop
+template<class env_type>
+struct cgbn_stage1_ops {
+    typedef env_type env_t;
+    typedef typename env_type::cgbn_t bn_t;
+
+    __device__ __forceinline__ static void set(env_t &env, bn_t &r, const bn_t &a) {
+        cgbn_set(env, r, a);
+    }
+
+    __device__ __forceinline__ static void set_ui32(env_t &env, bn_t &r, uint32_t value) {
+        cgbn_set_ui32(env, r, value);
+    }
+
+    __device__ __forceinline__ static void mul_ui32(env_t &env, bn_t &r, const bn_t &a, uint32_t value) {
+        cgbn_mul_ui32(env, r, a, value);
+    }
+
+    __device__ __forceinline__ static void sub_ui32(env_t &env, bn_t &r, const bn_t &a, uint32_t value) {
+        cgbn_sub_ui32(env, r, a, value);
+    }
+
+    __device__ __forceinline__ static void load(env_t &env, bn_t &r, const uint32_t *words) {
+        cgbn_load(env, r, (cgbn_mem_t<env_t::BITS> *) words);
+    }
+
+    __device__ __forceinline__ static void store(env_t &env, uint32_t *words, const bn_t &a) {
+        cgbn_store(env, (cgbn_mem_t<env_t::BITS> *) words, a);
+    }
+
+    __device__ __forceinline__ static uint32_t bits(env_t &env, const bn_t &a) {
+        return env_t::BITS - cgbn_clz(env, a);
+    }
+
+    __device__ __forceinline__ static uint32_t extract_bits(env_t &env, const bn_t &a, uint32_t start, uint32_t len) {
+        return cgbn_extract_bits_ui32(env, a, start, len);
+    }
+
+    __device__ __forceinline__ static bool equals_ui32(env_t &env, const bn_t &a, uint32_t value) {
+        return cgbn_equals_ui32(env, a, value);
+    }
+
+    __device__ __forceinline__ static int compare_ui32(env_t &env, const bn_t &a, uint32_t value) {
+        return cgbn_compare_ui32(env, a, value);
+    }
+
+    __device__ __forceinline__ static int compare(env_t &env, const bn_t &a, const bn_t &b) {
+        return cgbn_compare(env, a, b);
+    }
+
+    __device__ __forceinline__ static void gcd(env_t &env, bn_t &r, const bn_t &a, const bn_t &b) {
+        cgbn_gcd(env, r, a, b);
+    }
+
+    __device__ __forceinline__ static uint32_t bn2mont(env_t &env, bn_t &r, const bn_t &a, const bn_t &n) {
+        return cgbn_bn2mont(env, r, a, n);
+    }
+
+    __device__ __forceinline__ static void mont2bn(env_t &env, bn_t &r, const bn_t &a, const bn_t &n, uint32_t np0) {
+        cgbn_mont2bn(env, r, a, n, np0);
+    }
+
+    __device__ __forceinline__ static void mont_mul(env_t &env, bn_t &r, const bn_t &a, const bn_t &b, const bn_t &n,
+                                                    uint32_t np0) {
+        cgbn_mont_mul(env, r, a, b, n, np0);
+    }
+
+    __device__ __forceinline__ static void mont_sqr(env_t &env, bn_t &r, const bn_t &a, const bn_t &n, uint32_t np0) {
+        cgbn_mont_sqr(env, r, a, n, np0);
+    }
+};
+
+struct instance_scope_t {
+    __device__ instance_scope_t() {
+    }
+};
+
+// the control of a stage 1 instance (stage1_instance.h): the whole tile agrees on the completion flag, thread 0
+// claims the steps from the work counter and writes the scalar fields
+template<class params, class env_t, class tile_t>
+struct instance_control_t {
+    typedef instance_scope_t modexp_scope_t;
+    typedef instance_scope_t gcd_scope_t;
+
+    const tile_t &tile;
+    volatile bool *completed;
+    unsigned *work_counter; // nullptr with the static assignment
+    factor_result_t<params> *result;
+
+    __device__ __forceinline__ bool operator()() const {
+        return instance_completed(tile, completed);
+    }
+
+    __device__ __forceinline__ bool claim(unsigned *ticket) {
+        unsigned claimed = 0;
+        if (tile.thread_rank() == 0) claimed = atomicAdd(work_counter, 1);
+        *ticket = tile.shfl(claimed, 0);
+        return true;
+    }
+
+    __device__ __forceinline__ bool leader() const {
+        return tile.thread_rank() == 0;
+    }
+
+    __device__ __forceinline__ bool found(env_t &env, const typename env_t::cgbn_t &d, unsigned B) {
+        *completed = true;
+        cgbn_store(env, &result->factor, d);
+        result->b = B;
+        return true;
+    }
+};
+
+// static assignment, instance i runs step i of the schedule
 template<class params>
 __global__
 void parallel_factorize_kernel(cgbn_error_report_t *report,
                                cgbn_mem_t<params::BITS> n,
                                const unsigned *primes,
+                               prime_groups_view_t groups,
+                               residue_launch_t<params> launch,
                                unsigned random_mul,
-                               unsigned b_max,
-                               unsigned b_start,
-                               unsigned b_jump,
+                               b_schedule_t schedule,
                                volatile bool *completed,
                                factor_result_t<params> *result) {
     typedef cgbn_context_t<params::TPI> context_t;
@@ -72,71 +203,69 @@ void parallel_factorize_kernel(cgbn_error_report_t *report,
 
     const unsigned tid = blockDim.x * blockIdx.x + threadIdx.x;
     const unsigned instance = tid / params::TPI;
-    const unsigned B = b_start + (b_jump * (blockIdx.x + 1)) * instance; // faster (other than linear) B growth ?
-    if (B > b_max) return;
-
-    const double log_b = log2((double) B);
-    const unsigned log_b_ceil = ((unsigned) log_b) + 1;
-    const unsigned prime_per_iter = params::BITS / log_b_ceil / 2;
+    unsigned B;
+    if (!b_schedule_at(schedule, instance, &B)) return;
 
     context_t bn_context(cgbn_report_monitor, report, instance);   // construct a context
     env_t bn_env(bn_context);                                  // construct an environment for big-int math
+    const auto tile = cg::tiled_partition<params::TPI>(cg::this_thread_block());
 
-    unsigned primes_it;
-    unsigned power;
-    unsigned prime_i;
-
-    bn_t N, a, d, e_sub, e, g, tmp;
+    bn_t N;
     cgbn_load(bn_env, N, &n);
-    cgbn_set_ui32(bn_env, a, (ULong) 2 + tid);
-    cgbn_set_ui32(bn_env, d, 0);
-    cgbn_set_ui32(bn_env, e, 0);
-    cgbn_set_ui32(bn_env, e_sub, 0);
-    cgbn_set_ui32(bn_env, g, 0);
-    cgbn_set_ui32(bn_env, tmp, 0);
-
-    // check NWD(a, N), if 0 then we have a factor else we can proceed with the algorithm
-    cgbn_gcd(bn_env, d, a, N);
-    if (cgbn_compare_ui32(bn_env, d, 1)) {
-        *completed = true;
-        cgbn_store(bn_env, &result->factor, d);
-        result->b = B;
-        return;
-    }
+    instance_control_t<params, env_t, decltype(tile)> control = {tile, completed, nullptr, result};
+    stage1_instance<cgbn_stage1_ops<env_t>, params>(bn_env, N, primes, groups, launch, instance, B, 2 + tid, control);
+}
 
-    cgbn_set(bn_env, e, a); // e = a
-    prime_i = (ULong) primes[0];
-    for (primes_it = 0; prime_i <= B; primes_it += prime_per_iter) {
-        if (*completed) return;
-        cgbn_set_ui32(bn_env, e_sub, 1);
+// persistent threads, instances keep claiming the next B from the work counter until the queue runs out
+template<class params>
+__global__
+void persistent_factorize_kernel(cgbn_error_report_t *report,
+                                 cgbn_mem_t<params::BITS> n,
+                                 const unsigned *primes,
+                                 prime_groups_view_t groups,
+                                 residue_launch_t<params> launch,
+                                 b_schedule_t schedule,
+                                 unsigned *work_counter,
+                                 volatile bool *completed,
+                                 factor_result_t<params> *result) {
+    typedef cgbn_context_t<params::TPI> context_t;
+    typedef cgbn_env_t<context_t, params::BITS> env_t;
+    typedef typename env_t::cgbn_t bn_t;
 
-        for (unsigned i = 0; i < prime_per_iter && prime_i <= B; i++) {
-            power = (unsigned) (log_b / log2((double) prime_i)); // p_pow_i = log(B) / log(p_i)
-            cgbn_mul_ui32(bn_env, tmp, e_sub, (unsigned) pow((double) prime_i, power)); // e_sub *= p_i^p_pow_i
-            cgbn_set(bn_env, e_sub, tmp);
-            prime_i = primes[primes_it + i + 1];
-        }
-        cgbn_modular_power(bn_env, g, e, e_sub, N); // e = (e ** e_sub) % N - partial
-        cgbn_set(bn_env, e, g);
-    }
+    const unsigned instance = (blockDim.x * blockIdx.x + threadIdx.x) / params::TPI;
 
-    if (!cgbn_equals_ui32(bn_env, e, 1)) {
-        if (*completed) return;
+    context_t bn_context(cgbn_report_monitor, report, instance);
+    env_t bn_env(bn_context);
+    const auto tile = cg::tiled_partition<params::TPI>(cg::this_thread_block());
 
-        cgbn_sub_ui32(bn_env, g, e, 1); // g = e - 1
-        cgbn_gcd(bn_env, d, g, N); // d = gcd(g, N)
+    bn_t N;
+    cgbn_load(bn_env, N, &n);
+    instance_control_t<params, env_t, decltype(tile)> control = {tile, completed, work_counter, result};
+    stage1_instance_loop<cgbn_stage1_ops<env_t>, params>(bn_env, N, primes, groups, launch, schedule, control);
+}
 
-        if (cgbn_compare_ui32(bn_env, d, 1) <= 0) {
-            return;
-        } else if (cgbn_compare(bn_env, d, N) >= 0) {
-            return;
-        } else { // factor found!
-            *completed = true;
-            cgbn_store(bn_env, &result->factor, d);
-            result->b = B;
-            return;
-        }
-    }
+// residues of an earlier launch taken modulo a cofactor of its modulus, one instance per record
+template<class params>
+__global__
+void reduce_residues_kernel(cgbn_error_report_t *report,
+                            cgbn_mem_t<params::BITS> n,
+                            residue_record_t<params> *records,
+                            unsigned count) {
+    typedef cgbn_context_t<params::TPI> context_t;
+    typedef cgbn_env_t<context_t, params::BITS> env_t;
+    typedef typename env_t::cgbn_t bn_t;
+
+    const unsigned instance = (blockDim.x * blockIdx.x + threadIdx.x) / params::TPI;
+    if (instance >= count) return;
+
+    context_t bn_context(cgbn_report_monitor, report, instance);
+    env_t bn_env(bn_context);
+
+    bn_t N, x;
+    cgbn_load(bn_env, N, &n);
+    cgbn_load(bn_env, x, (cgbn_mem_t<params::BITS> *) records[instance].x);
+    cgbn_rem(bn_env, x, x, N);
+    cgbn_store(bn_env, (cgbn_mem_t<params::BITS> *) records[instance].x, x);
 }
 
 int cudaInitialize() {
@@ -161,14 +290,14 @@ int cudaInitialize() {
             return -1;
         };
         int Gflops = prop.multiProcessorCount * prop.clockRate;
-        printf("CUDA Device %d: %s Gflops %f Processors %d Threads/Block %d\n", dev, prop.name, 1e-6 * Gflops,
-               prop.multiProcessorCount, prop.maxThreadsPerBlock);
+        fprintf(stderr, "CUDA Device %d: %s Gflops %f Processors %d Threads/Block %d\n", dev, prop.name,
+                1e-6 * Gflops, prop.multiProcessorCount, prop.maxThreadsPerBlock);
         if (Gflops > MaxGflops) {
             MaxGflops = Gflops;
             MaxDevice = dev;
         };
     };
-    printf("Fastest CUDA Device %d: %s\n", MaxDevice, prop.name);
+    fprintf(stderr, "Fastest CUDA Device %d: %s\n", MaxDevice, prop.name);
 
     //  Print and set device
     if (cudaSuccess != (err = cudaGetDeviceProperties(&prop, MaxDevice))) {
@@ -178,163 +307,292 @@ int cudaInitialize() {
     };
     cudaSetDevice(MaxDevice);
 
-    printf("TotalGlobalMem=%lu [MB]\n", (unsigned long) (prop.totalGlobalMem / 1024u / 1024u));
-    printf("TotalConstMem=%lu [kB]\n", (unsigned long) (prop.totalConstMem / 1024u));
-    printf("ClockRate=%d [MHz]\n", prop.clockRate / 1000);
-    printf("MemoryClockRate=%d [MHz]\n", prop.memoryClockRate / 1000);
+    fprintf(stderr, "TotalGlobalMem=%lu [MB]\n", (unsigned long) (prop.totalGlobalMem / 1024u / 1024u));
+    fprintf(stderr, "TotalConstMem=%lu [kB]\n", (unsigned long) (prop.totalConstMem / 1024u));
+    fprintf(stderr, "ClockRate=%d [MHz]\n", prop.clockRate / 1000);
+    fprintf(stderr, "MemoryClockRate=%d [MHz]\n", prop.memoryClockRate / 1000);
 
-    printf("MaxTexture1D=%d\n", prop.maxTexture1D);
-    printf("MaxTexture1DLinear=%u [KB]\n", prop.maxTexture1DLinear / 1024u);
+    fprintf(stderr, "MaxTexture1D=%d\n", prop.maxTexture1D);
+    fprintf(stderr, "MaxTexture1DLinear=%u [KB]\n", prop.maxTexture1DLinear / 1024u);
 
-    printf("MaxTexture2D=%d x %d\n", prop.maxTexture2D[0], prop.maxTexture2D[1]);
-    printf("MaxTexture2DLinear=%d x %d\n", prop.maxTexture2DLinear[0], prop.maxTexture2DLinear[1]);
+    fprintf(stderr, "MaxTexture2D=%d x %d\n", prop.maxTexture2D[0], prop.maxTexture2D[1]);
+    fprintf(stderr, "MaxTexture2DLinear=%d x %d\n", prop.maxTexture2DLinear[0], prop.maxTexture2DLinear[1]);
 
-    printf("\n");
     return 0;
 }
 
-void to_mpz(mpz_t r, uint32_t *x, uint32_t count) {
-    mpz_import(r, count, -1, sizeof(uint32_t), 0, 0, x);
-}
+// the CUDA runtime behind a GpuContext
+class CudaDeviceApi : public DeviceApi {
+public:
+    int device_alloc(void **ptr, size_t bytes) override {
+        return checked(cudaMalloc(ptr, bytes), "Cannot allocate device memory");
+    }
 
-void from_mpz(mpz_t s, uint32_t *x, uint32_t count) {
-    size_t words;
+    void device_free(void *ptr) override {
+        cudaFree(ptr);
+    }
 
-    if (mpz_sizeinbase(s, 2) > count * 32) {
-        fprintf(stderr, "from_mpz failed -- result does not fit\n");
-        exit(1);
+    int pinned_alloc(void **ptr, size_t bytes) override {
+        return checked(cudaMallocHost(ptr, bytes), "Cannot allocate pinned host memory");
     }
 
-    mpz_export(x, &words, -1, sizeof(uint32_t), 0, 0, s);
-    while (words < count)
-        x[words++] = 0;
-}
+    void pinned_free(void *ptr) override {
+        cudaFreeHost(ptr);
+    }
 
-unsigned *allocate_primes(const unsigned prime_table[], const unsigned primes_num) {
-    cudaError_t err;
+    int mapped_alloc(void **host, void **device, size_t bytes) override {
+        if (checked(cudaHostAlloc(host, bytes, cudaHostAllocMapped), "Cannot allocate mapped host memory") != 0) {
+            return -1;
+        }
+        return checked(cudaHostGetDevicePointer(device, *host, 0), "Cannot map host memory");
+    }
 
-    unsigned *dev_primes;
+    void mapped_free(void *host) override {
+        cudaFreeHost(host);
+    }
 
-    if (cudaSuccess != (err = cudaMalloc((void **) &dev_primes, primes_num * sizeof(prime_table[0])))) {
-        fprintf(stderr, "Unable to allocate device prime table!\nError [%d]%s\n", (int) err, cudaGetErrorString(err));
-        return nullptr;
+    int stream_create(device_stream_t *stream) override {
+        return checked(cudaStreamCreateWithFlags((cudaStream_t *) stream, cudaStreamNonBlocking),
+                       "Cannot create stream");
     }
 
-    if (cudaSuccess !=
-        (err = cudaMemcpy(dev_primes, prime_table, primes_num * sizeof(prime_table[0]), cudaMemcpyHostToDevice))) {
-        fprintf(stderr, "Unable to allocate device prime table!\nError [%d]%s\n", (int) err, cudaGetErrorString(err));
-        return nullptr;
+    void stream_destroy(device_stream_t stream) override {
+        cudaStreamDestroy((cudaStream_t) stream);
     }
 
-    return dev_primes;
-}
+    int copy_async(void *dst, const void *src, size_t bytes, device_copy_kind_t kind,
+                   device_stream_t stream) override {
+        const cudaMemcpyKind direction = kind == COPY_HOST_TO_DEVICE ? cudaMemcpyHostToDevice : cudaMemcpyDeviceToHost;
+        return checked(cudaMemcpyAsync(dst, src, bytes, direction, (cudaStream_t) stream), "Cannot copy");
+    }
 
-int free_primes(unsigned *dev_primes) {
-    if (dev_primes != nullptr) cudaFree(dev_primes);
-    return 0;
+    int memset_async(void *ptr, int value, size_t bytes, device_stream_t stream) override {
+        return checked(cudaMemsetAsync(ptr, value, bytes, (cudaStream_t) stream), "Cannot clear device memory");
+    }
+
+    int stream_synchronize(device_stream_t stream) override {
+        return checked(cudaStreamSynchronize((cudaStream_t) stream), "Unable to synchronize stream!");
+    }
+
+private:
+    static int checked(cudaError_t err, const char *what) {
+        if (err == cudaSuccess) return 0;
+        fprintf(stderr, "%s\nError [%d]%s\n", what, (int) err, cudaGetErrorString(err));
+        return -1;
+    }
+};
+
+GpuContext *gpu_context_create(const unsigned prime_table[], const unsigned primes_num) {
+    if (cudaInitialize() != 0) return nullptr;
+    cudaSetDeviceFlags(cudaDeviceMapHost); // the completion flags live in mapped host memory
+    cudaDeviceSetCacheConfig(cudaFuncCachePreferL1);
+
+    static CudaDeviceApi cuda_api;
+    std::unique_ptr<GpuContext> context(new GpuContext(cuda_api, sizeof(cgbn_error_report_t)));
+    if (context->initialize() != 0 || context->load_primes(prime_table, primes_num) != 0) {
+        return nullptr;
+    }
+    return context.release();
 }
 
 template<class params>
-int parallel_factorize_param(mpz_t n,
-                             const unsigned *gpu_primes_table,
-                             const unsigned primes_num,
-                             unsigned b_max,
-                             unsigned b_start,
-                             unsigned b_jump,
+int parallel_factorize_param(GpuContext &context,
+                             mpz_t n,
+                             const b_schedule_t &schedule,
                              mpz_t *factor,
-                             unsigned *b_found) {
-    cudaError_t err;
-    size_t result_size = sizeof(factor_result_t<params>);
+                             unsigned *b_found,
+                             ExponentCache *exponents,
+                             GpuCancel *cancel) {
+    static_assert(params::BITS % (32 * params::TPI) == 0, "CGBN needs whole limbs on every thread of an instance");
+    TRACE_SCOPE("gpu_factorize");
+    DeviceApi &device = context.device();
+    const size_t result_size = sizeof(factor_result_t<params>);
+    static_assert(sizeof(factor_result_t<params>) + sizeof(unsigned) <= GPU_STAGING_BYTES, "result staging");
 
-    bool completed = false;
-    unsigned start = 0;
     cgbn_mem_t<params::BITS> gpu_n;
-    factor_result_t<params> *gpu_result = nullptr;
     factor_result_t<params> cpu_result;
-    bool *gpu_completed = nullptr;
-    unsigned *gpu_start = nullptr;
-    cgbn_error_report_t *report;
-
-    if (
-            (cudaSuccess != (err = cudaMalloc((void **) &gpu_result, result_size))) ||
-            (cudaSuccess != (err = cudaMalloc((void **) &gpu_completed, sizeof(bool)))) ||
-            (cudaSuccess != (err = cudaMalloc((void **) &gpu_start, sizeof(unsigned)))) ||
-            (cudaSuccess != (err = cudaMemset(gpu_result, 0L, result_size))) ||
-            (cudaSuccess != (err = cudaMemset(gpu_completed, false, sizeof(bool)))) ||
-            (cudaSuccess != (err = cudaMemset(gpu_start, 0L, sizeof(unsigned)))) ||
-            (cudaSuccess != (err = cgbn_error_report_alloc(&report)))
-            ) {
-        fprintf(stderr, "Cannot allocate GPU memory!\nError [%d]%s\n", (int) err, cudaGetErrorString(err));
-        return -1;
-    }
-
-    cudaDeviceSetCacheConfig(cudaFuncCachePreferL1);
+    unsigned start = 0;
 
     from_mpz(n, gpu_n._limbs, params::BITS / 32);
-    unsigned randomMul = 4123457; //+ 1000 * rand() + rand();
+    // before the lease, an upload takes a slot of its own
+    const prime_groups_view_t groups = context.prime_groups(exponents, params::BITS / 2, schedule.b_max);
+
+    // residues of an earlier launch for n or a multiple of it are extended instead of recomputed
+    const unsigned steps = b_schedule_size(schedule);
+    std::vector<unsigned> step_b(steps);
+    for (unsigned i = 0; i < steps; i++) b_schedule_at(schedule, i, &step_b[i]);
+    residue_plan_t plan;
+    std::vector<void *> released;
+    context.residues().plan(n, params::BITS, step_b, &plan, released);
+    for (void *buffer : released) context.release(buffer);
+    released.clear();
+
+    GpuStreamLease lease(context);
+    gpu_stream_slot_t &slot = lease.slot;
+    const auto stream = (cudaStream_t) slot.stream;
+    auto *report = (cgbn_error_report_t *) slot.report;
+    const unsigned record_count = context.residues().records(steps); // bounded however many steps there are
+    const size_t records_size = (record_count > 0 ? record_count : 1) * sizeof(residue_record_t<params>);
+    auto *gpu_result = (factor_result_t<params> *) context.acquire(result_size);
+    auto *records = (residue_record_t<params> *) context.acquire(records_size);
+    int *source = plan.sources != nullptr ? (int *) context.acquire(steps * sizeof(int)) : nullptr;
+    auto discard = [&]() {
+        if (cancel != nullptr) cancel->detach();
+        context.release(gpu_result);
+        context.release(records);
+        context.release(source);
+        context.release(plan.sources);
+        return -1;
+    };
+    if (gpu_result == nullptr || records == nullptr || (plan.sources != nullptr && source == nullptr)) {
+        return discard();
+    }
+    const residue_launch_t<params> launch = {(const residue_record_t<params> *) plan.sources, source, records,
+                                             context.residues().stride(steps)};
+
+    *slot.completed = false;
+    if (cancel != nullptr) cancel->attach(slot.completed); // a cancel from the host ends the launch like a factor
+    cgbn_error_report_reset(report);
+    if (device.memset_async(gpu_result, 0, result_size, slot.stream) != 0 ||
+        device.memset_async(records, 0, records_size, slot.stream) != 0 ||
+        device.memset_async(slot.work_counter, 0, sizeof(unsigned), slot.stream) != 0 ||
+        (source != nullptr && context.upload(source, plan.source.data(), steps * sizeof(int), slot) != 0)) {
+        return discard();
+    }
 
-    unsigned blocks_num = (b_max * params::TPI) / (b_jump * THREADS_PER_BLOCK);
     unsigned threads_per_block = THREADS_PER_BLOCK;
-    parallel_factorize_kernel<params><<<blocks_num, threads_per_block>>>(report, gpu_n, gpu_primes_table, randomMul, b_max,
-                                                                         b_start, b_jump,
-                                                                         gpu_completed,
-                                                                         gpu_result);
-
-    if (cudaSuccess != (err = cudaDeviceSynchronize()))
-        fprintf(stderr, "Unable to synchronize device!\nError [%d]%s\n", (int) err, cudaGetErrorString(err));
+    if (plan.reduce) { // the sources belong to a multiple of n
+        const unsigned blocks_num = (plan.count * params::TPI + THREADS_PER_BLOCK - 1) / THREADS_PER_BLOCK;
+        reduce_residues_kernel<params><<<blocks_num, threads_per_block, 0, stream>>>(
+                (cgbn_error_report_t *) slot.report_device, gpu_n, (residue_record_t<params> *) plan.sources,
+                plan.count);
+    }
+    {
+        TRACE_SCOPE("kernel_launch");
+        MetricTimer launch_timer(METRIC_KERNEL_LAUNCH);
+#ifdef PERSISTENT_THREADS
+        // just enough resident blocks to fill the device, work_counter is the shared work counter
+        const unsigned instances_per_block = THREADS_PER_BLOCK / params::TPI;
+        int device_id, sm_count, blocks_per_sm;
+        cudaGetDevice(&device_id);
+        cudaDeviceGetAttribute(&sm_count, cudaDevAttrMultiProcessorCount, device_id);
+        cudaOccupancyMaxActiveBlocksPerMultiprocessor(&blocks_per_sm, persistent_factorize_kernel<params>,
+                                                      threads_per_block, 0);
+        unsigned blocks_num = (unsigned) (sm_count * (blocks_per_sm > 0 ? blocks_per_sm : 1));
+        const unsigned blocks_needed = (steps + instances_per_block - 1) / instances_per_block;
+        if (blocks_num > blocks_needed) blocks_num = blocks_needed > 0 ? blocks_needed : 1;
+        persistent_factorize_kernel<params><<<blocks_num, threads_per_block, 0, stream>>>(
+                (cgbn_error_report_t *) slot.report_device, gpu_n, context.primes(), groups, launch, schedule,
+                slot.work_counter, slot.completed_device, gpu_result);
+#else
+        unsigned randomMul = 4123457; //+ 1000 * rand() + rand();
+        unsigned blocks_num = (steps * params::TPI + THREADS_PER_BLOCK - 1) / THREADS_PER_BLOCK;
+        parallel_factorize_kernel<params><<<blocks_num, threads_per_block, 0, stream>>>(
+                (cgbn_error_report_t *) slot.report_device, gpu_n, context.primes(), groups, launch, randomMul,
+                schedule, slot.completed_device, gpu_result);
+#endif
+    }
 
-    CGBN_CHECK(report);
+    cudaError_t err;
+    if (cudaSuccess != (err = cudaGetLastError())) {
+        fprintf(stderr, "Unable to launch the kernel!\nError [%d]%s\n", (int) err, cudaGetErrorString(err));
+        return discard();
+    }
 
-    if (cudaSuccess != (err = cudaMemcpy(&completed, gpu_completed, sizeof(bool), cudaMemcpyDeviceToHost))) {
-        fprintf(stderr, "Unable to retrieve finished flag from host!\nError [%d]%s\n", (int) err,
-                cudaGetErrorString(err));
-        return -1;
+    // the result and the work position come back through the slot's pinned staging
+    if (device.copy_async(slot.staging, gpu_result, result_size, COPY_DEVICE_TO_HOST, slot.stream) != 0 ||
+        device.copy_async(slot.staging + result_size, slot.work_counter, sizeof(unsigned), COPY_DEVICE_TO_HOST,
+                          slot.stream) != 0) {
+        return discard();
     }
 
-    if (cudaSuccess != (err = cudaMemcpy(&start, gpu_start, sizeof(start), cudaMemcpyDeviceToHost))) {
-        fprintf(stderr, "Unable to retrieve work position from host!\nError [%d]%s\n", (int) err,
-                cudaGetErrorString(err));
-        return -1;
+    int synchronized;
+    {
+        TRACE_SCOPE("device_sync");
+        MetricTimer sync_timer(METRIC_KERNEL_SYNC);
+        synchronized = device.stream_synchronize(slot.stream);
     }
+    if (synchronized != 0) return discard();
+    if (cancel != nullptr) cancel->detach();
 
-    if (cudaSuccess != (err = cudaMemcpy(&cpu_result, gpu_result, result_size, cudaMemcpyDeviceToHost))) {
-        fprintf(stderr, "Unable to retrieve result from host!\nError [%d]%s\n", (int) err, cudaGetErrorString(err));
-        return -1;
+    if (CGBN_CHECK(report) != 0) { // the records of a failed launch are not kept
+        discard();
+        return GPU_DEVICE_ERROR;
     }
 
+    // this launch's residues replace the ones it extended
+    context.release(gpu_result);
+    context.release(source);
+    context.release(plan.sources);
+    context.residues().store(n, params::BITS, step_b, records, released);
+    for (void *buffer : released) context.release(buffer);
+
+    memcpy(&cpu_result, slot.staging, result_size);
+    memcpy(&start, slot.staging + result_size, sizeof(unsigned));
+
     to_mpz(*factor, cpu_result.factor._limbs, params::BITS / 32);
-    printf("Found with B: %d\n", cpu_result.b);
+    if (cpu_result.b == 0 && cancel != nullptr && cancel->cancelled()) {
+        log_printf("GPU search cancelled after %u B values\n", start);
+        *b_found = 0;
+        return 0;
+    }
+#ifdef PERSISTENT_THREADS
+    log_printf("Found with B: %d (%u B values claimed)\n", cpu_result.b, start);
+#else
+    log_printf("Found with B: %d\n", cpu_result.b);
+#endif
     *b_found = cpu_result.b;
 
-    if (gpu_result != nullptr) cudaFree(gpu_result);
-    if (gpu_completed != nullptr) cudaFree(gpu_completed);
-    if (gpu_completed != nullptr) cgbn_error_report_free(report);
-
     return 0;
 }
 
-int gpu_factorize(mpz_t n,
-                  const unsigned int *primes_table,
-                  const unsigned primes_num,
-                  unsigned b_max,
-                  unsigned b_start,
-                  unsigned b_jump,
+int gpu_factorize(GpuContext &context,
+                  mpz_t n,
+                  const b_schedule_t &schedule,
                   mpz_t *factor,
-                  unsigned *b_found) {
-    if (n->_mp_size < 2) {
-        typedef pollard_params_t<4, 128> params;
-        return parallel_factorize_param<params>(n, primes_table, primes_num, b_max, b_start, b_jump, factor, b_found);
-    } else if (n->_mp_size < 4) {
-        typedef pollard_params_t<8, 256> params;
-        return parallel_factorize_param<params>(n, primes_table, primes_num, b_max, b_start, b_jump, factor, b_found);
-    } else if (n->_mp_size < 8) {
-        typedef pollard_params_t<16, 512> params;
-        return parallel_factorize_param<params>(n, primes_table, primes_num, b_max, b_start, b_jump, factor, b_found);
-    } else if (n->_mp_size < 16) {
-        typedef pollard_params_t<32, 1024> params;
-        return parallel_factorize_param<params>(n, primes_table, primes_num, b_max, b_start, b_jump, factor, b_found);
-    } else {
-        typedef pollard_params_t<32, 2048> params;
-        return parallel_factorize_param<params>(n, primes_table, primes_num, b_max, b_start, b_jump, factor, b_found);
+                  unsigned *b_found,
+                  ExponentCache *exponents,
+                  GpuCancel *cancel) {
+    if (!width_class_fits(n)) {
+        fprintf(stderr, "Input of %u bits exceeds the widest GPU instance (%u bits)\n",
+                (unsigned) mpz_sizeinbase(n, 2), width_class_bits[WIDTH_CLASSES - 1]);
+        return -1;
+    }
+
+    // CGBN splits an instance evenly over its TPI threads, so BITS is a multiple of 32 * TPI; the classes
+    // between two such widths (96, 192, 384 and 768 bits) run on the next wider instance
+    switch (width_class_of(n)) {
+        case 0:
+        case 1: {
+            typedef pollard_params_t<4, 128> params;
+            return parallel_factorize_param<params>(context, n, schedule, factor, b_found, exponents, cancel);
+        }
+        case 2:
+        case 3: {
+            typedef pollard_params_t<8, 256> params;
+            return parallel_factorize_param<params>(context, n, schedule, factor, b_found, exponents, cancel);
+        }
+        case 4:
+        case 5: {
+            typedef pollard_params_t<16, 512> params;
+            return parallel_factorize_param<params>(context, n, schedule, factor, b_found, exponents, cancel);
+        }
+        case 6:
+        case 7: {
+            typedef pollard_params_t<32, 1024> params;
+            return parallel_factorize_param<params>(context, n, schedule, factor, b_found, exponents, cancel);
+        }
+        case 8: {
+            typedef pollard_params_t<32, 2048> params;
+            return parallel_factorize_param<params>(context, n, schedule, factor, b_found, exponents, cancel);
+        }
+        case 9: {
+            typedef pollard_params_t<32, 4096> params;
+            return parallel_factorize_param<params>(context, n, schedule, factor, b_found, exponents, cancel);
+        }
+        default: {
+            typedef pollard_params_t<32, 8192> params;
+            return parallel_factorize_param<params>(context, n, schedule, factor, b_found, exponents, cancel);
+        }
     }
 }
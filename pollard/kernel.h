@@ -3,20 +3,38 @@
 
 #include <gmp.h>
 
+#include "b_schedule.h"
+#include "exponent_cache.h"
+
 #define MAX_PRIMES 20000000
+#define GPU_DEVICE_ERROR -2 // an instance reported a CGBN error, the input ends with POLLARD_ERROR
 
 typedef unsigned long ULong;
 
-int gpu_factorize(mpz_t n, const unsigned int *primes_table, const unsigned primes_num, unsigned b_max,
-                  unsigned b_start,
-                  unsigned b_jump,
+class GpuContext;
+
+class GpuCancel;
+
+// factor 0 when the schedule ran out or `cancel` stopped the launch first; -1 when the launch could
+// not be made, GPU_DEVICE_ERROR when the device reported an error
+int gpu_factorize(GpuContext &context,
+                  mpz_t n,
+                  const b_schedule_t &schedule,
                   mpz_t *factor,
-                  unsigned *b_found);
+                  unsigned *b_found,
+                  ExponentCache *exponents = nullptr,
+                  GpuCancel *cancel = nullptr);
 
 int cudaInitialize();
 
-unsigned *allocate_primes(const unsigned prime_table[], const unsigned primes_num);
+// picks the fastest device and uploads the prime table, nullptr on failure
+GpuContext *gpu_context_create(const unsigned prime_table[], const unsigned primes_num);
 
-int free_primes(unsigned *dev_primes);
+// the two entry points a GPU backend drives, tests point them at a search over HostDeviceApi
+struct gpu_backend_t {
+    GpuContext *(*create)(const unsigned prime_table[], const unsigned primes_num);
+    int (*search)(GpuContext &context, mpz_t n, const b_schedule_t &schedule, mpz_t *factor, unsigned *b_found,
+                  ExponentCache *exponents, GpuCancel *cancel);
+};
 
 #endif /* __KERNEL_H__ */
@@ -0,0 +1,358 @@
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <gmp.h>
+
+#include "libpollard.h"
+#include "checkpoint.h"
+#include "factor_algorithm.h"
+#include "factor_job.h"
+#include "kernel.h"
+#include "planner.h"
+#include "width_class.h"
+#include "../common/factor_db.h"
+#include "../common/get_timestamp.h"
+#include "../common/gmp_arena.h"
+#include "../common/hex.h"
+#include "../common/job_scheduler.h"
+#include "../common/metrics.h"
+#include "../common/numa.h"
+#include "../common/prime_table.h"
+#include "../common/thread_pool.h"
+#include "../common/trace.h"
+
+struct pollard_context {
+    FactorAlgorithm *alg = nullptr;
+    cost_model_t cost_model;
+    std::unique_ptr<CheckpointStore> checkpoints;
+    std::unique_ptr<FactorDb> factor_db;
+    std::unique_ptr<JobScheduler> scheduler;
+    std::string trace_file;
+
+    // the prime table and the backend are set up by the first input the factor db cannot answer
+    std::mutex init_lock;
+    bool initialized = false;
+    int init_status = 0;
+    unsigned *prime_table = nullptr;
+};
+
+static char *copy_string(const std::string &text) {
+    auto *copy = (char *) malloc(text.size() + 1);
+    memcpy(copy, text.c_str(), text.size() + 1);
+    return copy;
+}
+
+static bool is_hex(const char *number) {
+    return number != nullptr && number[0] != '\0' && strspn(number, "0123456789abcdefABCDEF") == strlen(number);
+}
+
+static int prepare_backend(pollard_context_t *context) {
+    std::lock_guard<std::mutex> guard(context->init_lock);
+    if (context->initialized) return context->init_status;
+    context->initialized = true;
+    context->init_status = -1;
+
+    unsigned primes_num = MAX_PRIMES;
+    context->prime_table = (unsigned *) calloc(primes_num, sizeof(unsigned));
+    int table_status;
+    {
+        MetricTimer timer(METRIC_PRIME_TABLE);
+        table_status = generate_prime_table(context->prime_table, primes_num);
+    }
+    if (table_status != 0 || context->alg->initialize(context->prime_table, primes_num) != 0) {
+        free(context->prime_table);
+        context->prime_table = nullptr;
+        return -1;
+    }
+
+    context->init_status = 0;
+    return 0;
+}
+
+// scheduler class and relative stage 1 cost of an input, before its job runs
+static void classify_input(const char *number, bool minus_one, const cost_model_t *cost_model,
+                           unsigned *job_class, double *cost) {
+    mpz_t n;
+    mpz_init_set_str(n, number, 16);
+    if (minus_one) mpz_sub_ui(n, n, 1);
+
+    const auto bits = (double) mpz_sizeinbase(n, 2);
+    *job_class = width_class_of(n);
+    // the B range is the same for every input, the cost per exponent bit decides
+    *cost = cost_model != nullptr ? cost_model_ns_per_bit(*cost_model, (unsigned) bits) : bits * bits;
+    mpz_clear(n);
+}
+
+static void make_result(FactorJob &job, int status, long long elapsed_us, pollard_result_t *result) {
+    result->status = status;
+    result->number = copy_string(to_hex(job.n));
+    result->factor_count = job.factors.size();
+    result->factors = (pollard_factor_t *) calloc(job.factors.size() + 1, sizeof(pollard_factor_t));
+    for (size_t i = 0; i < job.factors.size(); i++) {
+        result->factors[i].prime = copy_string(to_hex(job.factors.prime(i)));
+        result->factors[i].power = job.factors.power(i);
+    }
+    result->elapsed_us = elapsed_us;
+    result->log = copy_string(job.log);
+}
+
+// `done` may take over the result, whatever it leaves behind is released afterwards
+static int submit_job(pollard_context_t *context, const char *number, unsigned flags, int priority,
+                      std::function<void(pollard_result_t &)> done) {
+    if (!is_hex(number)) {
+        return -1;
+    }
+
+    const bool minus_one = (flags & POLLARD_MINUS_ONE) != 0;
+    unsigned job_class;
+    double cost;
+    classify_input(number, minus_one, context->alg->cost_model, &job_class, &cost);
+
+    const std::string input(number);
+    return context->scheduler->submit(job_class, priority, cost, [context, input, minus_one, done]() {
+        TRACE_SCOPE("job");
+        FactorJob job(input.c_str(), minus_one);
+        FactorDb *factor_db = context->factor_db.get();
+
+        const long long start = get_timestamp();
+        int status;
+        if (factor_db != nullptr && job.lookup(factor_db)) {
+            status = POLLARD_FACTORED;
+        } else if (prepare_backend(context) != 0) {
+            mpz_set_str(job.n, input.c_str(), 16);
+            if (minus_one) mpz_sub_ui(job.n, job.n, 1);
+            job.log = "Backend initialization failed\n";
+            status = POLLARD_ERROR;
+        } else {
+            job.run(context->alg, factor_db);
+            if (job.device_error) {
+                status = POLLARD_ERROR;
+            } else {
+                status = job.complete() ? POLLARD_FACTORED : (job.factored ? POLLARD_PARTIAL : POLLARD_FAILED);
+            }
+        }
+        metrics_input_done((unsigned) mpz_sizeinbase(job.n, 2), status == POLLARD_FACTORED || status == POLLARD_PARTIAL);
+
+        pollard_result_t result;
+        make_result(job, status, get_timestamp() - start, &result);
+        done(result);
+        pollard_result_free(&result);
+    }, true);
+}
+
+void pollard_options_init(pollard_options_t *options) {
+    memset(options, 0, sizeof(*options));
+    options->struct_size = sizeof(*options);
+    options->search_threads = 1;
+    options->schedule = -1;
+    options->checkpoint_interval_s = CHECKPOINT_INTERVAL_US / 1000000;
+    options->queue_capacity = SCHEDULER_CAPACITY;
+}
+
+pollard_context_t *pollard_create(const pollard_options_t *caller_options) {
+    // fields past the caller's structure keep their defaults
+    const size_t base_size = offsetof(pollard_options_t, trace_file);
+    if (caller_options->struct_size < base_size || caller_options->struct_size > sizeof(pollard_options_t)) {
+        fprintf(stderr, "pollard_create: options of %lu bytes, expected %lu to %lu, use pollard_options_init\n",
+                (unsigned long) caller_options->struct_size, (unsigned long) base_size,
+                (unsigned long) sizeof(pollard_options_t));
+        return nullptr;
+    }
+    pollard_options_t local_options;
+    pollard_options_init(&local_options);
+    memcpy(&local_options, caller_options, caller_options->struct_size);
+    const pollard_options_t *options = &local_options;
+
+    if (options->gmp_arena) gmp_arena_install();
+
+    auto *context = new pollard_context_t;
+    if (options->trace_file != nullptr) {
+        context->trace_file = options->trace_file;
+        trace_enable();
+    }
+
+    CPUFactorAlgorithm *serial_cpu = nullptr; // the serial CPU backend, which batches narrow inputs
+    if (options->hybrid) {
+        auto hybrid_alg = new HybridFactorAlgorithm;
+        hybrid_alg->threads = options->search_threads;
+        if (options->checkpoint_dir != nullptr) {
+            fprintf(stderr, "Checkpoints are only kept by the CPU backend, ignoring -checkpoint\n");
+        }
+        context->alg = hybrid_alg;
+    } else if (!options->use_cpu) {
+        context->alg = new GPUFactorAlgorithm;
+        if (options->checkpoint_dir != nullptr) {
+            fprintf(stderr, "Checkpoints are only kept by the CPU backend, ignoring -checkpoint\n");
+        }
+    } else if (options->host_kernel) {
+        auto host_alg = new HostKernelFactorAlgorithm;
+        host_alg->threads = options->search_threads;
+        if (options->checkpoint_dir != nullptr) {
+            fprintf(stderr, "Checkpoints are only kept by the CPU backend, ignoring -checkpoint\n");
+        }
+        context->alg = host_alg;
+    } else {
+        auto cpu_alg = new CPUFactorAlgorithm;
+        cpu_alg->threads = options->search_threads;
+        if (options->checkpoint_dir != nullptr) {
+            context->checkpoints.reset(new CheckpointStore(options->checkpoint_dir,
+                                                           options->checkpoint_interval_s * 1000000));
+            cpu_alg->checkpoints = context->checkpoints.get();
+        } else if (cpu_alg->threads <= 1) {
+            serial_cpu = cpu_alg;
+        }
+        context->alg = cpu_alg;
+    }
+
+    context->alg->numa = !options->no_numa;
+    context->alg->fixed_schedule = options->schedule >= 0;
+    if (options->schedule >= 0) context->alg->schedule_kind = (b_schedule_kind_t) options->schedule;
+    if (options->deadline_ms > 0) {
+        const char *file = options->cost_model_file;
+        if (file == nullptr || cost_model_load(&context->cost_model, file) != 0) {
+            // stdout belongs to the host program, progress goes with the diagnostics
+            fprintf(stderr, "Calibrating modexp cost model...");
+            cost_model_calibrate(&context->cost_model);
+            fprintf(stderr, " done\n");
+            if (file != nullptr) cost_model_save(context->cost_model, file);
+        }
+        context->alg->cost_model = &context->cost_model;
+        context->alg->budget_us = options->deadline_ms * 1000;
+        context->alg->plan_workers = options->use_cpu && context->checkpoints == nullptr
+                                     ? options->search_threads : 1;
+    }
+
+    if (options->factor_db_file != nullptr) {
+        context->factor_db.reset(new FactorDb);
+        if (context->factor_db->open(options->factor_db_file) != 0) {
+            pollard_destroy(context);
+            return nullptr;
+        }
+        context->alg->factor_db = context->factor_db.get();
+    }
+
+    const unsigned threads = options->job_threads > 0 ? options->job_threads : default_worker_count();
+    const unsigned nodes = options->no_numa ? 1 : numa_node_count();
+    context->scheduler.reset(new JobScheduler(threads, WIDTH_CLASSES, options->queue_capacity, nodes));
+    if (serial_cpu != nullptr && threads > 1) {
+        // jobs of one width queued together run their stage 1 as one batch
+        serial_cpu->queued_jobs = [context](unsigned job_class) {
+            return context->scheduler->stats(job_class).depth;
+        };
+    }
+    return context;
+}
+
+int pollard_prepare(pollard_context_t *context) {
+    return prepare_backend(context);
+}
+
+void pollard_destroy(pollard_context_t *context) {
+    if (context == nullptr) return;
+
+    context->scheduler.reset(); // finishes the queued jobs
+    if (!context->trace_file.empty()) {
+        trace_write(context->trace_file.c_str());
+    }
+    if (context->prime_table != nullptr) {
+        context->alg->clean();
+        free(context->prime_table);
+    }
+    delete context->alg;
+    delete context;
+}
+
+int pollard_factor(pollard_context_t *context, const char *number, unsigned flags, pollard_result_t *result) {
+    return pollard_factor_many(context, &number, 1, flags, result);
+}
+
+int pollard_factor_many(pollard_context_t *context, const char *const *numbers, size_t count, unsigned flags,
+                        pollard_result_t *results) {
+    for (size_t i = 0; i < count; i++) {
+        if (!is_hex(numbers[i])) return -1;
+    }
+
+    std::mutex lock;
+    std::condition_variable finished;
+    size_t remaining = count;
+
+    for (size_t i = 0; i < count; i++) {
+        const int submitted = submit_job(context, numbers[i], flags, 0, [&, i](pollard_result_t &result) {
+            results[i] = result;
+            memset(&result, 0, sizeof(result)); // now owned by the caller
+            std::lock_guard<std::mutex> guard(lock);
+            if (--remaining == 0) finished.notify_one();
+        });
+        if (submitted != 0) {
+            // never queued, reported like a backend that failed to start
+            memset(&results[i], 0, sizeof(results[i]));
+            results[i].status = POLLARD_ERROR;
+            results[i].number = copy_string(numbers[i]);
+            results[i].log = copy_string("Job could not be queued\n");
+            std::lock_guard<std::mutex> guard(lock);
+            remaining--;
+        }
+    }
+
+    std::unique_lock<std::mutex> guard(lock);
+    finished.wait(guard, [&]() { return remaining == 0; });
+    return 0;
+}
+
+int pollard_submit(pollard_context_t *context, const char *number, unsigned flags, int priority,
+                   pollard_callback_t callback, void *user) {
+    return submit_job(context, number, flags, priority, [callback, user](pollard_result_t &result) {
+        callback(user, &result);
+    });
+}
+
+void pollard_wait(pollard_context_t *context) {
+    context->scheduler->wait();
+}
+
+size_t pollard_stats(pollard_context_t *context, pollard_class_stats_t *stats, size_t max) {
+    const size_t classes = context->scheduler->classes();
+    size_t count = 0;
+    for (unsigned c = 0; c < classes && count < max; c++, count++) {
+        const job_class_stats_t source = context->scheduler->stats(c);
+        pollard_class_stats_t &target = stats[count];
+        target.bits = width_class_bits[c];
+        target.depth = source.depth;
+        target.max_depth = source.max_depth;
+        target.submitted = source.submitted;
+        target.completed = source.completed;
+        target.rejected = source.rejected;
+        target.wait_total_us = source.wait_total_us;
+        target.wait_max_us = source.wait_max_us;
+        target.run_total_us = source.run_total_us;
+        target.run_max_us = source.run_max_us;
+    }
+    return count;
+}
+
+size_t pollard_metrics(char *buffer, size_t size) {
+    const std::string text = metrics_prometheus();
+    if (size > 0) {
+        const size_t copied = text.size() < size - 1 ? text.size() : size - 1;
+        memcpy(buffer, text.data(), copied);
+        buffer[copied] = '\0';
+    }
+    return text.size();
+}
+
+void pollard_result_free(pollard_result_t *result) {
+    if (result->factors != nullptr) {
+        for (size_t i = 0; i < result->factor_count; i++) free(result->factors[i].prime);
+        free(result->factors);
+    }
+    free(result->number);
+    free(result->log);
+    memset(result, 0, sizeof(*result));
+}
@@ -0,0 +1,126 @@
+#ifndef __LIBPOLLARD_H__
+#define __LIBPOLLARD_H__
+
+/*
+ * C interface of the factoring library. A context owns the prime table, the
+ * backend (GPU or CPU), the factor db and the job scheduler; it is set up once
+ * and shared by any number of threads. Numbers are passed and returned as hex
+ * strings so callers need neither GMP nor C++.
+ *
+ *   pollard_options_t options;
+ *   pollard_options_init(&options);
+ *   pollard_context_t *context = pollard_create(&options);
+ *   pollard_result_t result;
+ *   if (pollard_factor(context, "af53955826884e6377970d", 0, &result) == 0) {
+ *       ... result.factors[i].prime ^ result.factors[i].power ...
+ *       pollard_result_free(&result);
+ *   }
+ *   pollard_destroy(context);
+ */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define POLLARD_API_VERSION 2
+
+#define POLLARD_MINUS_ONE 1u // factor N - 1 instead of N
+
+enum pollard_status_t {
+    POLLARD_ERROR = -1,   // the backend could not be initialized or the device reported an error
+    POLLARD_FACTORED = 0, // the factors multiply back to N
+    POLLARD_PARTIAL = 1,  // some factors found, a cofactor remains
+    POLLARD_FAILED = 2,   // no factor found
+};
+
+/*
+ * Set up by pollard_options_init, which records the size of the structure the
+ * caller was compiled against. New fields are only ever appended: a library
+ * reads the fields that fit in struct_size and defaults the rest, and rejects
+ * options larger than the structure it knows.
+ */
+typedef struct pollard_options {
+    size_t struct_size;              // sizeof(pollard_options_t) of the caller
+    int use_cpu;                     // host backend instead of the GPU
+    unsigned job_threads;            // inputs factored concurrently, 0 for one per core
+    unsigned search_threads;         // CPU workers per input
+    int schedule;                    // b_schedule_kind_t, -1 picks one per input size
+    long long deadline_ms;           // per input, 0 for none
+    const char *cost_model_file;     // planner cost model for deadlines, calibrated when missing
+    const char *checkpoint_dir;      // stage 1 checkpoints of the CPU backend
+    long long checkpoint_interval_s;
+    const char *factor_db_file;
+    unsigned queue_capacity;         // queued inputs before submissions wait
+    const char *trace_file;          // Chrome trace-event timeline written by pollard_destroy, NULL for none
+    int host_kernel;                 // with use_cpu: the GPU kernel's search on search_threads host workers
+    int hybrid;                      // GPU and search_threads CPU workers on every input, CPU only without a device
+    int no_numa;                     // one job queue and one prime table for all NUMA nodes
+    int gmp_arena;                   // per-job GMP arenas, replaces GMP's memory functions for the whole process
+} pollard_options_t;
+
+typedef struct pollard_factor {
+    char *prime; // hex
+    unsigned power;
+} pollard_factor_t;
+
+typedef struct pollard_result {
+    int status; // pollard_status_t
+    char *number; // hex of the factored number
+    size_t factor_count;
+    pollard_factor_t *factors;
+    long long elapsed_us;
+    char *log;  // progress output of the job
+} pollard_result_t;
+
+typedef struct pollard_class_stats {
+    unsigned bits; // kernel width class
+    unsigned depth;
+    unsigned max_depth;
+    unsigned long long submitted;
+    unsigned long long completed;
+    unsigned long long rejected;
+    long long wait_total_us;
+    long long wait_max_us;
+    long long run_total_us;
+    long long run_max_us;
+} pollard_class_stats_t;
+
+typedef struct pollard_context pollard_context_t;
+
+// called on a worker thread, the result is released when the callback returns
+typedef void (*pollard_callback_t)(void *user, const pollard_result_t *result);
+
+void pollard_options_init(pollard_options_t *options);
+
+pollard_context_t *pollard_create(const pollard_options_t *options);
+
+// sets up the prime table and the backend now instead of on the first input the factor db cannot answer
+int pollard_prepare(pollard_context_t *context);
+
+void pollard_destroy(pollard_context_t *context);
+
+int pollard_factor(pollard_context_t *context, const char *number, unsigned flags, pollard_result_t *result);
+
+// -1 when an input is not hex; otherwise every result is filled, POLLARD_ERROR for an input that could not be queued
+int pollard_factor_many(pollard_context_t *context, const char *const *numbers, size_t count, unsigned flags,
+                        pollard_result_t *results);
+
+int pollard_submit(pollard_context_t *context, const char *number, unsigned flags, int priority,
+                   pollard_callback_t callback, void *user);
+
+void pollard_wait(pollard_context_t *context);
+
+size_t pollard_stats(pollard_context_t *context, pollard_class_stats_t *stats, size_t max);
+
+// hot path metrics of the process in Prometheus text format, returns the full length like snprintf
+size_t pollard_metrics(char *buffer, size_t size);
+
+void pollard_result_free(pollard_result_t *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LIBPOLLARD_H__ */
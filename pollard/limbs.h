@@ -0,0 +1,14 @@
+#ifndef __LIMBS_H__
+#define __LIMBS_H__
+
+#include <cstdint>
+
+#include <gmp.h>
+
+// little-endian 32-bit limb arrays of the CGBN kernels
+void to_mpz(mpz_t r, const uint32_t *x, uint32_t count);
+
+// zero-extends to count limbs, exits when s does not fit
+void from_mpz(mpz_t s, uint32_t *x, uint32_t count);
+
+#endif /* __LIMBS_H__ */
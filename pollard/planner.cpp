@@ -0,0 +1,164 @@
+#include <cmath>
+#include <cstdio>
+
+#include <gmp.h>
+
+#include "planner.h"
+#include "../common/get_timestamp.h"
+
+#define CALIBRATION_EXPONENT_BITS 2048
+#define CALIBRATION_MIN_US 20000
+
+static const unsigned calibration_bits[] = {64, 128, 256, 512, 1024, 2048, 4096};
+
+int cost_model_calibrate(cost_model_t *model) {
+    model->bits.clear();
+    model->ns_per_bit.clear();
+
+    gmp_randstate_t state;
+    gmp_randinit_mt(state);
+    gmp_randseed_ui(state, 1);
+
+    mpz_t n, a, e, r;
+    mpz_init(n);
+    mpz_init(a);
+    mpz_init(e);
+    mpz_init(r);
+
+    for (unsigned bits : calibration_bits) {
+        mpz_urandomb(n, state, bits);
+        mpz_setbit(n, bits - 1);
+        mpz_setbit(n, 0);
+        mpz_urandomm(a, state, n);
+        mpz_urandomb(e, state, CALIBRATION_EXPONENT_BITS);
+        mpz_setbit(e, CALIBRATION_EXPONENT_BITS - 1);
+
+        unsigned reps = 0;
+        const long long start = get_timestamp();
+        long long elapsed;
+        do {
+            mpz_powm(r, a, e, n);
+            reps++;
+            elapsed = get_timestamp() - start;
+        } while (elapsed < CALIBRATION_MIN_US);
+
+        model->bits.push_back(bits);
+        model->ns_per_bit.push_back(elapsed * 1000.0 / reps / CALIBRATION_EXPONENT_BITS);
+    }
+
+    mpz_clear(n);
+    mpz_clear(a);
+    mpz_clear(e);
+    mpz_clear(r);
+    gmp_randclear(state);
+    return 0;
+}
+
+// one "bits ns_per_exponent_bit" pair per line, increasing bits
+int cost_model_load(cost_model_t *model, const char *filename) {
+    FILE *file = fopen(filename, "r");
+    if (file == nullptr) {
+        return -1;
+    }
+
+    model->bits.clear();
+    model->ns_per_bit.clear();
+
+    unsigned bits;
+    double ns;
+    while (fscanf(file, "%u %lf", &bits, &ns) == 2) {
+        if (!model->bits.empty() && bits <= model->bits.back()) {
+            fprintf(stderr, "Cost model %s: sizes must be increasing\n", filename);
+            fclose(file);
+            return -1;
+        }
+        model->bits.push_back(bits);
+        model->ns_per_bit.push_back(ns);
+    }
+    fclose(file);
+
+    if (model->bits.empty()) {
+        fprintf(stderr, "Cost model %s is empty\n", filename);
+        return -1;
+    }
+    return 0;
+}
+
+int cost_model_save(const cost_model_t &model, const char *filename) {
+    FILE *file = fopen(filename, "w");
+    if (file == nullptr) {
+        fprintf(stderr, "Unable to write cost model: %s\n", filename);
+        return -1;
+    }
+    for (size_t i = 0; i < model.bits.size(); i++) {
+        fprintf(file, "%u %.6f\n", model.bits[i], model.ns_per_bit[i]);
+    }
+    fclose(file);
+    return 0;
+}
+
+double cost_model_ns_per_bit(const cost_model_t &model, unsigned bits) {
+    const size_t count = model.bits.size();
+    if (count == 0) return 0;
+    if (count == 1) return model.ns_per_bit[0];
+
+    // interpolate (or extrapolate from the nearest segment) in log-log space
+    size_t i = 1;
+    while (i < count - 1 && model.bits[i] < bits) i++;
+
+    const double x0 = log((double) model.bits[i - 1]), x1 = log((double) model.bits[i]);
+    const double y0 = log(model.ns_per_bit[i - 1]), y1 = log(model.ns_per_bit[i]);
+    const double x = log((double) (bits > 0 ? bits : 1));
+    return exp(y0 + (y1 - y0) * (x - x0) / (x1 - x0));
+}
+
+// probability that a random integer x is x^(1/u)-smooth
+double dickman_rho(double u) {
+    if (u <= 1) return 1;
+    if (u <= 2) return 1 - log(u);
+
+    // rho'(u) = -rho(u - 1) / u, integrated from the closed form on [1, 2]
+    const int steps_per_unit = 64;
+    const double h = 1.0 / steps_per_unit;
+    std::vector<double> rho;
+    for (int i = 0; i <= steps_per_unit; i++) rho.push_back(1 - log(1 + i * h));
+
+    const int total = (int) ceil((u - 1) * steps_per_unit);
+    for (int i = steps_per_unit + 1; i <= total; i++) {
+        const double v = 1 + i * h;
+        const double prev = rho[i - steps_per_unit], prev_mid = rho[i - 1 - steps_per_unit];
+        rho.push_back(rho[i - 1] - h * (prev / v + prev_mid / (v - h)) / 2);
+    }
+    return rho.back() > 0 ? rho.back() : 0;
+}
+
+factor_plan_t plan_for_deadline(const cost_model_t &model, const b_schedule_t &schedule, unsigned bits,
+                                unsigned workers, long long budget_us, bool incremental) {
+    factor_plan_t plan;
+    plan.b2 = 0;
+    plan.passes = 1;
+
+    const double us_per_b = EXPONENT_BITS_PER_B * cost_model_ns_per_bit(model, bits) / 1000.0;
+    if (workers < 1) workers = 1;
+
+    // largest B1 whose schedule prefix completes within the budget on the given workers
+    double elapsed_us = 0;
+    unsigned B, b1 = schedule.b_start;
+    for (unsigned step = 0; b_schedule_at(schedule, step, &B); step++) {
+        const double next = incremental ? B * us_per_b : elapsed_us + B * us_per_b / workers;
+        if (next > budget_us) break;
+        elapsed_us = next;
+        b1 = B;
+    }
+
+    plan.b1 = b1;
+    plan.expected_us = (long long) elapsed_us;
+    if (b1 >= schedule.b_max && elapsed_us > 0) {
+        const double passes = budget_us / elapsed_us;
+        plan.passes = passes >= PLAN_MAX_PASSES ? PLAN_MAX_PASSES : (passes >= 1 ? (unsigned) passes : 1);
+    }
+
+    const double factor_log = (bits / 2) * log(2.0);
+    plan.success = b1 > 1 ? dickman_rho(factor_log / log((double) b1)) : 0;
+    return plan;
+}
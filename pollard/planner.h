@@ -0,0 +1,46 @@
+#ifndef __PLANNER_H__
+#define __PLANNER_H__
+
+#include <vector>
+
+#include "b_schedule.h"
+
+#define EXPONENT_BITS_PER_B 1.4427 // log2(E(B)) ~ B / ln 2
+#define PLAN_MAX_PASSES 8          // driver retries with a halved b_jump
+
+/*
+ * Modular exponentiation cost per exponent bit, sampled at a few modulus sizes
+ * and interpolated in between (log-log).
+ */
+struct cost_model_t {
+    std::vector<unsigned> bits;
+    std::vector<double> ns_per_bit;
+};
+
+int cost_model_calibrate(cost_model_t *model);
+
+int cost_model_load(cost_model_t *model, const char *filename);
+
+int cost_model_save(const cost_model_t &model, const char *filename);
+
+double cost_model_ns_per_bit(const cost_model_t &model, unsigned bits);
+
+/*
+ * Stage 1 parameters for one input under a time budget. b2 stays 0, there is no
+ * stage 2 in this tree.
+ */
+struct factor_plan_t {
+    unsigned b1;
+    unsigned b2;
+    unsigned passes;       // schedule passes (distinct B grids and bases) that fit in the budget
+    double success;        // estimated chance that a factor of half the input size is B1-smooth
+    long long expected_us; // predicted duration of one pass
+};
+
+// incremental: one residue is extended step by step (serial CPU stage 1), otherwise every step starts over
+factor_plan_t plan_for_deadline(const cost_model_t &model, const b_schedule_t &schedule, unsigned bits,
+                                unsigned workers, long long budget_us, bool incremental = false);
+
+double dickman_rho(double u);
+
+#endif /* __PLANNER_H__ */
@@ -0,0 +1,89 @@
+#include <algorithm>
+
+#include "residue_store.h"
+#include "stage1_instance.h"
+#include "../common/hex.h"
+
+ResidueStore::ResidueStore(unsigned max_sets, unsigned max_records)
+        : max_sets(max_sets > 0 ? max_sets : 1), max_records(max_records > 0 ? max_records : 1) {
+}
+
+unsigned ResidueStore::stride(unsigned steps) const {
+    return residue_stride(steps, max_records);
+}
+
+unsigned ResidueStore::records(unsigned steps) const {
+    return steps / stride(steps);
+}
+
+void ResidueStore::plan(mpz_t n, unsigned bits, const std::vector<unsigned> &steps, residue_plan_t *plan,
+                        std::vector<void *> &released) {
+    plan->sources = nullptr;
+    plan->count = 0;
+    plan->reduce = false;
+    plan->source.assign(steps.size(), -1);
+
+    const std::string key = to_hex(n);
+    residue_set_t taken;
+    bool found = false;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        mpz_t multiple;
+        mpz_init(multiple);
+        for (auto it = sets.begin(); it != sets.end(); ++it) {
+            bool exact = it->n == key;
+            if (!exact) {
+                mpz_set_str(multiple, it->n.c_str(), 16);
+                if (!mpz_divisible_p(multiple, n)) continue;
+            }
+            if (it->bits != bits) { // a cofactor in a narrower width, its records cannot be reused
+                released.push_back(it->records);
+            } else {
+                taken = *it;
+                plan->reduce = !exact;
+                found = true;
+            }
+            sets.erase(it);
+            break;
+        }
+        mpz_clear(multiple);
+    }
+    if (!found) return;
+
+    plan->sources = taken.records;
+    plan->count = (unsigned) taken.b.size();
+    for (size_t i = 0; i < steps.size(); i++) {
+        const auto above = std::upper_bound(taken.b.begin(), taken.b.end(), steps[i]);
+        if (above != taken.b.begin()) plan->source[i] = (int) (above - taken.b.begin() - 1);
+    }
+}
+
+void ResidueStore::store(mpz_t n, unsigned bits, const std::vector<unsigned> &steps, void *records,
+                         std::vector<void *> &released) {
+    residue_set_t set;
+    set.n = to_hex(n);
+    set.bits = bits;
+    const unsigned every = stride((unsigned) steps.size());
+    for (unsigned i = 0; i < steps.size(); i++) {
+        if (residue_kept(i, every)) set.b.push_back(steps[i]);
+    }
+    set.records = records;
+
+    std::lock_guard<std::mutex> guard(lock);
+    sets.push_front(set);
+    while (sets.size() > max_sets) {
+        released.push_back(sets.back().records);
+        sets.pop_back();
+    }
+}
+
+void ResidueStore::drain(std::vector<void *> &released) {
+    std::lock_guard<std::mutex> guard(lock);
+    for (auto &set : sets) released.push_back(set.records);
+    sets.clear();
+}
+
+unsigned ResidueStore::size() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return (unsigned) sets.size();
+}
@@ -0,0 +1,70 @@
+#ifndef __RESIDUE_STORE_H__
+#define __RESIDUE_STORE_H__
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <gmp.h>
+
+#define RESIDUE_SETS 4 // moduli whose residues stay on the device, the least recently launched is dropped first
+#define RESIDUE_RECORDS 4096 // records kept per launch, longer schedules keep evenly spaced steps
+
+// the residues of one launch: record i ran a step of its schedule with bound b[i] (ascending)
+struct residue_set_t {
+    std::string n; // hex
+    unsigned bits; // instance width of the records
+    std::vector<unsigned> b;
+    void *records;
+};
+
+struct residue_plan_t {
+    void *sources = nullptr; // records of an earlier launch, nullptr to start every step from its base
+    unsigned count = 0;      // records in sources
+    bool reduce = false;     // sources are modulo a multiple of N and have to be reduced first
+    std::vector<int> source; // per step, the record it extends or -1
+};
+
+/*
+ * Which stage 1 residue on the device belongs to which (N, base, B). A
+ * launch for N, or for a cofactor of N at the same width, takes the set out
+ * of the store and extends for each of its steps the record with the largest
+ * B not above the step's, so only the primes in between are exponentiated.
+ * Records that did not complete are marked by the kernel and restarted
+ * there. The records are opaque device buffers here: the caller allocates
+ * them and releases whatever comes back in `released`. A launch keeps at
+ * most max_records records, those of every stride-th step
+ * (stage1_instance.h), so a schedule of millions of small steps costs no
+ * more memory than one of max_records steps.
+ */
+class ResidueStore {
+public:
+    explicit ResidueStore(unsigned max_sets = RESIDUE_SETS, unsigned max_records = RESIDUE_RECORDS);
+
+    // the record of every stride-th step of a launch is kept
+    unsigned stride(unsigned steps) const;
+
+    // records a launch of `steps` steps writes
+    unsigned records(unsigned steps) const;
+
+    void plan(mpz_t n, unsigned bits, const std::vector<unsigned> &steps, residue_plan_t *plan,
+              std::vector<void *> &released);
+
+    // records of a finished launch over all of its steps, the oldest sets beyond max_sets are released
+    void store(mpz_t n, unsigned bits, const std::vector<unsigned> &steps, void *records,
+               std::vector<void *> &released);
+
+    // every stored set, for an owner that frees its records
+    void drain(std::vector<void *> &released);
+
+    unsigned size() const;
+
+private:
+    const unsigned max_sets;
+    const unsigned max_records;
+    mutable std::mutex lock;
+    std::list<residue_set_t> sets; // most recently stored first
+};
+
+#endif /* __RESIDUE_STORE_H__ */
@@ -0,0 +1,245 @@
+#include <cmath>
+
+#include "small_factor.h"
+
+#define RHO_BATCH 128            // gcd is taken once per this many rho steps
+#define RHO_MAX_STEPS (1u << 22) // per polynomial, enough for any 32-bit factor
+#define RHO_POLYNOMIALS 8
+
+typedef unsigned __int128 u128;
+
+static const uint64_t small_primes[] = {3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53, 59, 61};
+
+static uint64_t gcd_u64(uint64_t a, uint64_t b) {
+    while (b != 0) {
+        uint64_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+static uint64_t isqrt_u64(uint64_t n) {
+    auto r = (uint64_t) sqrtl((long double) n);
+    if (r > 0xFFFFFFFFULL) r = 0xFFFFFFFFULL;
+    while (r * r > n) r--;
+    while (r < 0xFFFFFFFFULL && (r + 1) * (r + 1) <= n) r++;
+    return r;
+}
+
+// floor(sqrt(n)) for the kN of SQUFOF, n < 2^75 so the root fits in 38 bits
+static uint64_t isqrt_u128(u128 n) {
+    auto r = (uint64_t) sqrtl((long double) n);
+    while ((u128) r * r > n) r--;
+    while ((u128) (r + 1) * (r + 1) <= n) r++;
+    return r;
+}
+
+// Montgomery arithmetic modulo an odd n < 2^64, R = 2^64
+struct mont_u64_t {
+    uint64_t n;
+    uint64_t n_inv; // n^-1 mod 2^64
+    uint64_t r2;    // R^2 mod n
+
+    explicit mont_u64_t(uint64_t modulus) : n(modulus) {
+        n_inv = n; // correct to 3 bits, each Newton step doubles that
+        for (int i = 0; i < 5; i++) n_inv *= 2 - n * n_inv;
+        const u128 r = ((u128) 1 << 64) % n;
+        r2 = (uint64_t) ((r * r) % n);
+    }
+
+    uint64_t reduce(u128 t) const {
+        const uint64_t m = (uint64_t) t * n_inv;
+        const uint64_t hi = (uint64_t) (t >> 64);
+        const uint64_t mn_hi = (uint64_t) (((u128) m * n) >> 64);
+        return hi >= mn_hi ? hi - mn_hi : hi - mn_hi + n;
+    }
+
+    uint64_t mul(uint64_t a, uint64_t b) const {
+        return reduce((u128) a * b);
+    }
+
+    uint64_t add(uint64_t a, uint64_t b) const {
+        const uint64_t s = a + b;
+        return (s < a || s >= n) ? s - n : s;
+    }
+
+    uint64_t to_mont(uint64_t a) const {
+        return mul(a % n, r2);
+    }
+};
+
+// a^e with a and the result in Montgomery form
+static uint64_t powm_u64(const mont_u64_t &m, uint64_t a, uint64_t e) {
+    uint64_t x = m.to_mont(1);
+    while (e != 0) {
+        if (e & 1) x = m.mul(x, a);
+        a = m.mul(a, a);
+        e >>= 1;
+    }
+    return x;
+}
+
+// deterministic Miller-Rabin for all 64-bit inputs
+bool is_prime_u64(uint64_t n) {
+    if (n < 2) return false;
+    if (n % 2 == 0) return n == 2;
+    for (uint64_t p : small_primes) {
+        if (n % p == 0) return n == p;
+    }
+    if (n < 67 * 67) return true;
+
+    uint64_t d = n - 1;
+    unsigned s = 0;
+    while ((d & 1) == 0) {
+        d >>= 1;
+        s++;
+    }
+
+    const mont_u64_t m(n);
+    const uint64_t one = m.to_mont(1), minus_one = m.to_mont(n - 1);
+    const uint64_t witnesses[] = {2, 325, 9375, 28178, 450775, 9780504, 1795265022};
+    for (uint64_t a : witnesses) {
+        a %= n;
+        if (a == 0) continue;
+
+        uint64_t x = powm_u64(m, m.to_mont(a), d);
+        if (x == one || x == minus_one) continue;
+
+        bool composite = true;
+        for (unsigned r = 1; r < s && composite; r++) {
+            x = m.mul(x, x);
+            if (x == minus_one) composite = false;
+        }
+        if (composite) return false;
+    }
+    return true;
+}
+
+// Brent's variant of Pollard rho, f(x) = x^2 + c in Montgomery form, n odd
+uint64_t rho_brent_u64(uint64_t n, uint64_t c) {
+    const mont_u64_t m(n);
+    const uint64_t c_m = m.to_mont(c);
+    uint64_t y = m.to_mont(2), x = y, ys = y, q = m.to_mont(1);
+    uint64_t d = 1;
+
+    for (uint64_t r = 1; d == 1 && r <= RHO_MAX_STEPS; r <<= 1) {
+        x = y;
+        for (uint64_t i = 0; i < r; i++) {
+            y = m.add(m.mul(y, y), c_m);
+        }
+
+        for (uint64_t k = 0; k < r && d == 1; k += RHO_BATCH) {
+            ys = y;
+            const uint64_t steps = (r - k < RHO_BATCH) ? r - k : RHO_BATCH;
+            for (uint64_t i = 0; i < steps; i++) {
+                y = m.add(m.mul(y, y), c_m);
+                q = m.mul(q, x > y ? x - y : y - x);
+            }
+            d = gcd_u64(q, n);
+        }
+    }
+
+    if (d == n) { // the batch overshot, redo it one step at a time
+        do {
+            ys = m.add(m.mul(ys, ys), c_m);
+            d = gcd_u64(x > ys ? x - ys : ys - x, n);
+        } while (d == 1);
+    }
+
+    return (d == 1 || d == n) ? 0 : d;
+}
+
+// Shanks' square forms factorization with the usual multipliers, returns 0 on failure;
+// kN is kept in 128 bits, P and Q stay below 2 sqrt(kN) < 2^39 for every n < 2^64
+uint64_t squfof_u64(uint64_t n) {
+    static const uint64_t multipliers[] = {1, 3, 5, 7, 11, 3 * 5, 3 * 7, 3 * 11, 5 * 7, 5 * 11, 7 * 11, 3 * 5 * 7,
+                                           3 * 5 * 11, 3 * 7 * 11, 5 * 7 * 11, 3 * 5 * 7 * 11};
+
+    const uint64_t s = isqrt_u64(n);
+    if (s * s == n) return s;
+
+    for (uint64_t k : multipliers) {
+        const u128 D = (u128) k * n;
+        const uint64_t Po = isqrt_u128(D);
+        uint64_t P = Po, Pprev = Po, Qprev = 1, Q = (uint64_t) (D - (u128) Po * Po), b, q, r = 0;
+        if (Q == 0) continue;
+
+        const uint64_t L = 2 * isqrt_u64(2 * s);
+        const uint64_t B = 3 * L;
+        uint64_t i;
+        for (i = 2; i < B && Q != 0; i++) {
+            b = (Po + P) / Q;
+            P = b * Q - P;
+            q = Q;
+            Q = Qprev + b * (Pprev - P);
+            r = isqrt_u64(Q);
+            if (!(i & 1) && r * r == Q) break;
+            Qprev = q;
+            Pprev = P;
+        }
+        if (i >= B || Q == 0 || r == 0) continue;
+
+        b = (Po - P) / r;
+        Pprev = P = b * r + P;
+        Qprev = r;
+        Q = (uint64_t) ((D - (u128) Pprev * Pprev) / Qprev);
+        if (Q == 0) continue;
+
+        for (i = 0; i < B && Q != 0; i++) {
+            b = (Po + P) / Q;
+            Pprev = P;
+            P = b * Q - P;
+            q = Q;
+            Q = Qprev + b * (Pprev - P);
+            Qprev = q;
+            if (P == Pprev) break;
+        }
+
+        r = gcd_u64(n, Qprev);
+        if (r != 1 && r != n) return r;
+    }
+
+    return 0;
+}
+
+// any nontrivial factor of composite n, 0 if none was found
+uint64_t split_u64(uint64_t n) {
+    if (n % 2 == 0) return 2;
+    for (uint64_t p : small_primes) {
+        if (n % p == 0) return p;
+    }
+
+    const uint64_t s = isqrt_u64(n);
+    if (s * s == n) return s;
+
+    uint64_t d = rho_brent_u64(n, 1);
+    if (d != 0) return d;
+
+    d = squfof_u64(n);
+    if (d != 0) return d;
+
+    for (uint64_t c = 2; c < 2 + RHO_POLYNOMIALS; c++) {
+        d = rho_brent_u64(n, c);
+        if (d != 0) return d;
+    }
+    return 0;
+}
+
+int small_factorize(mpz_t n, mpz_t *result) {
+    if (mpz_sizeinbase(n, 2) > SMALL_FACTOR_BITS || mpz_cmp_ui(n, 1) <= 0) {
+        return -1;
+    }
+
+    uint64_t factor = mpz_get_ui(n);
+    while (!is_prime_u64(factor)) {
+        const uint64_t d = split_u64(factor);
+        if (d == 0) {
+            return -1;
+        }
+        factor = d;
+    }
+
+    mpz_set_ui(*result, factor);
+    return 0;
+}
@@ -0,0 +1,20 @@
+#ifndef __SMALL_FACTOR_H__
+#define __SMALL_FACTOR_H__
+
+#include <cstdint>
+
+#include <gmp.h>
+
+#define SMALL_FACTOR_BITS 64 // composites up to this size are split on native words
+
+bool is_prime_u64(uint64_t n);
+
+uint64_t rho_brent_u64(uint64_t n, uint64_t c);
+
+uint64_t squfof_u64(uint64_t n);
+
+uint64_t split_u64(uint64_t n);
+
+int small_factorize(mpz_t n, mpz_t *result);
+
+#endif /* __SMALL_FACTOR_H__ */
@@ -0,0 +1,127 @@
+#ifndef __STAGE1_HOST_H__
+#define __STAGE1_HOST_H__
+
+#include <cstdint>
+
+#include <gmp.h>
+
+#include "limbs.h"
+#include "stage1_loop.h"
+
+/*
+ * Host instantiation of the kernel's stage 1 loop. Numbers are GMP integers
+ * of at most `width` bits and the Montgomery operations follow CGBN: R is
+ * 2^width, bn2mont returns -N^-1 mod 2^32 and every product is reduced by
+ * REDC, so the loop runs with the same residues as on the device.
+ */
+struct host_bn_t {
+    mpz_t v;
+
+    host_bn_t() {
+        mpz_init(v);
+    }
+
+    ~host_bn_t() {
+        mpz_clear(v);
+    }
+
+    host_bn_t(const host_bn_t &) = delete;
+
+    host_bn_t &operator=(const host_bn_t &) = delete;
+};
+
+struct host_mont_env_t {
+    mpz_t n_inverse; // -N^-1 mod R
+    mpz_t t, m;
+
+    host_mont_env_t() {
+        mpz_init(n_inverse);
+        mpz_init(t);
+        mpz_init(m);
+    }
+
+    ~host_mont_env_t() {
+        mpz_clear(n_inverse);
+        mpz_clear(t);
+        mpz_clear(m);
+    }
+};
+
+template<uint32_t width>
+struct host_stage1_ops {
+    typedef host_mont_env_t env_t;
+    typedef host_bn_t bn_t;
+
+    // r = t / R mod n for t < n * R
+    static void redc(env_t &env, bn_t &r, mpz_t t, const bn_t &n) {
+        mpz_tdiv_r_2exp(env.m, t, width);
+        mpz_mul(env.m, env.m, env.n_inverse);
+        mpz_tdiv_r_2exp(env.m, env.m, width);
+        mpz_addmul(t, env.m, n.v);
+        mpz_tdiv_q_2exp(r.v, t, width);
+        if (mpz_cmp(r.v, n.v) >= 0) mpz_sub(r.v, r.v, n.v);
+    }
+
+    static void set(env_t &, bn_t &r, const bn_t &a) {
+        mpz_set(r.v, a.v);
+    }
+
+    static void set_ui32(env_t &, bn_t &r, uint32_t value) {
+        mpz_set_ui(r.v, value);
+    }
+
+    static void mul_ui32(env_t &, bn_t &r, const bn_t &a, uint32_t value) {
+        mpz_mul_ui(r.v, a.v, value);
+        mpz_tdiv_r_2exp(r.v, r.v, width); // CGBN keeps the low bits
+    }
+
+    static void load(env_t &, bn_t &r, const uint32_t *words) {
+        to_mpz(r.v, words, width / 32);
+    }
+
+    static uint32_t bits(env_t &, const bn_t &a) {
+        return mpz_sgn(a.v) == 0 ? 0 : (uint32_t) mpz_sizeinbase(a.v, 2);
+    }
+
+    static uint32_t extract_bits(env_t &, const bn_t &a, uint32_t start, uint32_t len) {
+        uint32_t value = 0;
+        for (uint32_t i = len; i > 0; i--) {
+            value = (value << 1) | (uint32_t) mpz_tstbit(a.v, start + i - 1);
+        }
+        return value;
+    }
+
+    static uint32_t bn2mont(env_t &env, bn_t &r, const bn_t &a, const bn_t &n) {
+        mpz_set_ui(env.t, 1);
+        mpz_mul_2exp(env.t, env.t, width);
+        mpz_invert(env.n_inverse, n.v, env.t);
+        mpz_sub(env.n_inverse, env.t, env.n_inverse);
+
+        mpz_mul_2exp(env.t, a.v, width);
+        mpz_mod(r.v, env.t, n.v);
+        return (uint32_t) mpz_get_ui(env.n_inverse);
+    }
+
+    static void mont2bn(env_t &env, bn_t &r, const bn_t &a, const bn_t &n, uint32_t) {
+        mpz_set(env.t, a.v);
+        redc(env, r, env.t, n);
+    }
+
+    static void mont_mul(env_t &env, bn_t &r, const bn_t &a, const bn_t &b, const bn_t &n, uint32_t) {
+        mpz_mul(env.t, a.v, b.v);
+        redc(env, r, env.t, n);
+    }
+
+    static void mont_sqr(env_t &env, bn_t &r, const bn_t &a, const bn_t &n, uint32_t) {
+        mpz_mul(env.t, a.v, a.v);
+        redc(env, r, env.t, n);
+    }
+};
+
+struct host_never_stop {
+    bool operator()() const {
+        return false;
+    }
+};
+
+#endif /* __STAGE1_HOST_H__ */
@@ -0,0 +1,123 @@
+#ifndef __STAGE1_INSTANCE_H__
+#define __STAGE1_INSTANCE_H__
+
+#include <cstdint>
+
+#include "b_schedule.h"
+#include "stage1_loop.h"
+
+/*
+ * One search instance around the stage 1 loop, written once for the kernel
+ * and for the host kernel (pollard/host_kernel.h) like stage1_loop.h: the
+ * residue records kept between launches, stage 1 of one schedule step and
+ * the persistent loop over the steps. Besides the arithmetic of `ops` the
+ * driver needs gcd, compare, compare_ui32, equals_ui32, sub_ui32 and store.
+ * What differs between device and host goes through a `control` class:
+ *   bool operator()()             the search is over, the stop of stage1_power
+ *   bool claim(unsigned *ticket)  the next schedule step to run, false when no more are handed out
+ *   bool leader()                 this thread writes the scalar fields of a record
+ *   bool found(env, d, B)         keeps the factor d found at bound B, returns true
+ *   modexp_scope_t, gcd_scope_t   constructed around each phase, trace spans and timers on the host
+ */
+
+// stage 1 residue of one schedule step, kept for later launches; b stays 0 unless the step completed
+template<class params>
+struct residue_record_t {
+    uint32_t x[params::BITS / 32];
+    uint32_t base;
+    uint32_t b;
+    uint32_t next_prime; // index of the first prime above b
+    uint32_t reserved;
+};
+
+template<class params>
+struct residue_launch_t {
+    const residue_record_t<params> *sources; // records of an earlier launch, nullptr for none
+    const int *source;                       // per step, the source record it extends or -1
+    residue_record_t<params> *records;       // written by this launch, steps / stride of them
+    unsigned stride;                         // the steps residue_kept picks write records[step / stride]
+};
+
+// every stride-th step keeps its record, stride grows so a launch keeps at most max_records
+POLLARD_HOST_DEVICE inline unsigned residue_stride(unsigned steps, unsigned max_records) {
+    return steps > max_records ? (steps + max_records - 1) / max_records : 1;
+}
+
+POLLARD_HOST_DEVICE inline bool residue_kept(unsigned step, unsigned stride) {
+    return step % stride == stride - 1;
+}
+
+// stage 1 of schedule step `step` with bound B, true once the search is over
+template<class ops, class params, class control_t>
+STAGE1_FN bool stage1_instance(typename ops::env_t &env,
+                               const typename ops::bn_t &N,
+                               const unsigned *primes,
+                               const prime_groups_view_t &groups,
+                               const residue_launch_t<params> &launch,
+                               unsigned step,
+                               unsigned B,
+                               unsigned base,
+                               control_t &control) {
+    typename ops::bn_t a, d, e, g;
+    unsigned b_from = 0, prime_index = 0;
+    const residue_record_t<params> *from = nullptr;
+    if (launch.sources != nullptr && launch.source[step] >= 0) from = &launch.sources[launch.source[step]];
+
+    if (from != nullptr && from->b != 0 && from->b <= B) {
+        // extend the residue of an earlier launch, its base was checked then
+        ops::load(env, e, from->x);
+        base = from->base;
+        b_from = from->b;
+        prime_index = from->next_prime;
+    } else {
+        // a base sharing a factor with N is the factor
+        ops::set_ui32(env, a, base);
+        ops::gcd(env, d, a, N);
+        if (ops::compare_ui32(env, d, 1) != 0) return control.found(env, d, B);
+        ops::set(env, e, a);
+    }
+
+    // e = e ^ (E(B) / E(b_from)) % N, in the Montgomery domain throughout
+    {
+        typename control_t::modexp_scope_t scope;
+        if (!stage1_power<ops, params>(env, e, N, primes, groups, b_from, B, prime_index, control)) return true;
+    }
+
+    if (residue_kept(step, launch.stride)) {
+        residue_record_t<params> *record = &launch.records[step / launch.stride];
+        ops::store(env, record->x, e);
+        if (control.leader()) {
+            record->base = base;
+            record->next_prime = prime_index;
+            record->b = B;
+        }
+    }
+
+    if (!ops::equals_ui32(env, e, 1)) {
+        if (control()) return true;
+
+        typename control_t::gcd_scope_t scope;
+        ops::sub_ui32(env, g, e, 1);
+        ops::gcd(env, d, g, N);
+        if (ops::compare_ui32(env, d, 1) > 0 && ops::compare(env, d, N) < 0) return control.found(env, d, B);
+    }
+    return false;
+}
+
+// persistent instance: claims the next step until the schedule runs out or the search is over
+template<class ops, class params, class control_t>
+STAGE1_FN void stage1_instance_loop(typename ops::env_t &env,
+                                    const typename ops::bn_t &N,
+                                    const unsigned *primes,
+                                    const prime_groups_view_t &groups,
+                                    const residue_launch_t<params> &launch,
+                                    const b_schedule_t &schedule,
+                                    control_t &control) {
+    unsigned ticket, B;
+    while (!control() && control.claim(&ticket)) {
+        if (!b_schedule_at(schedule, ticket, &B)) return;
+        if (stage1_instance<ops, params>(env, N, primes, groups, launch, ticket, B, 2 + ticket, control)) return;
+    }
+}
+
+#endif /* __STAGE1_INSTANCE_H__ */
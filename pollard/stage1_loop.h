@@ -0,0 +1,154 @@
+#ifndef __STAGE1_LOOP_H__
+#define __STAGE1_LOOP_H__
+
+#include <cmath>
+#include <cstdint>
+
+/*
+ * Stage 1 of one kernel instance, written once for the device and for the
+ * host. The arithmetic goes through an `ops` class: the kernel instantiates
+ * it over CGBN, pollard/stage1_host.h over GMP with the same Montgomery
+ * conventions as a reference, pollard/host_bn.h over fixed-width mpn numbers
+ * for the host kernel. The residue enters the Montgomery domain once and
+ * leaves it once; every chunk of E(B) is applied by a fixed-window
+ * square-and-multiply over its words.
+ */
+
+#ifdef __CUDACC__
+#define STAGE1_FN __device__ __forceinline__
+#else
+#define STAGE1_FN inline
+#endif
+
+template<uint32_t tpi, uint32_t bits>
+class pollard_params_t {
+public:
+    static const uint32_t TPI = tpi;                   // threads per instance
+    static const uint32_t BITS = bits;                 // instance size
+    static const uint32_t LIMBS = (bits / 32 + tpi - 1) / tpi; // limbs of a number held by each thread
+    // window of the chunk exponentiation, 3 bits for chunks up to 128 bits; its 2^WINDOW table stays within
+    // 32 registers of every thread
+    static const uint32_t WINDOW = bits <= 256 || 16 * LIMBS > 32 ? 3 : 4;
+};
+
+// prime groups of the exponent cache on the device, count is 0 when there are none
+struct prime_groups_view_t {
+    const uint32_t *words; // count numbers of BITS / 32 words each
+    const unsigned *starts; // count + 1 prime indices
+    unsigned count;
+};
+
+// first group whose primes all exceed sqrt(B) and start at or past prime index `first`, from there on every
+// prime up to B has exponent 1
+STAGE1_FN unsigned first_linear_group(const prime_groups_view_t &groups, const unsigned *primes, unsigned B,
+                                      unsigned first) {
+    unsigned low = 0, high = groups.count;
+    while (low < high) {
+        const unsigned middle = (low + high) / 2;
+        const unsigned long long p = primes[groups.starts[middle]];
+        if (p * p > B && groups.starts[middle] >= first) {
+            high = middle;
+        } else {
+            low = middle + 1;
+        }
+    }
+    return low;
+}
+
+// prime index after `it`; primes below `jump` (all at most b_from) only gain a power up to sqrt(B)
+STAGE1_FN unsigned stage1_next_prime(const unsigned *primes, unsigned it, unsigned jump, unsigned B) {
+    it++;
+    if (it < jump && (unsigned long long) primes[it] * primes[it] > B) it = jump;
+    return it;
+}
+
+// x = x ^ e, x in the Montgomery domain, e scanned from its top bit in windows of `window` bits
+template<class ops, uint32_t window>
+STAGE1_FN void stage1_mont_power(typename ops::env_t &env, typename ops::bn_t &x, const typename ops::bn_t &e,
+                                 const typename ops::bn_t &n, uint32_t np0) {
+    typename ops::bn_t table[1u << window]; // table[k] = x ^ k, k > 0
+    ops::set(env, table[1], x);
+    ops::mont_sqr(env, table[2], x, n, np0);
+    for (uint32_t k = 3; k < (1u << window); k++) {
+        ops::mont_mul(env, table[k], table[k - 1], x, n, np0);
+    }
+
+    uint32_t position = ops::bits(env, e);
+    bool first = true;
+    while (position > 0) {
+        const uint32_t width = position < window ? position : window;
+        position -= width;
+        const uint32_t digit = ops::extract_bits(env, e, position, width);
+        if (first) {
+            ops::set(env, x, table[digit]); // the top window holds the top bit, digit > 0
+            first = false;
+            continue;
+        }
+        for (uint32_t s = 0; s < width; s++) {
+            ops::mont_sqr(env, x, x, n, np0);
+        }
+        if (digit != 0) {
+            ops::mont_mul(env, x, x, table[digit], n, np0);
+        }
+    }
+}
+
+/*
+ * x = x ^ (E(B) / E(b_from)) mod N, b_from = 0 to start from the base. E(B)
+ * is applied in chunks below 2^(BITS/2): prime powers multiplied on the fly
+ * up to sqrt(B) and past the last full group, precomputed groups of the
+ * exponent cache in between. A prime up to b_from contributes the powers it
+ * gains between the two bounds, so only those below sqrt(B) are visited.
+ * `prime_index` comes in as the index of the first prime above b_from (0
+ * for a fresh start) and goes out as the first prime above B. Returns false
+ * when `stop` ends the search first.
+ */
+template<class ops, class params, class stop_t>
+STAGE1_FN bool stage1_power(typename ops::env_t &env, typename ops::bn_t &x, const typename ops::bn_t &N,
+                            const unsigned *primes, const prime_groups_view_t &groups, unsigned b_from, unsigned B,
+                            unsigned &prime_index, const stop_t &stop) {
+    typename ops::bn_t e_sub, tmp;
+
+    const double log_b = log2((double) B);
+    const double log_b_from = b_from > 1 ? log2((double) b_from) : 0.0;
+    const unsigned log_b_ceil = ((unsigned) log_b) + 1;
+    const unsigned prime_per_iter = params::BITS / log_b_ceil / 2;
+    const unsigned jump = prime_index;
+
+    unsigned group = first_linear_group(groups, primes, B, jump);
+    unsigned group_start = group < groups.count ? groups.starts[group] : 0xFFFFFFFF;
+
+    const uint32_t np0 = ops::bn2mont(env, x, x, N);
+
+    unsigned primes_it = jump > 0 && (unsigned long long) primes[0] * primes[0] > B ? jump : 0;
+    unsigned prime_i = primes[primes_it];
+    while (prime_i <= B) {
+        if (stop()) return false;
+
+        if (primes_it == group_start && group < groups.count && primes[groups.starts[group + 1] - 1] <= B) {
+            // a whole group below B, its product is precomputed
+            ops::load(env, e_sub, groups.words + (unsigned long long) group * (params::BITS / 32));
+            primes_it = groups.starts[++group];
+            group_start = primes_it;
+        } else {
+            ops::set_ui32(env, e_sub, 1);
+            // the chunk stops at the next group so it can be loaded
+            for (unsigned i = 0; i < prime_per_iter && prime_i <= B && (i == 0 || primes_it != group_start); i++) {
+                auto power = (unsigned) (log_b / log2((double) prime_i)); // p_pow_i = log(B) / log(p_i)
+                if (primes_it < jump) power -= (unsigned) (log_b_from / log2((double) prime_i));
+                ops::mul_ui32(env, tmp, e_sub, (unsigned) pow((double) prime_i, power)); // e_sub *= p_i^p_pow_i
+                ops::set(env, e_sub, tmp);
+                primes_it = stage1_next_prime(primes, primes_it, jump, B);
+                prime_i = primes[primes_it];
+            }
+        }
+        prime_i = primes[primes_it];
+        stage1_mont_power<ops, params::WINDOW>(env, x, e_sub, N, np0);
+    }
+
+    ops::mont2bn(env, x, x, N, np0);
+    prime_index = primes_it;
+    return true;
+}
+
+#endif /* __STAGE1_LOOP_H__ */
@@ -0,0 +1,30 @@
+#ifndef __WIDTH_CLASS_H__
+#define __WIDTH_CLASS_H__
+
+#include <gmp.h>
+
+#define WIDTH_CLASSES 11
+
+/*
+ * Instance widths of the pollard_params_t instantiations the host kernel
+ * picks from: an input runs at the narrowest width holding all of its bits.
+ * Inputs of one class run the same kernel and are grouped by the job
+ * scheduler. On the GPU, classes CGBN cannot split evenly over the threads
+ * of an instance run on the next wider one.
+ */
+static const unsigned width_class_bits[WIDTH_CLASSES] = {96, 128, 192, 256, 384, 512, 768, 1024, 2048, 4096, 8192};
+
+// inputs wider than the last class share its scheduler class, the CPU backend takes them
+inline unsigned width_class_of(const mpz_t n) {
+    const size_t bits = mpz_sizeinbase(n, 2);
+    for (unsigned c = 0; c < WIDTH_CLASSES - 1; c++) {
+        if (bits <= width_class_bits[c]) return c;
+    }
+    return WIDTH_CLASSES - 1;
+}
+
+inline bool width_class_fits(const mpz_t n) {
+    return mpz_sizeinbase(n, 2) <= width_class_bits[WIDTH_CLASSES - 1];
+}
+
+#endif /* __WIDTH_CLASS_H__ */
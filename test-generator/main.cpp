@@ -1,123 +1,290 @@
 #include <cstdlib>
 #include <cstdio>
 #include <cstring>
+#include <atomic>
+#include <set>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <gmp.h>
 
+#include "../common/corpus.h"
+#include "../common/hex.h"
+
 #define MAX_TRIES 10000
+#define ROUGH_MARGIN 8 // other primes are q = 2 * k * r + 1 with a prime r this many bits below q
+
+/*
+ * Benchmark corpus generator. Every N has one hidden prime p whose p - 1 is
+ * built from its prime factorization, so its smoothness is exact: all prime
+ * powers are at most B1 and the largest prime below B1 lies in (B1 / 2, B1];
+ * with B2 > B1 one more prime in (B1, B2] is the single stage 2 prime. The
+ * other primes q have a prime of nearly their own size in q - 1, so only p is
+ * found by stage 1. Each entry draws from its own generator seeded with
+ * (seed, index), the output does not depend on the thread count.
+ */
 
-gmp_randstate_t random_state;
+struct corpus_spec_t {
+    unsigned bits;
+    unsigned long b1;
+    unsigned long b2; // 0 or <= b1 for none
+    unsigned factors;
+};
 
-void random_num(size_t size, mpz_t* result) {
-    mpz_rrandomb(*result, random_state, size);
+// a random prime in (low, high], 0 when there is none
+static unsigned long random_prime_in(gmp_randstate_t state, unsigned long low, unsigned long high, mpz_t tmp) {
+    if (high <= low) return 0;
+    for (int i = 0; i < MAX_TRIES; i++) {
+        mpz_set_ui(tmp, high - low);
+        mpz_urandomm(tmp, state, tmp);
+        mpz_add_ui(tmp, tmp, low); // low .. high - 1, the next prime above it is > low
+        mpz_nextprime(tmp, tmp);
+        if (mpz_cmp_ui(tmp, high) <= 0) return mpz_get_ui(tmp);
+    }
+    return 0;
 }
 
-int random_factor(mpz_t b, size_t b_size, size_t factor_size, mpz_t* result) {
-    int i;
-    mpz_t f, f1, num;
-    mpz_init(f);
-    mpz_init(f1);
-    mpz_init(num);
-    size_t num_size = factor_size - b_size;
-    
-    for (i = 0; i < MAX_TRIES; ++i) {
-        random_num(num_size, &num);
-        mpz_mul(f, num, b);
-        mpz_add_ui(f1, f, 1);
-        
-        if (mpz_probab_prime_p(f1, 50) != 0) {
-            mpz_set(*result, f1);
-            break;
+// hidden prime of about `bits` bits with the exact smoothness of the spec
+static int smooth_prime(gmp_randstate_t state, unsigned bits, unsigned long b1, unsigned long b2, mpz_t p) {
+    mpz_t m, tmp;
+    mpz_init(m);
+    mpz_init(tmp);
+    const unsigned b1_bits = (unsigned) (sizeof(unsigned long) * 8 - __builtin_clzl(b1));
+
+    int res = -1;
+    for (int attempt = 0; attempt < MAX_TRIES && res != 0; attempt++) {
+        std::set<unsigned long> used;
+        const unsigned long largest = random_prime_in(state, b1 / 2, b1, tmp);
+        mpz_set_ui(m, 2);
+        mpz_mul_ui(m, m, largest);
+        used.insert(2);
+        used.insert(largest);
+        if (b2 > b1) {
+            mpz_mul_ui(m, m, random_prime_in(state, b1, b2, tmp));
         }
-    }
 
-    mpz_clear(f);
-    mpz_clear(f1);
-    mpz_clear(num);
-    if (i < MAX_TRIES) {
-        return 0;
-    } else {
-        return -1;
+        // prime powers up to B1, below the largest one, until one more prime reaches the size
+        int misses = 0;
+        while (mpz_sizeinbase(m, 2) + b1_bits < bits && misses < MAX_TRIES) {
+            const unsigned long q = random_prime_in(state, 1, largest - 1, tmp);
+            if (q == 0 || used.count(q) != 0) {
+                misses++;
+                continue;
+            }
+            unsigned long power = q;
+            while (power <= b1 / q && gmp_urandomb_ui(state, 1) != 0) power *= q;
+            mpz_mul_ui(m, m, power);
+            used.insert(q);
+        }
+        if (misses >= MAX_TRIES) break; // not enough primes below B1 for this size
+
+        for (int last = 0; last < 256; last++) {
+            const unsigned long q = random_prime_in(state, 1, largest - 1, tmp);
+            if (q == 0 || used.count(q) != 0) continue;
+            mpz_mul_ui(p, m, q);
+            mpz_add_ui(p, p, 1);
+            if (mpz_probab_prime_p(p, 30) != 0) {
+                res = 0;
+                break;
+            }
+        }
     }
+
+    mpz_clear(m);
+    mpz_clear(tmp);
+    return res;
 }
 
-int main(int argc, char *argv[]) {
-    if (argc <= 2) {
-        fprintf(stderr, "Usage: %s size_of_n <list of b factors>\n", argv[0]);
-        return -1;
+// prime of exactly `bits` bits whose q - 1 has a prime factor ROUGH_MARGIN bits shorter
+static void rough_prime(gmp_randstate_t state, unsigned bits, mpz_t q) {
+    mpz_t r;
+    mpz_init(r);
+    while (true) {
+        mpz_urandomb(r, state, bits - ROUGH_MARGIN);
+        mpz_setbit(r, bits - ROUGH_MARGIN - 1);
+        mpz_nextprime(r, r);
+        for (unsigned long k = 1; k < (1ul << ROUGH_MARGIN); k++) {
+            mpz_mul_ui(q, r, 2 * k);
+            mpz_add_ui(q, q, 1);
+            if (mpz_sizeinbase(q, 2) > bits) break;
+            if (mpz_sizeinbase(q, 2) == bits && mpz_probab_prime_p(q, 30) != 0) {
+                mpz_clear(r);
+                return;
+            }
+        }
     }
+}
+
+// one corpus line, empty when the spec cannot be met
+static std::string generate_entry(const corpus_spec_t &spec, unsigned long seed, unsigned long index) {
+    gmp_randstate_t state;
+    gmp_randinit_mt(state);
+    mpz_t entry_seed;
+    mpz_init_set_ui(entry_seed, seed);
+    mpz_mul_2exp(entry_seed, entry_seed, 64);
+    mpz_add_ui(entry_seed, entry_seed, index);
+    gmp_randseed(state, entry_seed);
+    mpz_clear(entry_seed);
 
-    srand(time(NULL));
-    gmp_randinit_mt(random_state);
+    const unsigned hidden_bits = spec.bits / spec.factors;
+    const unsigned other_bits = spec.factors > 1 ? (spec.bits - hidden_bits) / (spec.factors - 1) : 0;
+    // the other primes need a prime above every bound in q - 1
+    const unsigned long bound = spec.b2 > spec.b1 ? spec.b2 : spec.b1;
+    const unsigned min_rough_bits = ROUGH_MARGIN + 1 + (unsigned) (sizeof(unsigned long) * 8 - __builtin_clzl(bound));
 
-    size_t size_n = std::stoi(argv[1]);
-    mpz_t b, p, q, n, n1, zero, rem;
-    mpz_init(b);
-    mpz_init(p);
-    mpz_init(q);
+    mpz_t n, factor;
     mpz_init(n);
-    mpz_init(n1);
-    mpz_init(zero);
-    mpz_init(rem);
-    mpz_set_ui(zero, 0);
-
-    for (int num_to_factor = 2; num_to_factor < argc; num_to_factor++) {
-        printf("<----------------------------------------------->\n");
-        const char *num_str = argv[num_to_factor];
-        mpz_set_str(b, num_str, 16);
-
-        if (mpz_probab_prime_p(b, 50) == 0) {
-            printf("Factor b: 0x%s is not a prime!\n", num_str);
-            continue;
-        }
+    mpz_init(factor);
+    std::vector<std::string> factors;
+    std::string line;
 
-        printf("Trying to find N for b: 0x%s\n", num_str);
-        size_t b_size = mpz_sizeinbase(b, 2);
-        size_t factor_size = size_n / 2;
-        int diff = 3 + rand() % 4;
-        size_t p_size = factor_size - diff;
-        size_t q_size = factor_size + diff;
+    if (smooth_prime(state, hidden_bits, spec.b1, spec.b2, factor) == 0) {
+        mpz_set(n, factor);
+        factors.push_back(to_hex(factor));
+        for (unsigned f = 1; f + 1 < spec.factors; f++) {
+            rough_prime(state, other_bits, factor);
+            mpz_mul(n, n, factor);
+            factors.push_back(to_hex(factor));
+        }
 
-        int res_p = random_factor(b, b_size, p_size - 1, &p);
-        if (res_p != 0) {
-            printf("Could not compute p factor!\n");
-            continue;
+        // the last prime makes N exactly spec.bits long, p may have taken too much of it
+        mpz_t prefix;
+        mpz_init_set(prefix, n);
+        const size_t prefix_bits = mpz_sizeinbase(prefix, 2);
+        const bool fits = prefix_bits < spec.bits && spec.bits - prefix_bits + 1 >= min_rough_bits;
+        while (fits) {
+            rough_prime(state, (unsigned) (spec.bits - prefix_bits + 1), factor);
+            mpz_mul(n, prefix, factor);
+            if (mpz_sizeinbase(n, 2) == spec.bits) {
+                factors.push_back(to_hex(factor));
+                break;
+            }
         }
-        int res_q = random_factor(b, b_size, q_size, &q);
-        if (res_q != 0) {
-            printf("Could not compute q factor!\n");
-            continue;
+        mpz_clear(prefix);
+
+        if (fits) {
+            line = std::to_string(spec.bits) + " " + std::to_string(spec.b1);
+            if (spec.b2 > spec.b1) line += ":" + std::to_string(spec.b2);
+            line += " " + to_hex(n);
+            for (auto &hex : factors) line += " " + hex;
         }
-        mpz_mul(n, p, q);
+    }
 
-        char p_str[1024] = {'\0'};
-        mpz_get_str(p_str, 16, p);
-        printf("Found p: 0x%s\n", p_str);
+    mpz_clear(n);
+    mpz_clear(factor);
+    gmp_randclear(state);
+    return line;
+}
 
-        char q_str[1024] = {'\0'};
-        mpz_get_str(q_str, 16, q);
-        printf("Found q: 0x%s\n", q_str);
+static int parse_list(const char *text, std::vector<unsigned long> &values) {
+    values.clear();
+    std::string list(text);
+    size_t start = 0;
+    while (start <= list.size()) {
+        const size_t end = std::min(list.find(',', start), list.size());
+        char *parsed;
+        const std::string item = list.substr(start, end - start);
+        values.push_back((unsigned long) strtod(item.c_str(), &parsed)); // 1e6 is accepted
+        if (item.empty() || *parsed != '\0') return -1;
+        start = end + 1;
+    }
+    return 0;
+}
 
-        char n_str[1024] = {'\0'};
-        mpz_get_str(n_str, 16, n);
-        printf("Found N: 0x%s\n", n_str);
+int main(int argc, char *argv[]) {
+    unsigned long seed = 1;
+    unsigned count = 10;
+    unsigned factors = 2;
+    unsigned threads = std::thread::hardware_concurrency();
+    const char *output = nullptr;
+    const char *tag = "v1";
+    std::vector<unsigned long> bits_list = {256}, b1_list = {1u << 14}, b2_list = {0};
 
-        mpz_sub_ui(n1, n, 1);
-        char n1_str[1024] = {'\0'};
-        mpz_get_str(n1_str, 16, n1);
-        printf("Found N - 1: 0x%s\n", n1_str);
+    for (int i = 1; i < argc; i++) {
+        int res = 0;
+        if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc) {
+            seed = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "-bits") == 0 && i + 1 < argc) {
+            res = parse_list(argv[++i], bits_list);
+        } else if (strcmp(argv[i], "-b1") == 0 && i + 1 < argc) {
+            res = parse_list(argv[++i], b1_list);
+        } else if (strcmp(argv[i], "-b2") == 0 && i + 1 < argc) {
+            res = parse_list(argv[++i], b2_list);
+        } else if (strcmp(argv[i], "-factors") == 0 && i + 1 < argc) {
+            factors = (unsigned) atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-count") == 0 && i + 1 < argc) {
+            count = (unsigned) atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            threads = (unsigned) atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "-tag") == 0 && i + 1 < argc) {
+            tag = argv[++i];
+        } else {
+            res = -1;
+        }
+        if (res != 0) {
+            fprintf(stderr, "Usage: %s [-seed n] [-bits list] [-b1 list] [-b2 list] [-factors k] [-count per bucket] "
+                            "[-j threads] [-tag version] [-o file]\n"
+                            "lists are comma separated, every bits x B1 x B2 combination is a bucket\n", argv[0]);
+            return -1;
+        }
+    }
+    if (threads < 1) threads = 1;
 
-        mpz_mod(rem, n1, b);
-        if (mpz_cmp(rem, zero) != 0) {
-            printf("Wrong!\n");
+    std::vector<corpus_spec_t> specs;
+    for (unsigned long bits : bits_list) {
+        for (unsigned long b1 : b1_list) {
+            for (unsigned long b2 : b2_list) {
+                const unsigned long stage1_bound = b2 > b1 ? b2 : b1;
+                if (factors < 2 || b1 < 3 || bits / factors < 16 ||
+                    (bits - bits / factors) / (factors - 1) <= (unsigned long) (ROUGH_MARGIN + 64 - __builtin_clzl(stage1_bound))) {
+                    fprintf(stderr, "Cannot build %lu bit N of %u factors with B1 %lu, B2 %lu\n", bits, factors,
+                            b1, b2);
+                    return -1;
+                }
+                for (unsigned c = 0; c < count; c++) {
+                    specs.push_back(corpus_spec_t{(unsigned) bits, b1, b2, factors});
+                }
+            }
         }
     }
 
-    mpz_clear(b);
-    mpz_clear(p);
-    mpz_clear(q);
-    mpz_clear(n);
-    mpz_clear(n1);
-    return 0;
+    std::vector<std::string> lines(specs.size());
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; t++) {
+        workers.emplace_back([&]() {
+            size_t index;
+            while ((index = next.fetch_add(1)) < specs.size()) {
+                lines[index] = generate_entry(specs[index], seed, index);
+            }
+        });
+    }
+    for (auto &worker : workers) worker.join();
+
+    FILE *out = output != nullptr ? fopen(output, "w") : stdout;
+    if (out == nullptr) {
+        fprintf(stderr, "Cannot write %s\n", output);
+        return -1;
+    }
+    fprintf(out, "%s %s\n# test_data", CORPUS_HEADER, tag);
+    for (int i = 1; i < argc; i++) fprintf(out, " %s", argv[i]);
+    fprintf(out, "\n# bits B1[:B2] N p others..., p - 1 has prime powers <= B1 (the largest prime in (B1 / 2, B1])"
+                 " and at most one prime in (B1, B2]\n");
+
+    int failed = 0;
+    for (size_t i = 0; i < lines.size(); i++) {
+        if (lines[i].empty()) {
+            fprintf(stderr, "No %u bit N with B1 %lu, B2 %lu fits: the hidden factor needs more prime powers than B1 "
+                            "offers, or leaves too little room for the other primes\n", specs[i].bits, specs[i].b1,
+                    specs[i].b2);
+            failed = -1;
+            continue;
+        }
+        fprintf(out, "%s\n", lines[i].c_str());
+    }
+    if (out != stdout) fclose(out);
+    return failed;
 }
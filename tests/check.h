@@ -0,0 +1,42 @@
+#ifndef __CHECK_H__
+#define __CHECK_H__
+
+#include <cstdio>
+#include <vector>
+
+#include "../primegen/primegen.h"
+
+/*
+ * Minimal assertions for the test executables: a failed CHECK reports its
+ * location and the test keeps going, main returns check_result() so CTest
+ * sees the failure.
+ */
+static unsigned check_failures = 0;
+
+#define CHECK(cond)                                                                  \
+    do {                                                                             \
+        if (!(cond)) {                                                               \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            check_failures++;                                                        \
+        }                                                                            \
+    } while (0)
+
+static inline int check_result(const char *name) {
+    if (check_failures != 0) {
+        fprintf(stderr, "%s: %u check(s) failed\n", name, check_failures);
+        return 1;
+    }
+    printf("%s: ok\n", name);
+    return 0;
+}
+
+// the primes below `limit`, a small stand-in for the 20M prime table
+static inline std::vector<unsigned> check_prime_table(unsigned limit) {
+    std::vector<unsigned> primes;
+    primegen pg;
+    primegen_init(&pg);
+    for (uint64 p = primegen_next(&pg); p < limit; p = primegen_next(&pg)) primes.push_back((unsigned) p);
+    return primes;
+}
+
+#endif /* __CHECK_H__ */
@@ -0,0 +1,17 @@
+#include <gmp.h>
+
+#include "../pollard/gpu_context.h"
+#include "../pollard/kernel.h"
+
+// the entry points of kernel.cu for test executables, which link the host objects only
+int gpu_factorize(GpuContext &, mpz_t, const b_schedule_t &, mpz_t *, unsigned *, ExponentCache *, GpuCancel *) {
+    return -1;
+}
+
+int cudaInitialize() {
+    return -1;
+}
+
+GpuContext *gpu_context_create(const unsigned [], const unsigned) {
+    return nullptr;
+}
@@ -0,0 +1,109 @@
+#include <cstdio>
+#include <vector>
+
+#include <gmp.h>
+
+#include "check.h"
+#include "../pollard/b_schedule.h"
+#include "../pollard/cpu_factor.h"
+
+// 128 bits, p - 1 is 1024-smooth (first entry of bench/e2e_corpus.txt)
+#define SMOOTH_N "83245e6dc8dd7564101ece6755b58dbb"
+#define SMOOTH_P "62d311d75a11fb3"
+
+static std::vector<unsigned> schedule_values(const b_schedule_t &schedule) {
+    std::vector<unsigned> values;
+    unsigned B;
+    for (unsigned step = 0; b_schedule_at(schedule, step, &B); step++) values.push_back(B);
+    return values;
+}
+
+static void check_kinds() {
+    const b_schedule_t linear = b_schedule_make(B_SCHEDULE_LINEAR, 128, 0, 100, 1000);
+    CHECK(schedule_values(linear) == std::vector<unsigned>({100, 200, 300, 400, 500, 600, 700, 800, 900, 1000}));
+    CHECK(b_schedule_size(linear) == 10);
+
+    const b_schedule_t geometric = b_schedule_make(B_SCHEDULE_GEOMETRIC, 128, 0, 100, 100000);
+    const std::vector<unsigned> grown = schedule_values(geometric);
+    CHECK(grown.size() == b_schedule_size(geometric) && !grown.empty());
+    for (size_t i = 2; i < grown.size(); i++) CHECK(grown[i] - grown[i - 1] > grown[i - 1] - grown[i - 2]);
+    CHECK(grown.back() <= 100000);
+
+    // linear up to the knee, then increments grow
+    const b_schedule_t cost = b_schedule_make(B_SCHEDULE_COST_MODEL, 2048, 0, 1000, 1u << 24);
+    const std::vector<unsigned> mixed = schedule_values(cost);
+    CHECK(cost.knee_steps >= 4 && mixed.size() > cost.knee_steps + 1);
+    for (unsigned i = 0; i < cost.knee_steps; i++) CHECK(mixed[i] == 1000 * (i + 1));
+    CHECK(mixed[cost.knee_steps + 1] - mixed[cost.knee_steps] > 1000);
+}
+
+static void check_choice() {
+    CHECK(b_schedule_for_bits(64, 0, 10, 1000).kind == B_SCHEDULE_LINEAR);
+    CHECK(b_schedule_for_bits(B_SCHEDULE_LINEAR_BITS, 0, 10, 1000).kind == B_SCHEDULE_LINEAR);
+    CHECK(b_schedule_for_bits(B_SCHEDULE_LINEAR_BITS + 1, 0, 10, 1000).kind == B_SCHEDULE_COST_MODEL);
+
+    // wider moduli reach the geometric part sooner
+    CHECK(b_schedule_make(B_SCHEDULE_COST_MODEL, 512, 0, 100, 1u << 25).knee_steps >
+          b_schedule_make(B_SCHEDULE_COST_MODEL, 2048, 0, 100, 1u << 25).knee_steps);
+
+    b_schedule_kind_t kind;
+    for (int k = B_SCHEDULE_LINEAR; k <= B_SCHEDULE_COST_MODEL; k++) {
+        CHECK(b_schedule_parse(b_schedule_name((b_schedule_kind_t) k), &kind) == 0 && kind == k);
+    }
+    CHECK(b_schedule_parse("quadratic", &kind) != 0);
+}
+
+static void check_slices() {
+    const b_schedule_t schedule = b_schedule_make(B_SCHEDULE_COST_MODEL, 512, 0, 500, 1u << 22);
+    const std::vector<unsigned> full = schedule_values(schedule);
+    const unsigned cut = (unsigned) full.size() / 3;
+
+    const std::vector<unsigned> head = schedule_values(b_schedule_slice(schedule, 0, cut));
+    const std::vector<unsigned> tail = schedule_values(b_schedule_slice(schedule, cut, (unsigned) full.size()));
+    CHECK(head == std::vector<unsigned>(full.begin(), full.begin() + cut));
+    CHECK(tail == std::vector<unsigned>(full.begin() + cut, full.end()));
+
+    // a slice of a slice counts from its own first step
+    const b_schedule_t inner = b_schedule_slice(b_schedule_slice(schedule, cut, (unsigned) full.size()), 1, 3);
+    CHECK(schedule_values(inner) == std::vector<unsigned>(full.begin() + cut + 1, full.begin() + cut + 3));
+}
+
+// workers claim schedule steps from one counter: the factor is found in parallel as it is serially
+static void check_claims(const std::vector<unsigned> &primes) {
+    mpz_t n, p, factor;
+    mpz_init_set_str(n, SMOOTH_N, 16);
+    mpz_init_set_str(p, SMOOTH_P, 16);
+    mpz_init(factor);
+    const b_schedule_t schedule = b_schedule_make(B_SCHEDULE_LINEAR, 128, 0, 128, 4096);
+
+    unsigned serial_b = 0, parallel_b = 0;
+    CHECK(cpu_factorize(n, primes.data(), (unsigned) primes.size(), schedule, &factor, &serial_b) == 0);
+    CHECK(mpz_cmp(factor, p) == 0 && serial_b >= 1024);
+
+    for (unsigned threads : {2u, 3u, 8u}) {
+        mpz_set_ui(factor, 0);
+        CHECK(cpu_factorize_parallel(n, primes.data(), (unsigned) primes.size(), schedule, threads, &factor,
+                                     &parallel_b) == 0);
+        CHECK(mpz_cmp(factor, p) == 0 && parallel_b >= 1024);
+    }
+
+    // a schedule that stops short of the smoothness bound fails once every step is claimed
+    const b_schedule_t short_schedule = b_schedule_make(B_SCHEDULE_LINEAR, 128, 0, 128, 512);
+    mpz_set_ui(factor, 0);
+    CHECK(cpu_factorize_parallel(n, primes.data(), (unsigned) primes.size(), short_schedule, 4, &factor,
+                                 &parallel_b) != 0);
+    CHECK(mpz_cmp_ui(factor, 0) == 0);
+
+    mpz_clear(n);
+    mpz_clear(p);
+    mpz_clear(factor);
+}
+
+int main() {
+    const std::vector<unsigned> primes = check_prime_table(1u << 16);
+    check_kinds();
+    check_choice();
+    check_slices();
+    check_claims(primes);
+    return check_result("b_schedule");
+}
@@ -0,0 +1,198 @@
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gmp.h>
+
+#include "check.h"
+#include "../common/job_log.h"
+#include "../pollard/cpu_factor.h"
+#include "../pollard/exponent_cache.h"
+
+// 59 bits, p - 1 is 1024-smooth (the factor of the first entry of bench/e2e_corpus.txt)
+#define SMOOTH_P "62d311d75a11fb3"
+
+/*
+ * cpu_factorize_batch against separate cpu_factorize runs on the same moduli
+ * and schedule: the same factor at the same B for every modulus, for batches
+ * sharing product moduli and for ones too wide to, including moduli the batch
+ * hands back to cpu_factorize (gcd = n at base 2). Then the batcher, which
+ * gathers concurrent callers into batches.
+ */
+static std::vector<unsigned> primes;
+static std::string discarded; // progress output of cpu_factorize
+
+static void random_prime(mpz_t p, unsigned bits, gmp_randstate_t state) {
+    do {
+        mpz_urandomb(p, state, bits);
+        mpz_setbit(p, bits - 1);
+        mpz_nextprime(p, p);
+    } while (mpz_sizeinbase(p, 2) != bits);
+}
+
+// a prime of `bits` bits whose p - 1 is a product of distinct primes below 1000, powersmooth to 1024
+static void smooth_prime(mpz_t p, unsigned bits, gmp_randstate_t state) {
+    do {
+        mpz_set_ui(p, 2);
+        while (mpz_sizeinbase(p, 2) < bits) {
+            const unsigned q = primes[1 + gmp_urandomm_ui(state, 167)]; // the odd primes below 1000
+            if (!mpz_divisible_ui_p(p, q)) mpz_mul_ui(p, p, q);
+        }
+        mpz_add_ui(p, p, 1);
+    } while (mpz_sizeinbase(p, 2) != bits || mpz_probab_prime_p(p, 30) == 0);
+}
+
+// moduli of `bits` bits: balanced semiprimes without a factor below B, SMOOTH_P times a prime, both factors smooth
+static void make_moduli(std::vector<__mpz_struct> &n, unsigned bits, gmp_randstate_t state) {
+    mpz_t p, q;
+    mpz_init(p);
+    mpz_init(q);
+    for (size_t i = 0; i < n.size(); i++) {
+        mpz_init(&n[i]);
+        do {
+            switch (i % 4) {
+                case 1:
+                    mpz_set_str(p, SMOOTH_P, 16);
+                    random_prime(q, bits - 59, state);
+                    break;
+                case 3:
+                    smooth_prime(p, bits / 2, state);
+                    smooth_prime(q, bits - bits / 2, state);
+                    break;
+                default:
+                    random_prime(p, bits / 2, state);
+                    random_prime(q, bits - bits / 2, state);
+                    break;
+            }
+            mpz_mul(&n[i], p, q);
+        } while (mpz_sizeinbase(&n[i], 2) != bits);
+    }
+    mpz_clear(p);
+    mpz_clear(q);
+}
+
+static void check_batch(unsigned bits, ExponentCache &exponents, gmp_randstate_t state) {
+    const size_t count = 10;
+    std::vector<__mpz_struct> n(count), batch(count), single(count);
+    make_moduli(n, bits, state);
+    for (size_t i = 0; i < count; i++) {
+        mpz_init(&batch[i]);
+        mpz_init(&single[i]);
+    }
+    const b_schedule_t schedule = b_schedule_make(B_SCHEDULE_LINEAR, bits, 0, 512, 4096);
+
+    std::vector<unsigned> batch_b(count), single_b(count, 0);
+    const int found = cpu_factorize_batch((mpz_t *) n.data(), count, primes.data(), (unsigned) primes.size(),
+                                          schedule, (mpz_t *) batch.data(), batch_b.data(), &exponents);
+    int single_found = 0;
+    for (size_t i = 0; i < count; i++) {
+        JobLogScope log_scope(discarded);
+        if (cpu_factorize(&n[i], primes.data(), (unsigned) primes.size(), schedule, (mpz_t *) &single[i],
+                          &single_b[i], nullptr, &exponents) == 0) {
+            single_found++;
+        }
+        discarded.clear();
+
+        if (batch_b[i] != single_b[i] || (single_b[i] != 0 && mpz_cmp(&batch[i], &single[i]) != 0)) {
+            gmp_fprintf(stderr, "Batch mismatch: %u bits, N 0x%Zx: batch B %u 0x%Zx, single B %u 0x%Zx\n", bits,
+                        &n[i], batch_b[i], &batch[i], single_b[i], &single[i]);
+            CHECK(false);
+        }
+    }
+    CHECK(found == single_found);
+    CHECK(single_found >= (int) count / 4); // SMOOTH_P at least
+
+    for (size_t i = 0; i < count; i++) {
+        mpz_clear(&n[i]);
+        mpz_clear(&batch[i]);
+        mpz_clear(&single[i]);
+    }
+}
+
+// narrow moduli share a product up to CPU_BATCH_PRODUCT_BITS, wider ones are raised alone
+static void check_group() {
+    CHECK(cpu_batch_group(CPU_BATCH_BITS + 1) == 1 && cpu_batch_group(128) == 1 && cpu_batch_group(0) == 1);
+    for (unsigned bits = 65; bits <= CPU_BATCH_BITS; bits++) {
+        const unsigned group = cpu_batch_group(bits);
+        CHECK(group > 1 && group * bits <= CPU_BATCH_PRODUCT_BITS);
+    }
+}
+
+/*
+ * Concurrent callers on inputs of one width join open batches while the
+ * stand-in queue reports callers still to come, and every one gets the result
+ * of its own input.
+ */
+static void check_batcher(ExponentCache &exponents, gmp_randstate_t state) {
+    const unsigned bits = 80, callers = 7;
+    std::vector<__mpz_struct> n(callers), result(callers), single(callers);
+    make_moduli(n, bits, state);
+    for (unsigned i = 0; i < callers; i++) {
+        mpz_init(&result[i]);
+        mpz_init(&single[i]);
+    }
+    const b_schedule_t schedule = b_schedule_make(B_SCHEDULE_LINEAR, bits, 0, 512, 4096);
+
+    std::atomic<unsigned> entered(0);
+    CpuBatcher batcher(primes.data(), (unsigned) primes.size(), &exponents, [&](unsigned) {
+        return callers - entered.load();
+    }, 10000000);
+    CHECK(batcher.accepts(&n[0], schedule));
+
+    std::vector<int> res(callers);
+    std::vector<unsigned> b_found(callers, 0);
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < callers; i++) {
+        threads.emplace_back([&, i]() {
+            std::string log;
+            JobLogScope log_scope(log);
+            entered++;
+            res[i] = batcher.factorize(&n[i], schedule, (mpz_t *) &result[i], &b_found[i]);
+        });
+    }
+    for (auto &thread : threads) thread.join();
+
+    for (unsigned i = 0; i < callers; i++) {
+        unsigned single_b = 0;
+        JobLogScope log_scope(discarded);
+        const int single_res = cpu_factorize(&n[i], primes.data(), (unsigned) primes.size(), schedule,
+                                             (mpz_t *) &single[i], &single_b, nullptr, &exponents);
+        discarded.clear();
+        CHECK(res[i] == single_res && b_found[i] == (single_res == 0 ? single_b : 0));
+        CHECK(single_res != 0 || mpz_cmp(&result[i], &single[i]) == 0);
+    }
+    CHECK(batcher.batches() >= 1);
+
+    // a deadline or a wide input is left to cpu_factorize
+    b_schedule_t timed = schedule;
+    timed.deadline_us = 1;
+    CHECK(!batcher.accepts(&n[0], timed));
+    mpz_t wide;
+    mpz_init_set_ui(wide, 1);
+    mpz_mul_2exp(wide, wide, CPU_BATCH_BITS);
+    CHECK(!batcher.accepts(wide, schedule));
+    mpz_clear(wide);
+
+    for (unsigned i = 0; i < callers; i++) {
+        mpz_clear(&n[i]);
+        mpz_clear(&result[i]);
+        mpz_clear(&single[i]);
+    }
+}
+
+int main() {
+    primes = check_prime_table(1u << 16);
+    ExponentCache exponents(primes.data(), (unsigned) primes.size());
+    gmp_randstate_t state;
+    gmp_randinit_default(state);
+    gmp_randseed_ui(state, 42);
+
+    check_group();
+    for (unsigned bits : {66u, 80u, 90u, 96u, 128u, 256u}) check_batch(bits, exponents, state);
+    check_batcher(exponents, state);
+
+    gmp_randclear(state);
+    return check_result("cpu_batch");
+}
@@ -0,0 +1,96 @@
+#include <cstdio>
+#include <string>
+
+#include <gmp.h>
+
+#include "check.h"
+#include "../common/factor_db.h"
+#include "../common/factor_list.h"
+
+#define DB_FILE "test_factor_db.log"
+
+static std::string read_file(const char *filename) {
+    std::string text;
+    FILE *file = fopen(filename, "r");
+    if (file == nullptr) return text;
+    int c;
+    while ((c = fgetc(file)) != EOF) text += (char) c;
+    fclose(file);
+    return text;
+}
+
+static void write_file(const char *filename, const char *text) {
+    FILE *file = fopen(filename, "w");
+    fputs(text, file);
+    fclose(file);
+}
+
+static bool has_record(FactorDb &db, const char *n_hex) {
+    mpz_t n;
+    mpz_init_set_str(n, n_hex, 16);
+    FactorList factors;
+    const bool found = db.lookup(n, factors);
+    mpz_clear(n);
+    return found;
+}
+
+// 0x3c3 = 963 = 3^2 * 107, 0x8f = 143 = 11 * 13, 0x4d = 77 = 7 * 11
+static void check_validation() {
+    write_file(DB_FILE, FACTOR_DB_HEADER "\n"
+                        "3c3 3^2 6b^1\n"  // valid
+                        "8f b^1 d^2\n"    // product 1859 is not 143
+                        "4d 7^1 f^1\n"    // 15 is not prime
+                        "4d 7^1x\n"       // malformed power
+                        "8f b^1 d^1\n");  // valid
+    FactorDb db;
+    CHECK(db.open(DB_FILE) == 0);
+    CHECK(has_record(db, "3c3"));
+    CHECK(has_record(db, "8f"));
+    CHECK(!has_record(db, "4d"));
+    CHECK(db.size() == 2);
+}
+
+// a crash in the middle of a write: the partial line is dropped and the next record starts on its own line
+static void check_torn_log() {
+    write_file(DB_FILE, FACTOR_DB_HEADER "\n"
+                        "3c3 3^2 6b^1\n"
+                        "8f b^1 d^");
+    {
+        FactorDb db;
+        CHECK(db.open(DB_FILE) == 0);
+        CHECK(has_record(db, "3c3"));
+        CHECK(!has_record(db, "8f"));
+
+        mpz_t n, p;
+        mpz_init_set_ui(n, 77);
+        mpz_init(p);
+        FactorList factors;
+        mpz_set_ui(p, 7);
+        factors.add(p, 1);
+        mpz_set_ui(p, 11);
+        factors.add(p, 1);
+        CHECK(db.record(n, factors) == 0);
+        mpz_clear(n);
+        mpz_clear(p);
+    }
+    CHECK(read_file(DB_FILE) == FACTOR_DB_HEADER "\n3c3 3^2 6b^1\n8f b^1 d^\n4d 7^1 b^1\n");
+
+    FactorDb reopened;
+    CHECK(reopened.open(DB_FILE) == 0);
+    CHECK(has_record(reopened, "4d"));
+    CHECK(has_record(reopened, "3c3"));
+    CHECK(!has_record(reopened, "8f"));
+
+    // a cut that still parses (d^1 of d^12) is dropped as well
+    write_file(DB_FILE, FACTOR_DB_HEADER "\n8f b^1 d^1");
+    FactorDb cut;
+    CHECK(cut.open(DB_FILE) == 0);
+    CHECK(!has_record(cut, "8f"));
+}
+
+int main() {
+    check_validation();
+    check_torn_log();
+    remove(DB_FILE);
+    return check_result("factor_db");
+}
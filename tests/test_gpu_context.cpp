@@ -0,0 +1,108 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+#include "../common/get_timestamp.h"
+#include "../pollard/device_api.h"
+#include "../pollard/exponent_cache.h"
+#include "../pollard/gpu_context.h"
+
+static void sleep_ms(unsigned ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+static long long test_clock_us = 0; // the clock of check_deadlines, moved only by the test
+
+static long long test_clock() {
+    return test_clock_us;
+}
+
+// the completion flag of a launch is set once the clock passes its deadline, and never after disarm
+static void check_deadlines() {
+    test_clock_us = 1000000;
+    GpuDeadlines deadlines(test_clock);
+    volatile bool early = false, late = false, disarmed = false;
+    GpuCancel early_cancel, late_cancel, disarmed_cancel;
+    early_cancel.attach(&early);
+    late_cancel.attach(&late);
+    disarmed_cancel.attach(&disarmed);
+
+    deadlines.arm(&late_cancel, test_clock_us + 200000);
+    deadlines.arm(&early_cancel, test_clock_us + 20000);
+    deadlines.arm(&disarmed_cancel, test_clock_us + 100000);
+    deadlines.disarm(&disarmed_cancel);
+
+    deadlines.expire();
+    CHECK(!early && !early_cancel.cancelled());
+    test_clock_us += 80000;
+    deadlines.expire();
+    CHECK(early && early_cancel.cancelled());
+    CHECK(!late && !late_cancel.cancelled());
+    test_clock_us += 200000;
+    deadlines.expire();
+    CHECK(late && late_cancel.cancelled());
+    CHECK(!disarmed && !disarmed_cancel.cancelled());
+    deadlines.disarm(&early_cancel); // already fired, nothing left to remove
+
+    // a deadline that passed before the launch attached stops it as soon as it does
+    GpuCancel queued_cancel;
+    deadlines.arm(&queued_cancel, test_clock_us);
+    deadlines.expire();
+    volatile bool queued = false;
+    queued_cancel.attach(&queued);
+    CHECK(queued);
+    deadlines.disarm(&queued_cancel);
+}
+
+// the timer thread fires on the real clock without anyone calling expire()
+static void check_deadline_timer() {
+    GpuDeadlines deadlines;
+    volatile bool flag = false;
+    GpuCancel cancel;
+    cancel.attach(&flag);
+    deadlines.arm(&cancel, get_timestamp());
+    const long long give_up = get_timestamp() + 10000000;
+    while (!cancel.cancelled() && get_timestamp() < give_up) sleep_ms(1);
+    CHECK(flag && cancel.cancelled());
+    deadlines.disarm(&cancel);
+}
+
+// the GPU context over the host device layer: slots and pooled buffers are reused, nothing outlives the context
+static void check_reuse() {
+    const std::vector<unsigned> primes = check_prime_table(1u << 20);
+    const unsigned primes_num = (unsigned) primes.size();
+    ExponentCache exponents(primes.data(), primes_num);
+    HostDeviceApi api;
+    {
+        GpuContext context(api, 64);
+        CHECK(context.initialize() == 0 && context.load_primes(primes.data(), primes_num) == 0);
+        CHECK(memcmp(context.primes(), primes.data(), primes_num * sizeof(primes[0])) == 0);
+        // uploaded once
+        const prime_groups_view_t groups = context.prime_groups(&exponents, 256, 1u << 20);
+        CHECK(groups.count > 0 && context.prime_groups(&exponents, 256, 1u << 20).words == groups.words);
+
+        const unsigned long long allocations = api.allocations();
+        for (unsigned i = 0; i < 100; i++) {
+            GpuStreamLease lease(context);
+            void *result = context.acquire(260);
+            void *large = context.acquire(40000);
+            context.release(result);
+            context.release(large);
+        }
+        CHECK(api.allocations() == allocations + 2);
+
+        GpuStreamLease first(context), second(context);
+        CHECK(&first.slot != &second.slot && first.slot.stream != second.slot.stream);
+    }
+    CHECK(api.live() == 0);
+}
+
+int main() {
+    check_deadlines();
+    check_deadline_timer();
+    check_reuse();
+    return check_result("gpu_context");
+}
@@ -0,0 +1,160 @@
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <gmp.h>
+
+#include "check.h"
+#include "../common/get_timestamp.h"
+#include "../pollard/device_api.h"
+#include "../pollard/factor_algorithm.h"
+#include "../pollard/factor_job.h"
+#include "../pollard/gpu_context.h"
+
+// 128 bits, p - 1 is 1024-smooth (first entry of bench/e2e_corpus.txt)
+#define SMOOTH_N "83245e6dc8dd7564101ece6755b58dbb"
+#define SMOOTH_P "62d311d75a11fb3"
+
+/*
+ * The hybrid backend over a stand-in for the GPU search: a context on the
+ * host device layer, and a search that either returns a known factor at
+ * once or waits until it is cancelled, the way kernel instances poll the
+ * completion flag of their slot.
+ */
+static HostDeviceApi host_api;
+static mpz_t device_factor; // returned by the stand-in, 0 while it waits for the cancel
+static int device_error = 0; // returned by the stand-in instead of searching when set
+static std::mutex seen_lock;
+static std::set<std::thread::id> launch_threads;
+static unsigned launches = 0, cancelled = 0;
+
+static GpuContext *host_context_create(const unsigned prime_table[], const unsigned primes_num) {
+    GpuContext *context = new GpuContext(host_api, 64);
+    if (context->initialize() != 0 || context->load_primes(prime_table, primes_num) != 0) {
+        delete context;
+        return nullptr;
+    }
+    return context;
+}
+
+static int host_search(GpuContext &context, mpz_t n, const b_schedule_t &schedule, mpz_t *factor, unsigned *b_found,
+                       ExponentCache *exponents, GpuCancel *cancel) {
+    (void) n;
+    (void) exponents;
+    if (device_error != 0) return device_error;
+    GpuStreamLease lease(context);
+    void *buffer = context.acquire(4096);
+    *lease.slot.completed = false;
+    cancel->attach(lease.slot.completed);
+
+    int res = 0;
+    *b_found = 0;
+    if (mpz_sgn(device_factor) != 0) {
+        mpz_set(*factor, device_factor);
+        b_schedule_at(schedule, 0, b_found);
+    } else {
+        const long long give_up = get_timestamp() + 10000000;
+        while (!*lease.slot.completed && get_timestamp() < give_up) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (!*lease.slot.completed) res = -1;
+    }
+    cancel->detach();
+    context.release(buffer);
+
+    std::lock_guard<std::mutex> guard(seen_lock);
+    launch_threads.insert(std::this_thread::get_id());
+    launches++;
+    if (*b_found == 0 && res == 0) cancelled++;
+    return res;
+}
+
+// the CPU steps find the factor first, the waiting launch is cancelled
+static void check_cpu_wins(HybridFactorAlgorithm &alg) {
+    mpz_t n, p, factor;
+    mpz_init_set_str(n, SMOOTH_N, 16);
+    mpz_init_set_str(p, SMOOTH_P, 16);
+    mpz_init(factor);
+    mpz_set_ui(device_factor, 0);
+    const b_schedule_t schedule = b_schedule_make(B_SCHEDULE_LINEAR, 128, 0, 256, 1u << 20);
+
+    const unsigned cancelled_before = cancelled;
+    unsigned b_found = 0;
+    CHECK(alg.factorize_single(n, schedule, &factor, &b_found) == 0);
+    CHECK(mpz_cmp(factor, p) == 0 && b_found >= 1024 && b_found <= alg.cpu_b_max);
+    CHECK(cancelled == cancelled_before + 1);
+
+    mpz_clear(n);
+    mpz_clear(p);
+    mpz_clear(factor);
+}
+
+// the launch finds the factor first and the CPU workers stop at their next step
+static void check_device_wins(HybridFactorAlgorithm &alg) {
+    gmp_randstate_t state;
+    gmp_randinit_default(state);
+    gmp_randseed_ui(state, 49);
+    mpz_t n, p, q, factor;
+    mpz_inits(n, p, q, factor, nullptr);
+    mpz_urandomb(p, state, 256);
+    mpz_setbit(p, 255);
+    mpz_nextprime(p, p);
+    mpz_urandomb(q, state, 256);
+    mpz_setbit(q, 255);
+    mpz_nextprime(q, q);
+    mpz_mul(n, p, q);
+    mpz_set(device_factor, p);
+    const b_schedule_t schedule = b_schedule_make(B_SCHEDULE_LINEAR, 512, 0, 8192, 1u << 23);
+
+    const unsigned cpu_b_max = alg.cpu_b_max;
+    alg.cpu_b_max = 1u << 22; // hundreds of CPU steps, far longer than the test runs
+    const long long start = get_timestamp();
+    unsigned b_found = 0;
+    CHECK(alg.factorize_single(n, schedule, &factor, &b_found) == 0);
+    CHECK(get_timestamp() - start < 5000000);
+    CHECK(mpz_cmp(factor, p) == 0 && b_found > alg.cpu_b_max);
+    alg.cpu_b_max = cpu_b_max;
+
+    mpz_clears(n, p, q, factor, nullptr);
+    gmp_randclear(state);
+}
+
+// an error the device reports reaches the job, which ends the input with POLLARD_ERROR
+static void check_device_error(HybridFactorAlgorithm &alg) {
+    FactorJob job(SMOOTH_N, false);
+    const unsigned cpu_b_max = alg.cpu_b_max;
+    alg.cpu_b_max = 0; // every step on the device
+    device_error = GPU_DEVICE_ERROR;
+    job.run(&alg, nullptr);
+    CHECK(job.device_error && !job.complete());
+    device_error = 0;
+    alg.cpu_b_max = cpu_b_max;
+}
+
+int main() {
+    const std::vector<unsigned> primes = check_prime_table(1u << 23);
+    mpz_init(device_factor);
+    {
+        HybridFactorAlgorithm alg;
+        alg.device = {host_context_create, host_search};
+        alg.threads = 2;
+        CHECK(alg.initialize(primes.data(), (unsigned) primes.size()) == 0);
+        CHECK(alg.context != nullptr);
+        for (unsigned i = 0; i < 3; i++) {
+            check_cpu_wins(alg);
+            check_device_wins(alg);
+        }
+        CHECK(launches == 6);
+        check_device_error(alg);
+        // the launches run on the backend's launcher threads, none is started per call
+        CHECK(!launch_threads.empty() && launch_threads.size() <= DEVICE_QUEUE_DEPTH);
+        CHECK(launch_threads.count(std::this_thread::get_id()) == 0);
+        alg.clean();
+        CHECK(host_api.live() == 0);
+    }
+    mpz_clear(device_factor);
+    return check_result("hybrid");
+}
@@ -0,0 +1,86 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+#include "../common/get_timestamp.h"
+#include "../common/job_scheduler.h"
+#include "../common/numa.h"
+
+// cpulist parsing as in /sys/devices/system/node/node*/cpulist
+static void check_cpulist() {
+    std::vector<unsigned> cpus;
+    CHECK(numa_parse_cpulist("0-3,8,10-11\n", cpus) == 0);
+    CHECK(cpus == std::vector<unsigned>({0, 1, 2, 3, 8, 10, 11}));
+    CHECK(numa_parse_cpulist("3-1", cpus) != 0);
+    CHECK(numa_parse_cpulist("0,x", cpus) != 0);
+}
+
+// per-node queues, two nodes even on a single-node host: every job runs and workers read their node's copy
+static void check_node_queues() {
+    const std::vector<unsigned> table = {2, 3, 5, 7, 11, 13};
+    NumaReplicas replicas(table.data(), table.size() * sizeof(unsigned));
+    CHECK(memcmp(replicas.local(), table.data(), table.size() * sizeof(unsigned)) == 0);
+
+    std::atomic<unsigned> done(0);
+    {
+        JobScheduler scheduler(3, 2, 16, 2);
+        for (unsigned i = 0; i < 40; i++) {
+            scheduler.submit(i % 2, (int) (i % 3), i, [&]() {
+                if (memcmp(replicas.local(), table.data(), table.size() * sizeof(unsigned)) == 0) done++;
+            }, true);
+        }
+        scheduler.wait();
+        const job_class_stats_t low = scheduler.stats(0), high = scheduler.stats(1);
+        CHECK(low.completed + high.completed == 40);
+        CHECK(low.depth == 0 && high.depth == 0);
+    }
+    CHECK(done.load() == 40);
+}
+
+/*
+ * Idle workers are woken for every job however many wake-ups went to
+ * workers that found the queues empty: after a burst of tiny jobs stolen
+ * across nodes, as many long jobs as workers all start at once.
+ */
+static void check_idle_wakeups() {
+    const unsigned workers = 4;
+    JobScheduler scheduler(workers, 1, 1024, 2);
+    for (unsigned round = 0; round < 20; round++) {
+        for (unsigned i = 0; i < 200; i++) scheduler.submit(0, 0, 1, []() {}, true);
+        scheduler.wait();
+
+        std::mutex starts_lock;
+        std::vector<long long> starts;
+        const long long submitted = get_timestamp();
+        for (unsigned i = 0; i < workers; i++) {
+            scheduler.submit(0, 0, 1, [&]() {
+                {
+                    std::lock_guard<std::mutex> guard(starts_lock);
+                    starts.push_back(get_timestamp());
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }, true);
+        }
+        scheduler.wait();
+
+        long long latest = 0;
+        for (long long start : starts) latest = std::max(latest, start - submitted);
+        if (latest >= 50000) {
+            fprintf(stderr, "round %u: a long job waited %lld us for an idle worker\n", round, latest);
+            CHECK(latest < 50000);
+            return;
+        }
+    }
+}
+
+int main() {
+    check_cpulist();
+    check_node_queues();
+    check_idle_wakeups();
+    return check_result("job_scheduler");
+}
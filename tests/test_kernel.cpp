@@ -0,0 +1,114 @@
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include <gmp.h>
+
+#include "check.h"
+#include "../pollard/exponent_cache.h"
+#include "../pollard/gpu_context.h"
+#include "../pollard/host_kernel.h"
+#include "../pollard/kernel.h"
+#include "../pollard/width_class.h"
+
+// 59 bits, p - 1 is 1024-smooth (the factor of the first entry of bench/e2e_corpus.txt)
+#define SMOOTH_P "62d311d75a11fb3"
+
+#define SKIPPED 77 // CTest SKIP_RETURN_CODE, no CUDA device to run on
+
+/*
+ * kernel.cu against the host kernel, which runs the same stage 1 loop and
+ * instance driver on host threads: for every width class, the same inputs
+ * and schedules give the same results on both, from scratch and when the
+ * stored residues of an earlier call are extended. Built with nvcc only,
+ * skipped on machines without a device.
+ */
+struct search_t {
+    int res;
+    unsigned b;
+    mpz_t factor;
+
+    search_t() : res(-1), b(0) {
+        mpz_init(factor);
+    }
+
+    ~search_t() {
+        mpz_clear(factor);
+    }
+};
+
+// p times random primes of 32 to 256 bits, together exactly in width class `c`
+static void class_input(mpz_t n, const mpz_t p, unsigned c, gmp_randstate_t state) {
+    const unsigned bits = width_class_bits[c];
+    mpz_t q;
+    mpz_init(q);
+    do {
+        mpz_set(n, p);
+        while (mpz_sizeinbase(n, 2) < bits) {
+            const unsigned left = bits - (unsigned) mpz_sizeinbase(n, 2);
+            const unsigned q_bits = left > 256 ? 256 : (left > 32 ? left : 32);
+            mpz_urandomb(q, state, q_bits);
+            mpz_setbit(q, q_bits - 1);
+            mpz_nextprime(q, q);
+            mpz_mul(n, n, q);
+        }
+    } while (width_class_of(n) != c);
+    mpz_clear(q);
+}
+
+static void check_class(GpuContext &context, HostKernel &host, ExponentCache &exponents, unsigned c,
+                        gmp_randstate_t state) {
+    const unsigned bits = width_class_bits[c];
+    mpz_t n, p;
+    mpz_init(n);
+    mpz_init_set_str(p, SMOOTH_P, 16);
+    class_input(n, p, c, state);
+
+    // below the smoothness bound of p nothing is found; then the residues of that call are extended up to it
+    const b_schedule_t short_schedule = b_schedule_make(B_SCHEDULE_LINEAR, bits, 0, 128, 512);
+    const b_schedule_t schedule = b_schedule_make(B_SCHEDULE_LINEAR, bits, 0, 128, 4096);
+    for (const b_schedule_t *s : {&short_schedule, &schedule}) {
+        search_t device, reference;
+        device.res = gpu_factorize(context, n, *s, &device.factor, &device.b, &exponents);
+        reference.res = host.factorize(n, *s, &reference.factor, &reference.b, &exponents);
+
+        const bool found = s == &schedule;
+        bool same = device.res == 0 && reference.res == 0;
+        if (found) {
+            // instances race for the first factor, any step from p's bound on finds p
+            same = same && device.b >= 1024 && reference.b >= 1024 && mpz_cmp(device.factor, p) == 0 &&
+                   mpz_cmp(reference.factor, p) == 0;
+        } else {
+            same = same && device.b == 0 && reference.b == 0 && mpz_sgn(device.factor) == 0 &&
+                   mpz_sgn(reference.factor) == 0;
+        }
+        if (!same) {
+            gmp_fprintf(stderr, "Kernel mismatch: %u bit class, N 0x%Zx, B up to %u: device %d B %u 0x%Zx, "
+                                "host %d B %u 0x%Zx\n", bits, n, s->b_max, device.res, device.b, device.factor,
+                        reference.res, reference.b, reference.factor);
+            CHECK(same);
+        }
+    }
+
+    mpz_clear(n);
+    mpz_clear(p);
+}
+
+int main() {
+    const std::vector<unsigned> primes = check_prime_table(1u << 20);
+    const unsigned primes_num = (unsigned) primes.size();
+    std::unique_ptr<GpuContext> context(gpu_context_create(primes.data(), primes_num));
+    if (context == nullptr) {
+        printf("kernel: no CUDA device, skipped\n");
+        return SKIPPED;
+    }
+    ExponentCache exponents(primes.data(), primes_num);
+    HostKernel host(primes.data(), 4);
+
+    gmp_randstate_t state;
+    gmp_randinit_default(state);
+    gmp_randseed_ui(state, 48);
+    for (unsigned c = 0; c < WIDTH_CLASSES; c++) check_class(*context, host, exponents, c, state);
+    gmp_randclear(state);
+    return check_result("kernel");
+}
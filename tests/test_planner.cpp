@@ -0,0 +1,72 @@
+#include <cmath>
+#include <cstdio>
+
+#include "check.h"
+#include "../pollard/planner.h"
+
+static cost_model_t sample_model() {
+    cost_model_t model;
+    model.bits = {64, 256, 1024};
+    model.ns_per_bit = {10, 40, 640};
+    return model;
+}
+
+static void check_cost_model() {
+    const cost_model_t model = sample_model();
+    CHECK(fabs(cost_model_ns_per_bit(model, 64) - 10) < 1e-9);
+    CHECK(fabs(cost_model_ns_per_bit(model, 256) - 40) < 1e-9);
+    CHECK(fabs(cost_model_ns_per_bit(model, 128) - 20) < 1e-9); // log-log midpoint
+    CHECK(cost_model_ns_per_bit(model, 2048) > 640);
+
+    const char *path = "test_planner_cost_model.txt";
+    cost_model_t loaded;
+    CHECK(cost_model_save(model, path) == 0);
+    CHECK(cost_model_load(&loaded, path) == 0);
+    CHECK(loaded.bits == model.bits && loaded.ns_per_bit.size() == model.ns_per_bit.size());
+    remove(path);
+}
+
+static void check_rho() {
+    CHECK(dickman_rho(0.5) == 1);
+    CHECK(fabs(dickman_rho(2) - (1 - log(2.0))) < 1e-9);
+    CHECK(fabs(dickman_rho(3) - 0.0486083882) < 1e-4);
+    CHECK(dickman_rho(5) < dickman_rho(4) && dickman_rho(5) > 0);
+}
+
+static void check_plans() {
+    const cost_model_t model = sample_model();
+    const b_schedule_t schedule = b_schedule_make(B_SCHEDULE_LINEAR, 256, 0, 1000, 1u << 20);
+
+    // B1 and the predicted time grow with the budget and stay within it
+    unsigned previous_b1 = 0;
+    for (long long budget : {1000LL, 100000LL, 10000000LL}) {
+        const factor_plan_t plan = plan_for_deadline(model, schedule, 256, 1, budget);
+        CHECK(plan.b1 >= previous_b1);
+        CHECK(plan.expected_us <= budget);
+        CHECK(plan.b2 == 0);
+        previous_b1 = plan.b1;
+    }
+
+    // more workers share the steps, an incremental search pays only for the largest B
+    const factor_plan_t one = plan_for_deadline(model, schedule, 256, 1, 1000000);
+    const factor_plan_t four = plan_for_deadline(model, schedule, 256, 4, 1000000);
+    const factor_plan_t incremental = plan_for_deadline(model, schedule, 256, 1, 1000000, true);
+    CHECK(four.b1 > one.b1);
+    CHECK(incremental.b1 > one.b1);
+    CHECK(four.success >= one.success);
+
+    // a budget beyond the whole schedule repeats it, up to PLAN_MAX_PASSES times
+    const factor_plan_t whole = plan_for_deadline(model, b_schedule_make(B_SCHEDULE_LINEAR, 256, 0, 1000, 10000),
+                                                  256, 1, 1LL << 40);
+    CHECK(whole.b1 == 10000 && whole.passes == PLAN_MAX_PASSES);
+
+    // no budget: nothing beyond b_start
+    CHECK(plan_for_deadline(model, schedule, 256, 1, 0).b1 == schedule.b_start);
+}
+
+int main() {
+    check_cost_model();
+    check_rho();
+    check_plans();
+    return check_result("planner");
+}
@@ -0,0 +1,113 @@
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <gmp.h>
+
+#include "check.h"
+#include "../common/hex.h"
+#include "../pollard/residue_store.h"
+#include "../pollard/stage1_instance.h"
+
+static void *record(uintptr_t id) {
+    return (void *) id;
+}
+
+static std::string list_of(const std::vector<int> &values) {
+    std::string text;
+    for (int value : values) text += (text.empty() ? "" : " ") + std::to_string(value);
+    return "[" + text + "]";
+}
+
+// plans `steps` for n and reports, with the N and the B range, every field that differs from the expectation
+static void check_plan(ResidueStore &store, mpz_t n, unsigned bits, const std::vector<unsigned> &steps,
+                       void *sources, unsigned count, bool reduce, const std::vector<int> &source,
+                       std::vector<void *> &released) {
+    residue_plan_t plan;
+    store.plan(n, bits, steps, &plan, released);
+    if (plan.sources == sources && (sources == nullptr || (plan.count == count && plan.reduce == reduce)) &&
+        plan.source == source) {
+        return;
+    }
+    fprintf(stderr, "Residue plan mismatch: N 0x%s, %u bits, B %u to %u: sources %p (expected %p), "
+                    "count %u (%u), reduce %d (%d), steps %s (%s)\n",
+            to_hex(n).c_str(), bits, steps.front(), steps.back(), plan.sources, sources, plan.count, count,
+            plan.reduce, reduce, list_of(plan.source).c_str(), list_of(source).c_str());
+    check_failures++;
+}
+
+/*
+ * A linear schedule whose B step has halved many times keeps at most
+ * max_records records, evenly spaced over its steps, and a later launch
+ * extends the nearest of them.
+ */
+static void check_record_cap() {
+    const unsigned cap = 16;
+    ResidueStore store(2, cap);
+    std::vector<void *> released;
+    mpz_t n;
+    mpz_init_set_ui(n, 1155);
+
+    for (unsigned steps : {1u, cap, cap + 1, 1000u, 1u << 22}) {
+        const unsigned stride = store.stride(steps), count = store.records(steps);
+        CHECK(count >= 1 && count <= cap);
+        CHECK(count == steps / stride && (stride == 1) == (steps <= cap));
+        unsigned kept = 0; // the steps that write a record, each to its own
+        for (unsigned i = 0; i < steps; i++) {
+            if (residue_kept(i, stride)) {
+                CHECK(i / stride == kept);
+                kept++;
+            }
+        }
+        CHECK(kept == count);
+    }
+
+    // B = 2, 4, ..., 2 * steps: only every stride-th B is kept, the finer steps extend the largest one below them
+    const unsigned steps = 1000, stride = store.stride(steps);
+    std::vector<unsigned> b(steps);
+    for (unsigned i = 0; i < steps; i++) b[i] = 2 * (i + 1);
+    store.store(n, 128, b, record(1), released);
+    std::vector<unsigned> finer = {2 * stride - 1, 2 * stride, 2 * stride + 1, 2 * steps + 1};
+    std::vector<int> source = {-1, 0, 0, (int) store.records(steps) - 1};
+    check_plan(store, n, 128, finer, record(1), store.records(steps), false, source, released);
+
+    mpz_clear(n);
+}
+
+// steps map to the largest earlier B, cofactors reuse their multiple's set at the same width
+int main() {
+    ResidueStore store(2);
+    std::vector<void *> released;
+    mpz_t n, cofactor;
+    mpz_init_set_ui(n, 1155); // 3 * 5 * 7 * 11
+    mpz_init_set_ui(cofactor, 385);
+
+    // nothing stored yet, every step starts from its base
+    check_plan(store, n, 128, {100, 200}, nullptr, 0, false, {-1, -1}, released);
+
+    // a plan takes its set out of the store
+    store.store(n, 128, {100, 200, 300}, record(1), released);
+    check_plan(store, n, 128, {50, 150, 250, 300, 400}, record(1), 3, false, {-1, 0, 1, 2, 2}, released);
+    CHECK(store.size() == 0);
+
+    // a cofactor extends the residues modulo its multiple after reducing them
+    store.store(n, 128, {100, 200}, record(2), released);
+    check_plan(store, cofactor, 128, {200}, record(2), 2, true, {1}, released);
+
+    // at another width the set cannot be used, and is released
+    store.store(n, 256, {100}, record(3), released);
+    check_plan(store, cofactor, 128, {200}, nullptr, 0, false, {-1}, released);
+    CHECK(released == std::vector<void *>({record(3)}));
+
+    // the oldest set beyond max_sets is released
+    released.clear();
+    for (uintptr_t id = 4; id <= 6; id++) store.store(n, 128, {100}, record(id), released);
+    CHECK(store.size() == 2);
+    CHECK(released == std::vector<void *>({record(4)}));
+
+    mpz_clear(n);
+    mpz_clear(cofactor);
+    check_record_cap();
+    return check_result("residue_store");
+}
@@ -0,0 +1,89 @@
+#include <cstdint>
+#include <cstdio>
+
+#include <gmp.h>
+
+#include "check.h"
+#include "../pollard/small_factor.h"
+
+// the first prime at or above `from`
+static uint64_t next_prime_u64(uint64_t from) {
+    mpz_t p;
+    mpz_init_set_ui(p, from - 1);
+    mpz_nextprime(p, p);
+    const uint64_t prime = mpz_get_ui(p);
+    mpz_clear(p);
+    return prime;
+}
+
+// small_factorize returns a prime factor of n, one of `expected` unless that is 0
+static void check_split(uint64_t n, uint64_t expected_p, uint64_t expected_q) {
+    mpz_t value, factor;
+    mpz_init_set_ui(value, n);
+    mpz_init(factor);
+    CHECK(small_factorize(value, &factor) == 0);
+    const uint64_t d = mpz_get_ui(factor);
+    if (d != expected_p && d != expected_q) {
+        fprintf(stderr, "small_factorize(%llu) gave %llu, expected %llu or %llu\n", (unsigned long long) n,
+                (unsigned long long) d, (unsigned long long) expected_p, (unsigned long long) expected_q);
+        CHECK(d == expected_p || d == expected_q);
+    }
+    mpz_clear(value);
+    mpz_clear(factor);
+}
+
+// balanced semiprimes of exactly `bits` bits, and one with a 16-bit factor
+static void check_semiprimes() {
+    for (unsigned bits : {32u, 48u, 62u, 63u, 64u}) {
+        const unsigned low = bits / 2, high = bits - low;
+        const uint64_t p = next_prime_u64((uint64_t) (0.75 * (double) (1ULL << low)));
+        const uint64_t q = next_prime_u64((uint64_t) (0.9 * (double) (1ULL << (high - 1)) * 2));
+        const uint64_t n = p * q;
+        CHECK(64 - __builtin_clzll(n) == (int) bits);
+        CHECK(!is_prime_u64(n) && is_prime_u64(p) && is_prime_u64(q));
+        check_split(n, p, q);
+
+        // each splitter on its own, SQUFOF included above 2^62
+        const uint64_t rho = rho_brent_u64(n, 1), squfof = squfof_u64(n);
+        CHECK(rho == p || rho == q);
+        CHECK(squfof == p || squfof == q);
+
+        const uint64_t small = next_prime_u64(40000);
+        const uint64_t large = next_prime_u64((1ULL << (bits - 1)) / small + 1);
+        check_split(small * large, small, large);
+    }
+}
+
+// squares, primes, even numbers and the inputs small_factorize refuses
+static void check_special() {
+    for (uint64_t p : {(uint64_t) 65521, next_prime_u64(3000000000ULL), (uint64_t) 4294967291ULL}) {
+        check_split(p * p, p, p);
+        CHECK(squfof_u64(p * p) == p);
+    }
+
+    for (uint64_t p : {(uint64_t) 2, (uint64_t) 3, (uint64_t) 65537, next_prime_u64(1ULL << 62), (uint64_t) 18446744073709551557ULL}) {
+        CHECK(is_prime_u64(p));
+        check_split(p, p, p);
+    }
+    CHECK(!is_prime_u64(0) && !is_prime_u64(1) && !is_prime_u64(3215031751ULL)); // a strong pseudoprime to 2, 3, 5, 7
+
+    check_split(2ULL * 4294967291ULL, 2, 2);
+    check_split(1ULL << 63, 2, 2);
+
+    mpz_t value, factor;
+    mpz_init(factor);
+    mpz_init_set_ui(value, 1);
+    CHECK(small_factorize(value, &factor) != 0);
+    mpz_set_ui(value, 1);
+    mpz_mul_2exp(value, value, 64);
+    mpz_add_ui(value, value, 1);
+    CHECK(small_factorize(value, &factor) != 0);
+    mpz_clear(value);
+    mpz_clear(factor);
+}
+
+int main() {
+    check_semiprimes();
+    check_special();
+    return check_result("small_factor");
+}
@@ -0,0 +1,112 @@
+#include <cstdio>
+#include <vector>
+
+#include <gmp.h>
+
+#include "check.h"
+#include "../pollard/cpu_factor.h"
+#include "../pollard/exponent_cache.h"
+#include "../pollard/host_bn.h"
+#include "../pollard/stage1_host.h"
+
+#define CHECK_SEED 1
+#define CHECK_PRIMES_LIMIT (1u << 18) // past the largest bound and the prime groups
+
+// odd, of exactly `bits` bits; the loop only needs an odd modulus, a prime search at 8192 bits would take longer
+// than all the checks
+static void random_modulus(mpz_t n, unsigned bits, gmp_randstate_t random) {
+    mpz_urandomb(n, random, bits);
+    mpz_setbit(n, bits - 1);
+    mpz_setbit(n, 0);
+}
+
+// the kernel's stage 1 loop run on the host against mpz_powm, with and without the prime groups, from the base
+// and extending a residue of an earlier bound; over GMP and over the fixed-width numbers of the host kernel
+template<class params>
+static void check_stage1_loop(ExponentCache &exponents, const unsigned *primes, unsigned primes_num,
+                              gmp_randstate_t random) {
+    typedef host_stage1_ops<params::BITS> ops;
+    typedef host_fixed_ops<params::BITS> fixed;
+    auto table = exponents.prime_groups(params::BITS / 2, 1u << 17);
+    const prime_groups_view_t with_groups = {table->words.data(), table->starts.data(), table->count()};
+    const prime_groups_view_t without_groups = {nullptr, nullptr, 0};
+
+    mpz_t e, tmp, expected;
+    mpz_init(e);
+    mpz_init(tmp);
+    mpz_init(expected);
+    host_mont_env_t env;
+    host_bn_t n, x;
+    random_modulus(n.v, params::BITS - 1, random);
+    typename fixed::env_t fixed_env;
+    typename fixed::bn_t fixed_n, fixed_x;
+    fixed::from_mpz(fixed_n, n.v);
+
+    // the wide instances only at small bounds, a host squaring there costs as much as the whole 128-bit run, and
+    // the widest extend a residue from one earlier bound
+    const std::vector<unsigned> bounds = params::BITS >= 2048 ? std::vector<unsigned>{1000u, 9001u}
+                                                              : std::vector<unsigned>{1000u, 60000u, 100003u};
+    for (unsigned B : bounds) {
+        primes_power(&e, primes, primes_num, B, &tmp);
+        for (const prime_groups_view_t *groups : {&with_groups, &without_groups}) {
+            for (unsigned b_from : params::BITS > 4096 ? std::vector<unsigned>{0u, B / 3}
+                                                       : std::vector<unsigned>{0u, B / 3, B / 40}) {
+                const unsigned base = 2 + B % 7;
+                unsigned prime_index = 0;
+                mpz_set_ui(x.v, base);
+                if (b_from > 0) stage1_power<ops, params>(env, x, n, primes, *groups, 0, b_from, prime_index,
+                                                          host_never_stop());
+                stage1_power<ops, params>(env, x, n, primes, *groups, b_from, B, prime_index, host_never_stop());
+                mpz_set_ui(expected, base);
+                mpz_powm(expected, expected, e, n.v);
+                if (mpz_cmp(x.v, expected) != 0 || primes[prime_index] <= B || primes[prime_index - 1] > B) {
+                    fprintf(stderr, "Stage 1 loop mismatch: %u bits, B %u from %u, %s prime groups\n",
+                            params::BITS, B, b_from, groups->count > 0 ? "with" : "without");
+                    check_failures++;
+                }
+
+                unsigned fixed_index = 0;
+                fixed::set_ui32(fixed_env, fixed_x, base);
+                if (b_from > 0) stage1_power<fixed, params>(fixed_env, fixed_x, fixed_n, primes, *groups, 0, b_from,
+                                                            fixed_index, host_never_stop());
+                stage1_power<fixed, params>(fixed_env, fixed_x, fixed_n, primes, *groups, b_from, B, fixed_index,
+                                            host_never_stop());
+                fixed::to_mpz(tmp, fixed_x);
+                if (mpz_cmp(tmp, expected) != 0 || fixed_index != prime_index) {
+                    fprintf(stderr, "Fixed-width stage 1 mismatch: %u bits, B %u from %u, %s prime groups\n",
+                            params::BITS, B, b_from, groups->count > 0 ? "with" : "without");
+                    check_failures++;
+                }
+            }
+        }
+    }
+
+    mpz_clear(e);
+    mpz_clear(tmp);
+    mpz_clear(expected);
+}
+
+int main() {
+    const std::vector<unsigned> primes = check_prime_table(CHECK_PRIMES_LIMIT);
+    const unsigned primes_num = (unsigned) primes.size();
+    ExponentCache exponents(primes.data(), primes_num);
+    gmp_randstate_t random;
+    gmp_randinit_default(random);
+    gmp_randseed_ui(random, CHECK_SEED);
+
+    // every kernel width
+    check_stage1_loop<pollard_params_t<4, 96>>(exponents, primes.data(), primes_num, random);
+    check_stage1_loop<pollard_params_t<4, 128>>(exponents, primes.data(), primes_num, random);
+    check_stage1_loop<pollard_params_t<8, 192>>(exponents, primes.data(), primes_num, random);
+    check_stage1_loop<pollard_params_t<8, 256>>(exponents, primes.data(), primes_num, random);
+    check_stage1_loop<pollard_params_t<16, 384>>(exponents, primes.data(), primes_num, random);
+    check_stage1_loop<pollard_params_t<16, 512>>(exponents, primes.data(), primes_num, random);
+    check_stage1_loop<pollard_params_t<32, 768>>(exponents, primes.data(), primes_num, random);
+    check_stage1_loop<pollard_params_t<32, 1024>>(exponents, primes.data(), primes_num, random);
+    check_stage1_loop<pollard_params_t<32, 2048>>(exponents, primes.data(), primes_num, random);
+    check_stage1_loop<pollard_params_t<32, 4096>>(exponents, primes.data(), primes_num, random);
+    check_stage1_loop<pollard_params_t<32, 8192>>(exponents, primes.data(), primes_num, random);
+
+    gmp_randclear(random);
+    return check_result("stage1_loop");
+}